@@ -779,6 +779,23 @@ struct fx_flac {
 	 */
 	uint8_t chan_cur;
 
+	/**
+	 * Selects which channels are written to the output, see
+	 * fx_flac_set_channel_mode(). Not affected by fx_flac_reset().
+	 */
+	fx_flac_channel_mode_t channel_mode;
+
+	/**
+	 * Bit mask of the subframes in the current frame that must be fully
+	 * reconstructed to produce the requested output.
+	 */
+	uint8_t chan_mask;
+
+	/**
+	 * Block buffer holding the output if only a single channel is written.
+	 */
+	uint8_t chan_out;
+
 	/**
 	 * Pointer into the current block buffer.
 	 */
@@ -889,6 +906,37 @@ static bool _fx_flac_decode_channel_count(
 	return true;
 }
 
+/**
+ * Returns a bit mask of the subframes that have to be restored in order to
+ * produce the output selected by the given channel mode. Residuals of all other
+ * subframes are still read from the bitstream, but LPC restoration and any
+ * further post-processing is skipped.
+ */
+static uint8_t _fx_flac_required_channels(
+    fx_flac_channel_mode_t mode, fx_flac_channel_assignment_t channel_assignment,
+    uint8_t channel_count) {
+	if ((mode == FLAC_CHANNEL_MODE_ALL) || (channel_count == 1U)) {
+		return (uint8_t)((1U << channel_count) - 1U);
+	}
+	switch (channel_assignment) {
+		case LEFT_SIDE_STEREO: /* Left is coded verbatim */
+			return (mode == FLAC_CHANNEL_MODE_LEFT) ? 0x01U : 0x03U;
+		case RIGHT_SIDE_STEREO: /* Right is coded verbatim */
+			return (mode == FLAC_CHANNEL_MODE_RIGHT) ? 0x02U : 0x03U;
+		case MID_SIDE_STEREO: /* Mid is exactly the downmix */
+			return (mode == FLAC_CHANNEL_MODE_DOWNMIX) ? 0x01U : 0x03U;
+		default: /* Independent channels, only the front pair is used */
+			switch (mode) {
+				case FLAC_CHANNEL_MODE_LEFT:
+					return 0x01U;
+				case FLAC_CHANNEL_MODE_RIGHT:
+					return 0x02U;
+				default:
+					return 0x03U;
+			}
+	}
+}
+
 /******************************************************************************
  * Decoding functions                                                         *
  ******************************************************************************/
@@ -927,6 +975,16 @@ static inline void _fx_flac_post_process_mid_side(int32_t *blk1, int32_t *blk2,
 	}
 }
 
+static inline void _fx_flac_post_process_downmix(int32_t *blk1, int32_t *blk2,
+                                                 uint32_t blk_size) {
+	blk1 = (int32_t *)FX_ASSUME_ALIGNED(blk1);
+	blk2 = (int32_t *)FX_ASSUME_ALIGNED(blk2);
+	for (uint32_t i = 0U; i < blk_size; i++) {
+		/* Rounds towards negative infinity, same as the mid channel */
+		blk1[i] = (blk1[i] + blk2[i]) >> 1;
+	}
+}
+
 static inline void _fx_flac_restore_lpc_signal(int32_t *blk, uint32_t blk_size,
                                                int32_t *lpc_coeffs,
                                                uint8_t lpc_order,
@@ -1415,6 +1473,14 @@ static bool _fx_flac_process_search_frame(fx_flac_t *inst) {
 				return _fx_flac_handle_err(inst);
 			}
 
+			/* Figure out which subframes are needed for the output */
+			inst->chan_mask = _fx_flac_required_channels(
+			    inst->channel_mode, fh->channel_assignment, fh->channel_count);
+			inst->chan_out = ((inst->channel_mode == FLAC_CHANNEL_MODE_RIGHT) &&
+			                  (fh->channel_count > 1U))
+			                     ? 1U
+			                     : 0U;
+
 			/* Decode the subframes */
 			inst->state = FLAC_IN_FRAME;
 			inst->priv_state = FLAC_SUBFRAME_HEADER;
@@ -1432,6 +1498,7 @@ static bool _fx_flac_process_in_frame(fx_flac_t *inst) {
 	fx_flac_subframe_header_t *sfh = inst->subframe_header;
 	int32_t *blk = inst->blkbuf[inst->chan_cur % FLAC_MAX_CHANNEL_COUNT];
 	const uint32_t blk_n = fh->block_size;
+	const bool restore = inst->chan_mask & (1U << inst->chan_cur);
 
 	/* Figure out the number of bits to read for sample. This depends on the
 	   channel assignment. */
@@ -1517,7 +1584,7 @@ static bool _fx_flac_process_in_frame(fx_flac_t *inst) {
 			   buffer for this subframe. */
 			blk[0U] = READ_BITS_CRC(bps);
 			blk[0U] = SIGN_EXTEND(blk[0U], bps);
-			for (uint16_t i = 1U; i < blk_n; i++) {
+			for (uint16_t i = 1U; restore && (i < blk_n); i++) {
 				blk[i] = blk[0U];
 			}
 			inst->priv_state = FLAC_SUBFRAME_FINALIZE;
@@ -1669,9 +1736,11 @@ static bool _fx_flac_process_in_frame(fx_flac_t *inst) {
 			/* Go to the next partition or finalize this subframe */
 			inst->partition_cur++;
 			if (inst->partition_cur == (1U << sfh->rice_partition_order)) {
-				/* Decode the residual */
-				_fx_flac_restore_lpc_signal(blk, blk_n, sfh->lpc_coeffs,
-				                            sfh->order, sfh->lpc_shift);
+				/* Decode the residual, unless the channel is not used */
+				if (restore) {
+					_fx_flac_restore_lpc_signal(blk, blk_n, sfh->lpc_coeffs,
+					                            sfh->order, sfh->lpc_shift);
+				}
 				inst->priv_state = FLAC_SUBFRAME_FINALIZE;
 			} else {
 				inst->priv_state = FLAC_SUBFRAME_RICE_INIT;
@@ -1679,7 +1748,7 @@ static bool _fx_flac_process_in_frame(fx_flac_t *inst) {
 			break;
 		case FLAC_SUBFRAME_FINALIZE: {
 			/* Apply the wasted bits transformation */
-			if (sfh->wasted_bits) {
+			if (sfh->wasted_bits && restore) {
 				uint8_t shift = sfh->wasted_bits;
 				for (uint16_t i = 0U; i < blk_n; i++) {
 					blk[i] = blk[i] * (1 << shift);
@@ -1706,27 +1775,37 @@ static bool _fx_flac_process_in_frame(fx_flac_t *inst) {
 			(void)crc16;
 #endif
 
-			/* Post process side-stereo */
+			/* Post process side-stereo, unless a single subframe already
+			   holds the requested output */
 			int32_t *c1 = inst->blkbuf[0], *c2 = inst->blkbuf[1];
-			switch (fh->channel_assignment) {
-				case LEFT_SIDE_STEREO:
-					_fx_flac_post_process_left_side(c1, c2, blk_n);
-					break;
-				case RIGHT_SIDE_STEREO:
-					_fx_flac_post_process_right_side(c1, c2, blk_n);
-					break;
-				case MID_SIDE_STEREO:
-					_fx_flac_post_process_mid_side(c1, c2, blk_n);
-					break;
-				default:
-					break;
+			if (inst->chan_mask == 0x03U) {
+				switch (fh->channel_assignment) {
+					case LEFT_SIDE_STEREO:
+						_fx_flac_post_process_left_side(c1, c2, blk_n);
+						break;
+					case RIGHT_SIDE_STEREO:
+						_fx_flac_post_process_right_side(c1, c2, blk_n);
+						break;
+					case MID_SIDE_STEREO:
+						_fx_flac_post_process_mid_side(c1, c2, blk_n);
+						break;
+					default:
+						break;
+				}
+				if (inst->channel_mode == FLAC_CHANNEL_MODE_DOWNMIX) {
+					_fx_flac_post_process_downmix(c1, c2, blk_n);
+				}
 			}
 
 			/* Shift the output such that the resulting int32 stream can be
 			   played back. */
+			const bool all = inst->channel_mode == FLAC_CHANNEL_MODE_ALL;
 			uint8_t shift = 32U - fh->sample_size;
 			if (shift) {
 				for (uint8_t c = 0U; c < fh->channel_count; c++) {
+					if (!all && (c != inst->chan_out)) {
+						continue;
+					}
 					int32_t *blk = inst->blkbuf[c];
 					for (uint16_t i = 0U; i < blk_n; i++) {
 						blk[i] = blk[i] * (1 << shift);
@@ -1752,8 +1831,10 @@ static bool _fx_flac_process_decoded_frame(fx_flac_t *inst, int32_t *out,
 	/* Fetch the current stream and frame info. */
 	const fx_flac_frame_header_t *fh = inst->frame_header;
 
-	/* Fetch channel count and number of samples left to write */
-	const uint8_t cc = fh->channel_count;
+	/* Fetch channel count and number of samples left to write, in the single
+	   channel modes only one block buffer is written to the output */
+	const bool all = inst->channel_mode == FLAC_CHANNEL_MODE_ALL;
+	const uint8_t cc = all ? fh->channel_count : 1U;
 	uint32_t n_smpls_rem =
 	    (fh->block_size - inst->blk_cur - 1U) * cc + (cc - inst->chan_cur);
 
@@ -1766,7 +1847,8 @@ static bool _fx_flac_process_decoded_frame(fx_flac_t *inst, int32_t *out,
 	uint32_t tar = 0U; /* Number of samples written. */
 	while (tar < n_smpls_rem) {
 		/* Write to the output buffer */
-		out[tar] = inst->blkbuf[inst->chan_cur][inst->blk_cur];
+		out[tar] =
+		    inst->blkbuf[all ? inst->chan_cur : inst->chan_out][inst->blk_cur];
 
 		/* Advance the read and write cursors */
 		inst->chan_cur++;
@@ -1832,6 +1914,7 @@ fx_flac_t *fx_flac_init(void *mem, uint16_t max_block_size,
 		/* Copy the given parameters */
 		inst->max_block_size = max_block_size;
 		inst->max_channels = max_channels;
+		inst->channel_mode = FLAC_CHANNEL_MODE_ALL;
 
 		/* Fetch the base addresses of the internal pointers. */
 		inst->metadata = (fx_flac_metadata_t *)fx_mem_align(
@@ -1892,6 +1975,61 @@ void fx_flac_reset(fx_flac_t *inst) {
 	inst->blk_cur = 0U;
 }
 
+void fx_flac_set_channel_mode(fx_flac_t *inst, fx_flac_channel_mode_t mode) {
+	inst = (fx_flac_t *)FX_ALIGN_ADDR(inst);
+	inst->channel_mode = mode;
+}
+
+bool fx_flac_seek(fx_flac_t *inst) {
+	inst = (fx_flac_t *)FX_ALIGN_ADDR(inst);
+
+	/* Without the streaminfo there is nothing to resume a frame with */
+	if (inst->state < FLAC_END_OF_METADATA || inst->state == FLAC_ERR) {
+		return false;
+	}
+
+	/* Drop the buffered bits and the frame in progress, then search the
+	   next frame header like after a corrupted frame */
+	fx_bitstream_init(&inst->bitstream);
+	inst->state = FLAC_SEARCH_FRAME;
+	inst->priv_state = FLAC_FRAME_SYNC;
+	inst->n_bytes_rem = 0U;
+	inst->crc8 = 0U;
+	inst->crc16 = 0U;
+	inst->coef_cur = 0U;
+	inst->partition_cur = 0U;
+	inst->partition_sample = 0U;
+	inst->rice_unary_counter = 0U;
+	inst->chan_cur = 0U;
+	inst->blk_cur = 0U;
+	return true;
+}
+
+uint32_t fx_flac_get_buffered_bytes(const fx_flac_t *inst) {
+	inst = (fx_flac_t *)FX_ALIGN_ADDR(inst);
+	return (BUFSIZE - inst->bitstream.pos) / 8U;
+}
+
+int64_t fx_flac_get_frame_sample(const fx_flac_t *inst) {
+	inst = (fx_flac_t *)FX_ALIGN_ADDR(inst);
+	const fx_flac_frame_header_t *fh = inst->frame_header;
+	if (inst->state != FLAC_IN_FRAME && inst->state != FLAC_DECODED_FRAME &&
+	    inst->state != FLAC_END_OF_FRAME) {
+		return -1;
+	}
+	if (fh->blocking_strategy == BLK_VARIABLE) {
+		return (int64_t)fh->sync_info;
+	}
+
+	/* A fixed block size stream counts frames, all but the last one have the
+	   block size of the streaminfo */
+	uint32_t block_size = inst->streaminfo->min_block_size;
+	if (block_size == 0U) {
+		block_size = fh->block_size;
+	}
+	return (int64_t)(fh->sync_info * block_size);
+}
+
 fx_flac_state_t fx_flac_get_state(const fx_flac_t *inst) {
 	return ((const fx_flac_t *)FX_ALIGN_ADDR(inst))->state;
 }
@@ -28,6 +28,7 @@
 #define FOXEN_FLAC_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #ifndef FX_EXPORT
 #if __EMSCRIPTEN__
@@ -134,6 +135,36 @@ extern "C"
 		FLAC_END_OF_FRAME = 6
 	} fx_flac_state_t;
 
+	/**
+	 * Enum used in fx_flac_set_channel_mode() to select which channels are
+	 * written to the output.
+	 */
+	typedef enum
+	{
+		/**
+		 * All channels are restored and written interleaved (default).
+		 */
+		FLAC_CHANNEL_MODE_ALL = 0,
+
+		/**
+		 * Only the left (first) channel is written. The other subframes of
+		 * independent and left-side coded frames are parsed but not restored.
+		 */
+		FLAC_CHANNEL_MODE_LEFT = 1,
+
+		/**
+		 * Only the right (second) channel is written. The other subframes of
+		 * independent and right-side coded frames are parsed but not restored.
+		 */
+		FLAC_CHANNEL_MODE_RIGHT = 2,
+
+		/**
+		 * A single channel holding (left + right) / 2 is written. Mid-side coded
+		 * frames output the mid subframe directly without restoring the side.
+		 */
+		FLAC_CHANNEL_MODE_DOWNMIX = 3
+	} fx_flac_channel_mode_t;
+
 	/**
 	 * Enum used in fx_flac_get_streaminfo() to query metadata about the stream.
 	 */
@@ -239,6 +270,53 @@ extern "C"
 	 */
 	FX_EXPORT void fx_flac_reset(fx_flac_t *inst);
 
+	/**
+	 * Selects which channels the decoder writes to the output. Subframes that
+	 * are not needed for the selected output are skipped after parsing their
+	 * residuals. The setting is kept across fx_flac_reset(). The streaminfo
+	 * still reports the channel count of the stream.
+	 *
+	 * @param inst is the FLAC decoder instance.
+	 * @param mode is the channel mode, FLAC_CHANNEL_MODE_ALL after init.
+	 */
+	FX_EXPORT void fx_flac_set_channel_mode(fx_flac_t *inst,
+											fx_flac_channel_mode_t mode);
+
+	/**
+	 * Drops the frame in progress and the buffered input and searches the next
+	 * frame header, for seeking: the caller continues feeding the stream at
+	 * another byte offset. The streaminfo and the channel mode are kept. The
+	 * first frame found is decoded completely, the caller learns where it is
+	 * from fx_flac_get_frame_sample().
+	 *
+	 * @param inst is the FLAC decoder instance.
+	 * @return false if the decoder has not read the metadata yet or is in the
+	 * FLAC_ERR state, nothing is changed then.
+	 */
+	FX_EXPORT bool fx_flac_seek(fx_flac_t *inst);
+
+	/**
+	 * Returns the number of input bytes the decoder took in, i.e. counted in
+	 * in_len, but has not parsed yet. The reader keeps up to eight bytes ahead,
+	 * the byte offset of the decoder in the stream is the input consumed minus
+	 * this, e.g. the offset of the first frame once FLAC_END_OF_METADATA is
+	 * returned.
+	 *
+	 * @param inst is the FLAC decoder instance.
+	 * @return the number of buffered whole bytes.
+	 */
+	FX_EXPORT uint32_t fx_flac_get_buffered_bytes(const fx_flac_t *inst);
+
+	/**
+	 * Returns the number of the first sample (per channel) of the frame that
+	 * is being decoded or was decoded last, computed from the frame header.
+	 *
+	 * @param inst is the FLAC decoder instance.
+	 * @return the sample number, or -1 if the decoder is not in the
+	 * FLAC_IN_FRAME, FLAC_DECODED_FRAME or FLAC_END_OF_FRAME state.
+	 */
+	FX_EXPORT int64_t fx_flac_get_frame_sample(const fx_flac_t *inst);
+
 	/**
 	 * Returns the current decoder state.
 	 *
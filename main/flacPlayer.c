@@ -1,13 +1,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "esp_log.h"
 #include "esp_timer.h"
 
-#include "ulp.h"
 #include "flac.h"
-#include "ulpSound.h"
 #include "flacPlayer.h"
 
 static const char *TAG = "flacPlayer";
@@ -16,24 +15,55 @@ void flac_player_init(flac_player_t *flac_player)
 {
 	flac_player->flac_decoder = NULL;
 	flac_player->idle = true;
+	flac_player->paused = false;
 	flac_player->latest_sample = 0;
+	flac_player->next_file = NULL;
+	flac_player->switch_due = false;
+	flac_player->sink = NULL;
 }
 
-void flac_player_link(flac_player_t *flac_player, ulp_sound_t *ulp)
+void flac_player_link(flac_player_t *flac_player, sound_sink_t *sink)
 {
-	flac_player->ulp = ulp;
-	if (flac_player->ulp == NULL)
+	flac_player->sink = sink;
+	if (flac_player->sink == NULL)
 		ESP_LOGE(TAG, "Cannot link to output!");
 }
 
+// the output of the file opened follows the sink layout
+static void flac_player_configure(flac_player_t *flac_player)
+{
+	uint8_t source_channels = fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_N_CHANNELS);
+	ESP_LOGI(TAG, "Got source channels: %u", source_channels);
+	uint8_t source_bits = fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_SAMPLE_SIZE);
+	ESP_LOGI(TAG, "Got source bits: %u", source_bits);
+
+	// keep both channels only if the sink plays them, otherwise let the decoder downmix and skip unused subframes
+	flac_player->interleaved = (flac_player->layout.channels == 2) && (source_channels == 2);
+	flac_player->duplicate = flac_player->layout.dual && !flac_player->interleaved;
+	flac_player->fine = flac_player->layout.fraction_bits > 0;
+	flac_player->unit_len = (!flac_player->fine && (flac_player->interleaved || flac_player->duplicate)) ? 2 : 1;
+	flac_player->output_channel = 0;
+	fx_flac_set_channel_mode(flac_player->flac_decoder, flac_player->interleaved ? FLAC_CHANNEL_MODE_ALL : FLAC_CHANNEL_MODE_DOWNMIX);
+	requantizer_init(&flac_player->requantizer[0], source_bits);
+	requantizer_init(&flac_player->requantizer[1], source_bits);
+}
+
 void flac_player_play(flac_player_t *flac_player, const unsigned char *flac_file, uint32_t file_size)
 {
 	flac_player->flac_file_addr = flac_file;
 	flac_player->flac_file_size = file_size;
 	flac_player->flac_file_bytes_read = 0;
 	flac_player->idle = false;
+	flac_player->paused = false;
+	flac_player->anchor_due = false;
+	flac_player->switch_due = false;
+	flac_player->next_file = NULL;
+	flac_player->decoded = 0;
 	flac_player->num_glitches = 0;
+	flac_player->output_samples_len = 0;
+	flac_player->output_samples_pos = 0;
 	flac_player->start_time_us = esp_timer_get_time();
+	refill_scheduler_init(&flac_player->scheduler, FLAC_PLAYER_REFILL_GUARD_US, FLAC_PLAYER_MIN_SLEEP_US, FLAC_PLAYER_MAX_SLEEP_US);
 
 	ESP_LOGI(TAG, "File address: %p", flac_player->flac_file_addr);
 	ESP_LOGI(TAG, "File size: %u bytes", flac_player->flac_file_size);
@@ -41,7 +71,19 @@ void flac_player_play(flac_player_t *flac_player, const unsigned char *flac_file
 	flac_player_init_flac_decoder(flac_player);
 	int64_t source_sampling_rate = flac_player_get_sampling_rate(flac_player);
 	ESP_LOGI(TAG, "Got source SR: %lu", (uint32_t)source_sampling_rate);
-	ulp_sound_init(flac_player->ulp, source_sampling_rate);
+
+	sound_sink_start(flac_player->sink, source_sampling_rate, &flac_player->layout);
+	flac_player_configure(flac_player);
+	flac_player->hold = flac_player->fine ? 0x80 : 0x8080;
+
+	// the file starts right after the prefilled lap of silence
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	flac_player->stream_start = position.written;
+	flac_player->stream_offset = 0;
+	flac_player->previous_start = position.written;
+	flac_player->previous_offset = 0;
+	flac_player->previous_end = 0;
 }
 
 fx_flac_state_t flac_player_init_flac_decoder(flac_player_t *flac_player)
@@ -75,7 +117,9 @@ fx_flac_state_t flac_player_init_flac_decoder(flac_player_t *flac_player)
 			break;
 		case FLAC_END_OF_METADATA:
 			ESP_LOGI(TAG, "Initialized FLAC decoder");
-			ESP_LOGI(TAG, "First frame offset: %u", flac_player->flac_file_bytes_read);
+			// the decoder reads ahead of the metadata it parsed
+			flac_player->first_frame_offset = flac_player->flac_file_bytes_read - fx_flac_get_buffered_bytes(flac_player->flac_decoder);
+			ESP_LOGI(TAG, "First frame offset: %u", flac_player->first_frame_offset);
 			return state;
 		case FLAC_SEARCH_FRAME:
 			if (flac_player->flac_file_size <= flac_player->flac_file_bytes_read)
@@ -97,19 +141,112 @@ fx_flac_state_t flac_player_init_flac_decoder(flac_player_t *flac_player)
 	return state;
 }
 
-uint8_t flac_player_get_next_sample(flac_player_t *flac_player)
+// sample of the file the next sample written to the sink comes from
+static uint64_t flac_player_next_file_sample(flac_player_t *flac_player)
+{
+	size_t pending = flac_player->output_samples_len - flac_player->output_samples_pos;
+	// the sample completing a word at the end was never decoded
+	return (flac_player->decoded > pending) ? (flac_player->decoded - pending) / flac_player->unit_len : 0;
+}
+
+// the file continues at offset from the FIFO position start, the current anchor ends where the file got to
+static void flac_player_anchor(flac_player_t *flac_player, uint64_t start, uint64_t offset)
+{
+	flac_player->previous_start = flac_player->stream_start;
+	flac_player->previous_offset = flac_player->stream_offset;
+	flac_player->previous_end = flac_player_next_file_sample(flac_player);
+	flac_player->stream_start = start;
+	flac_player->stream_offset = offset;
+}
+
+// the first block after a seek, keep entries ahead of it are still to be written
+static void flac_player_anchor_frame(flac_player_t *flac_player, size_t keep)
+{
+	int64_t frame_sample = fx_flac_get_frame_sample(flac_player->flac_decoder);
+	if (frame_sample < 0)
+		return;
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	// replaces the estimate of the seek, the previous anchor stays
+	flac_player->stream_start = position.written + keep / flac_player->unit_len;
+	flac_player->stream_offset = frame_sample;
+	flac_player->decoded = (uint64_t)frame_sample * flac_player->unit_len + keep;
+	flac_player->anchor_due = false;
+	ESP_LOGI(TAG, "Seek landed on sample %lu", (uint32_t)frame_sample);
+}
+
+// at the end of the file playing, opens the next one for the sink to take right behind the keep entries left
+static bool flac_player_follow(flac_player_t *flac_player, size_t keep)
 {
+	if (flac_player->next_file == NULL)
+		return false;
+	int64_t previous_sampling_rate = flac_player_get_sampling_rate(flac_player);
+	// the decoder is done with the old file, the leftover is in the output buffer
+	flac_player->flac_file_addr = flac_player->next_file;
+	flac_player->flac_file_size = flac_player->next_size;
+	flac_player->flac_file_bytes_read = 0;
+	flac_player->next_file = NULL;
+	ESP_LOGI(TAG, "Following with %p, %u bytes", flac_player->flac_file_addr, flac_player->flac_file_size);
+	if (flac_player_init_flac_decoder(flac_player) != FLAC_END_OF_METADATA)
+		return false;
+	int64_t source_sampling_rate = flac_player_get_sampling_rate(flac_player);
+
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	uint64_t start = position.written + keep / flac_player->unit_len;
+	if (!sound_sink_follow(flac_player->sink, source_sampling_rate, start))
+	{
+		ESP_LOGI(TAG, "Sink cannot follow at %lu Hz, starting over after the end", (uint32_t)source_sampling_rate);
+		flac_player->next_file = flac_player->flac_file_addr;
+		flac_player->next_size = flac_player->flac_file_size;
+		return false;
+	}
+
+	// the old file ends where the new one starts, the odd sample left completes a word with the first new one
+	flac_player_anchor(flac_player, start, 0);
+	flac_player_configure(flac_player);
+	flac_player->decoded = keep;
+	flac_player->anchor_due = false;
+	flac_player->num_glitches = 0;
+	flac_player->start_time_us = esp_timer_get_time();
+	if (source_sampling_rate != previous_sampling_rate)
+	{
+		ESP_LOGI(TAG, "Sampling rate %lu Hz from sample %lu", (uint32_t)source_sampling_rate, (uint32_t)start);
+		flac_player->switch_due = true;
+		flac_player->switch_pos = start;
+	}
+	return true;
+}
+
+// decodes the next block behind the samples not yet written, once idle it only completes a leftover sample to a word
+static void flac_player_decode_block(flac_player_t *flac_player)
+{
+	// the FIFO takes whole words, at most one sample is left over
+	size_t keep = flac_player->output_samples_len - flac_player->output_samples_pos;
+	if (flac_player->fine)
+		memmove(flac_player->output_words_buffer, flac_player->output_words_buffer + flac_player->output_samples_pos, keep * sizeof(uint16_t));
+	else
+		memmove(flac_player->output_samples_buffer, flac_player->output_samples_buffer + flac_player->output_samples_pos, keep);
+	flac_player->output_samples_pos = 0;
+	flac_player->output_samples_len = keep;
+	uint8_t *out = flac_player->output_samples_buffer + keep;
+	uint16_t *out_words = flac_player->output_words_buffer + keep;
+
 	while (true)
 	{
+		// the stream ends on the last decoded sample, the sink plays nothing stale behind it
 		if (flac_player->idle)
-			return flac_player->latest_sample;
-
-		uint32_t buf_len = 2UL;
-		int32_t size_to_read = flac_player->flac_file_size - flac_player->flac_file_bytes_read;
-		if (buf_len > size_to_read)
-			buf_len = size_to_read;
+		{
+			if (!flac_player->fine && (keep & 1))
+			{
+				out[0] = flac_player->latest_sample;
+				flac_player->output_samples_len++;
+			}
+			return;
+		}
 
-		uint32_t out_buf_len = 1;
+		uint32_t buf_len = flac_player->flac_file_size - flac_player->flac_file_bytes_read;
+		uint32_t out_buf_len = flac_player->fine ? FLAC_PLAYER_DECODE_BLOCK_LEN - keep : FLAC_PLAYER_DECODE_BLOCK_LEN;
 		fx_flac_state_t state = fx_flac_process(flac_player->flac_decoder, flac_player->flac_file_addr + flac_player->flac_file_bytes_read, &buf_len, flac_player->decoder_decoded_samples_buffer, &out_buf_len);
 		flac_player->flac_file_bytes_read += buf_len;
 
@@ -130,8 +267,17 @@ uint8_t flac_player_get_next_sample(flac_player_t *flac_player)
 				ESP_LOGV(TAG, "flac_player->decoder_decoded_samples_buffer: %p", flac_player->decoder_decoded_samples_buffer);
 				ESP_LOGV(TAG, "out_buf_len: %lu", out_buf_len);
 				ESP_LOGI(TAG, "Reached end of file");
-				ESP_LOGI(TAG, "playtime %6.3f sec", (esp_timer_get_time() - flac_player->start_time_us) / 1000000.0f);
-				flac_player->idle = true;
+				sound_sink_position_t position;
+				sound_sink_get_position(flac_player->sink, &position);
+				ESP_LOGI(TAG, "decoded in %6.3f sec, played %6.3f sec, %lu ms to the DAC", (esp_timer_get_time() - flac_player->start_time_us) / 1000000.0f,
+						 flac_player_get_position_us(flac_player) / 1000000.0f, position.latency_us / 1000);
+				sound_sink_log_telemetry(flac_player->sink, false);
+				refill_scheduler_telemetry_t scheduler;
+				refill_scheduler_get_telemetry(&flac_player->scheduler, &scheduler, false);
+				ESP_LOGI(TAG, "%lu refills, %lu followed by a sleep of %6.3f ms on average, least headroom %6.3f ms, longest refill %6.3f ms", scheduler.refills, scheduler.sleeps,
+						 scheduler.sleeps ? scheduler.slept_us / 1000.0f / scheduler.sleeps : 0.0f, scheduler.min_margin_us / 1000.0f, scheduler.max_refill_us / 1000.0f);
+				if (!flac_player_follow(flac_player, keep))
+					flac_player->idle = true;
 			}
 			break;
 		default:
@@ -141,15 +287,57 @@ uint8_t flac_player_get_next_sample(flac_player_t *flac_player)
 		}
 		// ESP_LOGI(TAG, "%08X", flac_player->decoder_decoded_samples_buffer[0]);
 		// ESP_LOGI(TAG, "R%d,W%d bytes", buf_len, out_buf_len);
-		if (out_buf_len == 1)
+		if (out_buf_len > 0 && flac_player->anchor_due)
+			flac_player_anchor_frame(flac_player, keep);
+		if (out_buf_len > 0 && flac_player->fine)
 		{
-			flac_player->latest_sample = ((flac_player->decoder_decoded_samples_buffer[0] >> 24) & 0xFF) + 0x80;
-			// ESP_LOGI(TAG, "%02X", sample);
-			return flac_player->latest_sample;
+			// one word per sample, the DAC code and the bits the ULP plays as sub-samples
+			requantizer_process_fine(&flac_player->requantizer[0], flac_player->decoder_decoded_samples_buffer, out_words, out_buf_len);
+			flac_player->output_samples_len += out_buf_len;
+			flac_player->decoded += out_buf_len;
+			flac_player->latest_word = out_words[out_buf_len - 1];
+			return;
+		}
+		if (out_buf_len > 0)
+		{
+			// requantize the whole block to the 8 bit DAC in one go
+			if (flac_player->interleaved)
+			{
+				uint8_t first = flac_player->output_channel;
+				requantizer_process_stride(&flac_player->requantizer[first], flac_player->decoder_decoded_samples_buffer, out, out_buf_len, 2);
+				requantizer_process_stride(&flac_player->requantizer[first ^ 1], flac_player->decoder_decoded_samples_buffer + 1, out + 1, out_buf_len - 1, 2);
+				flac_player->output_channel ^= out_buf_len & 1;
+			}
+			else
+				requantizer_process(&flac_player->requantizer[0], flac_player->decoder_decoded_samples_buffer, out, out_buf_len);
+
+			// every sample goes to both bytes of a word, spread back to front so nothing is overwritten early
+			if (flac_player->duplicate)
+			{
+				for (size_t i = out_buf_len; i-- > 0;)
+					out[i * 2] = out[i * 2 + 1] = out[i];
+				out_buf_len *= 2;
+			}
+			flac_player->output_samples_len += out_buf_len;
+			flac_player->decoded += out_buf_len;
+			flac_player->latest_sample = out[out_buf_len - 1];
+			return;
 		}
 	}
 }
 
+// next byte in FIFO order, with the duplication for both DACs already applied
+uint8_t flac_player_get_next_sample(flac_player_t *flac_player)
+{
+	if (flac_player->output_samples_pos == flac_player->output_samples_len)
+		flac_player_decode_block(flac_player);
+	if (flac_player->output_samples_pos == flac_player->output_samples_len)
+		return flac_player->fine ? flac_player->latest_word & 0xFF : flac_player->latest_sample;
+	if (flac_player->fine)
+		return flac_player->output_words_buffer[flac_player->output_samples_pos++] & 0xFF;
+	return flac_player->output_samples_buffer[flac_player->output_samples_pos++];
+}
+
 int64_t flac_player_get_sampling_rate(flac_player_t *flac_player)
 {
 	int64_t sampling_rate = fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_SAMPLE_RATE);
@@ -158,27 +346,236 @@ int64_t flac_player_get_sampling_rate(flac_player_t *flac_player)
 	return sampling_rate;
 }
 
-void flac_player_refill(flac_player_t *flac_player)
+// sample of the file at the DAC, without the prefill, the stale words of underruns and the level held in a pause
+uint64_t flac_player_get_played_samples(flac_player_t *flac_player)
+{
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	uint64_t played = (position.played > position.stale) ? position.played - position.stale : 0;
+	// nothing past the last file sample written has played, the rest is the level held in a pause
+	if (played >= flac_player->stream_start)
+	{
+		uint64_t current = flac_player->stream_offset + played - flac_player->stream_start;
+		uint64_t end = flac_player_next_file_sample(flac_player);
+		return (current < end) ? current : end;
+	}
+	if (played < flac_player->previous_start)
+		return flac_player->previous_offset;
+	uint64_t previous = flac_player->previous_offset + played - flac_player->previous_start;
+	return (previous < flac_player->previous_end) ? previous : flac_player->previous_end;
+}
+
+// playback position in the file by the samples that reached the DAC, for syncing to the audio
+int64_t flac_player_get_position_us(flac_player_t *flac_player)
+{
+	return sound_sink_samples_to_us(flac_player->sink, flac_player_get_played_samples(flac_player));
+}
+
+// a pause repeats the last word written, a level step would click
+static void flac_player_fill_hold(flac_player_t *flac_player, uint16_t buffer_diff)
+{
+	size_t free_words = buffer_diff;
+	size_t written = 1;
+	if (flac_player->fine)
+	{
+		uint16_t words[FLAC_PLAYER_DECODE_BLOCK_LEN];
+		for (size_t i = 0; i < FLAC_PLAYER_DECODE_BLOCK_LEN; i++)
+			words[i] = flac_player->hold;
+		while ((free_words > 0) && (written > 0))
+		{
+			written = sound_sink_write_words(flac_player->sink, words, free_words < FLAC_PLAYER_DECODE_BLOCK_LEN ? free_words : FLAC_PLAYER_DECODE_BLOCK_LEN);
+			free_words -= written;
+		}
+		return;
+	}
+	uint8_t samples[FLAC_PLAYER_DECODE_BLOCK_LEN * 2];
+	for (size_t i = 0; i < sizeof(samples); i += 2)
+	{
+		samples[i] = flac_player->hold & 0xFF;
+		samples[i + 1] = flac_player->hold >> 8;
+	}
+	while ((free_words > 0) && (written > 0))
+	{
+		written = sound_sink_write(flac_player->sink, samples, free_words * 2 < sizeof(samples) ? free_words * 2 : sizeof(samples));
+		free_words -= written / 2;
+	}
+}
+
+// writes up to the free space of the sink
+static void flac_player_fill(flac_player_t *flac_player)
 {
-	uint16_t buffer_diff = ulp_sound_get_buffer_diff(flac_player->ulp);
+	uint16_t buffer_diff = sound_sink_get_buffer_diff(flac_player->sink);
 	if (buffer_diff == 0)
 	{
 		ESP_LOGW(TAG, "FIFO buffer is full, did ULP stopped?");
 		flac_player->num_glitches++;
 	}
-	for (uint32_t i = 0; i < buffer_diff; i++)
-		ulp_sound_refill(flac_player->ulp, flac_player_get_next_sample(flac_player) | flac_player_get_next_sample(flac_player) << 8);
+	if (flac_player->paused)
+		flac_player_fill_hold(flac_player, buffer_diff);
+	else if (flac_player->fine)
+	{
+		// one word per sample, nothing is left over
+		size_t free_words = buffer_diff;
+		while (free_words > 0)
+		{
+			if (flac_player->output_samples_pos == flac_player->output_samples_len)
+				flac_player_decode_block(flac_player);
+			size_t available = flac_player->output_samples_len - flac_player->output_samples_pos;
+			size_t written = sound_sink_write_words(flac_player->sink, flac_player->output_words_buffer + flac_player->output_samples_pos, available < free_words ? available : free_words);
+			if (written == 0)
+				break;
+			flac_player->output_samples_pos += written;
+			flac_player->hold = flac_player->output_words_buffer[flac_player->output_samples_pos - 1];
+			free_words -= written;
+		}
+	}
+	else
+	{
+		// whole decoded blocks go out in bulk, a sample left over from an odd block leads the next one
+		size_t free_samples = (size_t)buffer_diff * 2;
+		while (free_samples > 0)
+		{
+			while ((flac_player->output_samples_len - flac_player->output_samples_pos < 2) && !flac_player->idle)
+				flac_player_decode_block(flac_player);
+			// at the end a leftover sample is completed to a word, then there is nothing left
+			if (flac_player->output_samples_len - flac_player->output_samples_pos < 2)
+				flac_player_decode_block(flac_player);
+			size_t available = flac_player->output_samples_len - flac_player->output_samples_pos;
+			size_t written = sound_sink_write(flac_player->sink, flac_player->output_samples_buffer + flac_player->output_samples_pos, available < free_samples ? available : free_samples);
+			if (written == 0)
+				break;
+			flac_player->output_samples_pos += written;
+			flac_player->hold = flac_player->output_samples_buffer[flac_player->output_samples_pos - 2] | (flac_player->output_samples_buffer[flac_player->output_samples_pos - 1] << 8);
+			free_samples -= written;
+		}
+	}
 	ESP_LOGV(TAG, "Filled %d words", buffer_diff);
 	if (flac_player->num_glitches >= 100)
 	{
-		ESP_LOGE(TAG, "Forcing player to stop, playtime %6.3f sec", (esp_timer_get_time() - flac_player->start_time_us) / 1000000.0f);
+		ESP_LOGE(TAG, "Forcing player to stop, played %6.3f sec", flac_player_get_position_us(flac_player) / 1000000.0f);
 		flac_player->idle = true;
-		ulp_print_status();
-		// ulp_print_mem(RTC_SLOW_MEM, 8192);
+		flac_player->output_samples_pos = flac_player->output_samples_len;
+		sound_sink_log_telemetry(flac_player->sink, true);
 	}
 }
 
+void flac_player_set_next(flac_player_t *flac_player, const unsigned char *flac_file, uint32_t file_size)
+{
+	flac_player->next_file = flac_file;
+	flac_player->next_size = file_size;
+}
+
+bool flac_player_has_next(flac_player_t *flac_player)
+{
+	return flac_player->next_file != NULL;
+}
+
+bool flac_player_play_next(flac_player_t *flac_player)
+{
+	const unsigned char *flac_file = flac_player->next_file;
+	if (flac_file == NULL)
+		return false;
+	flac_player_play(flac_player, flac_file, flac_player->next_size);
+	return true;
+}
+
+void flac_player_stop(flac_player_t *flac_player)
+{
+	if (!flac_player->idle)
+		ESP_LOGI(TAG, "Stopped at %6.3f sec", flac_player_get_position_us(flac_player) / 1000000.0f);
+	// the position ends with the last sample written
+	flac_player->decoded = flac_player_next_file_sample(flac_player) * flac_player->unit_len;
+	flac_player->idle = true;
+	flac_player->paused = false;
+	flac_player->next_file = NULL;
+	flac_player->output_samples_pos = flac_player->output_samples_len;
+}
+
+void flac_player_set_paused(flac_player_t *flac_player, bool paused)
+{
+	if (paused == flac_player->paused)
+		return;
+	flac_player->paused = paused;
+	if (paused || flac_player->anchor_due)
+		return;
+	// the held level lies between the written file samples and the ones that follow now
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	flac_player_anchor(flac_player, position.written, flac_player_next_file_sample(flac_player));
+}
+
+bool flac_player_seek(flac_player_t *flac_player, uint64_t sample)
+{
+	if (flac_player->flac_decoder == NULL)
+		return false;
+	uint64_t n_samples = fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_N_SAMPLES);
+	if (n_samples == 0)
+	{
+		ESP_LOGW(TAG, "Cannot seek without the sample count");
+		return false;
+	}
+	if (sample > n_samples)
+		sample = n_samples;
+
+	// the bitrate varies, start a frame early so the frame found is rather before the target than past it
+	uint64_t frames_len = flac_player->flac_file_size - flac_player->first_frame_offset;
+	uint64_t offset = frames_len * sample / n_samples;
+	uint64_t frame_size = fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_MAX_FRAME_SIZE);
+	if (frame_size == 0) // unknown to the encoder, take the average
+		frame_size = frames_len * fx_flac_get_streaminfo(flac_player->flac_decoder, FLAC_KEY_MAX_BLOCK_SIZE) / n_samples;
+	offset = (offset > frame_size) ? offset - frame_size : 0;
+	if (!fx_flac_seek(flac_player->flac_decoder))
+		return false;
+
+	// the FIFO plays out, the position shows the target until the frame found tells better
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	flac_player_anchor(flac_player, position.written, sample);
+	flac_player->output_samples_pos = flac_player->output_samples_len = 0;
+	flac_player->decoded = sample * flac_player->unit_len;
+	flac_player->output_channel = 0;
+	flac_player->flac_file_bytes_read = flac_player->first_frame_offset + offset;
+	flac_player->anchor_due = true;
+	flac_player->idle = false;
+	ESP_LOGI(TAG, "Seek to %6.3f sec at byte %u", (float)sample / flac_player_get_sampling_rate(flac_player), flac_player->flac_file_bytes_read);
+	return true;
+}
+
+void flac_player_refill(flac_player_t *flac_player)
+{
+	int64_t start_us = esp_timer_get_time();
+	sound_sink_position_t before;
+	sound_sink_get_position(flac_player->sink, &before);
+	refill_scheduler_begin(&flac_player->scheduler, before.latency_us);
+
+	flac_player_fill(flac_player);
+	// the sink took the new rate as it looked at its buffer
+	if (flac_player->switch_due && (before.played >= flac_player->switch_pos))
+		flac_player->switch_due = false;
+
+	sound_sink_position_t after;
+	sound_sink_get_position(flac_player->sink, &after);
+	uint64_t written_us = sound_sink_samples_to_us(flac_player->sink, after.written - before.written);
+	refill_scheduler_end(&flac_player->scheduler, esp_timer_get_time() - start_us, written_us, after.latency_us);
+}
+
+// time the sink plays on its headroom before the next refill is due, 0 to refill at once
+uint32_t flac_player_get_sleep_us(flac_player_t *flac_player)
+{
+	uint32_t sleep_us = flac_player->scheduler.sleep_us;
+	if (!flac_player->switch_due)
+		return sleep_us;
+	// wake where the next file starts, the refill there changes the rate
+	sound_sink_position_t position;
+	sound_sink_get_position(flac_player->sink, &position);
+	if (position.played >= flac_player->switch_pos)
+		return 0;
+	uint64_t switch_us = sound_sink_samples_to_us(flac_player->sink, flac_player->switch_pos - position.played);
+	return (switch_us < sleep_us) ? switch_us : sleep_us;
+}
+
+// until the last decoded sample went to the sink, then the sink's end can follow
 bool flac_player_is_playing(flac_player_t *flac_player)
 {
-	return !flac_player->idle;
+	return !flac_player->idle || (flac_player->output_samples_pos < flac_player->output_samples_len);
 }
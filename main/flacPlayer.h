@@ -4,31 +4,102 @@
 #include <stdbool.h>
 
 #include "flac.h"
-#include "ulpSound.h"
+#include "soundSink.h"
+#include "requantizer.h"
+#include "refillScheduler.h"
+
+#define FLAC_PLAYER_DECODE_BLOCK_LEN 64
+#define FLAC_PLAYER_REFILL_GUARD_US 5000 // headroom left at the refill, covers the light sleep wakeup and timer jitter
+#define FLAC_PLAYER_MIN_SLEEP_US 2000	 // light sleep entry and exit cost more below this
+#define FLAC_PLAYER_MAX_SLEEP_US 1000000
+
+/* - position anchors -                                        *\
+ * The samples written from stream_start on are the file from   *
+ * stream_offset on. Resume and seek start a new anchor, the     *
+ * previous one stays until the sink played past the FIFO        *
+ * position the new one starts at, it ends at previous_end. The  *
+\* level held during a pause belongs to neither.                 */
+
+/* - gapless follow -                                          *\
+ * A file set as next is opened by the refill that reaches the  *
+ * end of the current one, on the same decoder, and its samples *
+ * go to the sink right behind the last ones, no start and no   *
+ * prefill in between. It becomes the file playing with a new   *
+ * anchor, the previous one covers the rest of the old file. A  *
+ * sink that cannot follow, see sound_sink_follow(), leaves it  *
+ * to flac_player_play_next() once the old file played out. At  *
+ * another sampling rate the sleep ends where the new file      *
+\* starts, the refill there lets the sink change its rate.      */
 
 typedef struct
 {
 	fx_flac_t *flac_decoder;
-	ulp_sound_t *ulp;
+	sound_sink_t *sink;
 
 	const unsigned char *flac_file_addr;
 	size_t flac_file_bytes_read;
-	int32_t decoder_decoded_samples_buffer[2];
+	int32_t decoder_decoded_samples_buffer[FLAC_PLAYER_DECODE_BLOCK_LEN];
 	size_t flac_file_size;
+	const unsigned char *next_file; // NULL for none
+	uint32_t next_size;
+	sound_sink_layout_t layout; // as the sink started
+
+	bool interleaved;			  // decoded block alternates left and right samples
+	bool duplicate;				  // every sample goes to both bytes of a word
+	bool fine;					  // sink takes bits below the DAC LSB, the block goes out as whole words
+	uint8_t output_channel;		  // channel of the first sample of the next block
+	requantizer_t requantizer[2]; // one per channel, the error feedback must not mix them
+	uint8_t output_samples_buffer[FLAC_PLAYER_DECODE_BLOCK_LEN * 2 + 1]; // duplicated block plus a leftover sample
+	uint16_t output_words_buffer[FLAC_PLAYER_DECODE_BLOCK_LEN]; // fine mode, DAC code plus fraction per sample
+	size_t output_samples_len; // in words in fine mode
+	size_t output_samples_pos;
 
 	int64_t start_time_us;
+	size_t first_frame_offset;
+	uint8_t unit_len; // output buffer entries per sink position, two for a word per sample or frame
+	uint64_t decoded; // output buffer entries since the start of the file, continued from the frame after a seek
+
+	uint64_t stream_start;	// FIFO position, written order without stale words, see sound_sink_position_t
+	uint64_t stream_offset; // sample of the file written at stream_start
+	uint64_t previous_start;
+	uint64_t previous_offset;
+	uint64_t previous_end;
+	bool anchor_due; // a seek landed somewhere, the first decoded frame tells where
+	bool switch_due; // the sink changes its sampling rate at switch_pos
+	uint64_t switch_pos;
+
 	size_t num_glitches;
 	bool idle;
+	bool paused; // refills hold the last written word until resumed
 	uint8_t latest_sample;
+	uint16_t latest_word;
+	uint16_t hold; // last word written, both samples or the fine word
+	refill_scheduler_t scheduler;
 } flac_player_t;
 
 void flac_player_init(flac_player_t *flac_player);
-void flac_player_link(flac_player_t *flac_player, ulp_sound_t *ulp);
+void flac_player_link(flac_player_t *flac_player, sound_sink_t *sink);
 void flac_player_play(flac_player_t *flac_player, const unsigned char *flac_file, uint32_t file_size);
 
 fx_flac_state_t flac_player_init_flac_decoder(flac_player_t *flac_player);
 uint8_t flac_player_get_next_sample(flac_player_t *flac_player);
 int64_t flac_player_get_sampling_rate(flac_player_t *flac_player);
 
+uint64_t flac_player_get_played_samples(flac_player_t *flac_player);
+int64_t flac_player_get_position_us(flac_player_t *flac_player);
+
+// follows the file playing without a gap, replaces a next file set before
+void flac_player_set_next(flac_player_t *flac_player, const unsigned char *flac_file, uint32_t file_size);
+bool flac_player_has_next(flac_player_t *flac_player);
+// plays the next file from a start of the sink, for when it could not follow, false without one
+bool flac_player_play_next(flac_player_t *flac_player);
+// drops the samples not yet written and the next file, the sink plays what it has and the player is idle
+void flac_player_stop(flac_player_t *flac_player);
+// takes effect once the sink played what it has, the refills hold the level meanwhile
+void flac_player_set_paused(flac_player_t *flac_player, bool paused);
+// continues at the frame that the byte offset estimated from the streaminfo lands on, false without the sample count
+bool flac_player_seek(flac_player_t *flac_player, uint64_t sample);
+
 void flac_player_refill(flac_player_t *flac_player);
+uint32_t flac_player_get_sleep_us(flac_player_t *flac_player);
 bool flac_player_is_playing(flac_player_t *flac_player);
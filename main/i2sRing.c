@@ -0,0 +1,144 @@
+#include <string.h>
+
+#include "i2sRing.h"
+
+void i2s_ring_init(i2s_ring_t *ring, uint16_t buffers, uint16_t buffer_frames)
+{
+	memset(ring, 0, sizeof(*ring));
+	if (buffers > I2S_RING_MAX_BUFFERS)
+		buffers = I2S_RING_MAX_BUFFERS;
+	ring->buffers = buffers;
+	ring->buffer_frames = buffer_frames;
+	// the DMA is on the first buffer, the rest of the lap waits for it
+	for (uint16_t i = 0; i < buffers; i++)
+	{
+		ring->written[i] = (i > 0);
+		ring->pos[i] = (uint64_t)i * buffer_frames;
+	}
+	ring->write_pos = (uint64_t)buffers * buffer_frames;
+	ring->play_pos = buffer_frames;
+	ring->telemetry.min_headroom = UINT32_MAX;
+}
+
+// written frames the DMA has not started, the held buffer plays after the full ones
+static uint32_t i2s_ring_headroom(const i2s_ring_t *ring)
+{
+	uint32_t full = 0;
+	for (uint16_t i = 0; i < ring->buffers; i++)
+		full += ring->written[i];
+	return full * ring->buffer_frames + (ring->holding ? ring->fill : 0);
+}
+
+// frames of the run at pos the DMA plays again, below what it played already, counts the rest as played
+static uint32_t i2s_ring_replay(i2s_ring_t *ring, uint64_t pos, uint32_t frames)
+{
+	if (pos + frames <= ring->play_pos)
+		return frames;
+	uint32_t stale = (pos < ring->play_pos) ? ring->play_pos - pos : 0;
+	ring->play_pos = pos + frames;
+	return stale;
+}
+
+void i2s_ring_done(i2s_ring_t *ring)
+{
+	uint8_t finished = ring->dma;
+	ring->done++;
+	ring->dma = (ring->dma + 1) % ring->buffers;
+	if (ring->dma == 0)
+		ring->telemetry.laps++;
+
+	// a full queue drops its oldest entry for the new one
+	if (ring->queued == ring->buffers - 1)
+	{
+		ring->queue_head = (ring->queue_head + 1) % ring->buffers;
+		ring->queued--;
+	}
+	ring->queue[(ring->queue_head + ring->queued) % ring->buffers] = finished;
+	ring->queued++;
+
+	// what the writer already put into the held buffer plays before the older lap behind it
+	uint32_t stale;
+	if (ring->holding && ring->held == ring->dma)
+		stale = i2s_ring_replay(ring, ring->held_pos, ring->fill) + i2s_ring_replay(ring, ring->pos[ring->dma] + ring->fill, ring->buffer_frames - ring->fill);
+	else
+		stale = i2s_ring_replay(ring, ring->pos[ring->dma], ring->buffer_frames);
+	if (stale > 0)
+	{
+		ring->stale_frames += stale;
+		ring->telemetry.underruns++;
+		ring->telemetry.underrun_frames += stale;
+	}
+	ring->written[ring->dma] = false;
+}
+
+uint32_t i2s_ring_free_frames(const i2s_ring_t *ring)
+{
+	uint32_t free_frames = (uint32_t)ring->queued * ring->buffer_frames;
+	if (ring->holding)
+		free_frames += ring->buffer_frames - ring->fill;
+	return free_frames;
+}
+
+uint32_t i2s_ring_poll(i2s_ring_t *ring)
+{
+	uint32_t headroom = i2s_ring_headroom(ring);
+	if (headroom < ring->telemetry.min_headroom)
+		ring->telemetry.min_headroom = headroom;
+	uint32_t free_frames = i2s_ring_free_frames(ring);
+	if (free_frames == 0)
+		ring->telemetry.overruns++;
+	return free_frames;
+}
+
+void i2s_ring_commit(i2s_ring_t *ring, uint32_t frames)
+{
+	while (frames > 0)
+	{
+		if (!ring->holding)
+		{
+			if (ring->queued == 0)
+				return;
+			ring->held = ring->queue[ring->queue_head];
+			ring->queue_head = (ring->queue_head + 1) % ring->buffers;
+			ring->queued--;
+			ring->holding = true;
+			ring->fill = 0;
+			ring->held_pos = ring->write_pos;
+		}
+		uint32_t n = ring->buffer_frames - ring->fill;
+		if (n > frames)
+			n = frames;
+		ring->fill += n;
+		ring->write_pos += n;
+		frames -= n;
+		// the driver keeps a full buffer until the next write asks for another one
+		if (ring->fill == ring->buffer_frames)
+		{
+			ring->written[ring->held] = true;
+			ring->pos[ring->held] = ring->held_pos;
+			ring->holding = false;
+		}
+	}
+}
+
+void i2s_ring_resync(i2s_ring_t *ring)
+{
+	ring->queued = 0;
+	ring->holding = false;
+}
+
+uint64_t i2s_ring_played(const i2s_ring_t *ring)
+{
+	return ring->done * ring->buffer_frames;
+}
+
+void i2s_ring_get_telemetry(i2s_ring_t *ring, i2s_ring_telemetry_t *telemetry, bool reset)
+{
+	*telemetry = ring->telemetry;
+	if (reset)
+	{
+		memset(&ring->telemetry, 0, sizeof(ring->telemetry));
+		ring->telemetry.laps = telemetry->laps;
+		ring->telemetry.min_headroom = UINT32_MAX;
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* - I2S DMA ring bookkeeping -                                         *\
+ * Mirrors the legacy I2S driver's TX path: the DMA loops over buffers  *
+ * descriptors of buffer_frames each and hands every finished one back  *
+ * through a queue of at most buffers - 1 entries, dropping the oldest  *
+ * entry when full. The writer takes one from that queue and fills it   *
+ * before it takes the next. Replaying this on the TX done events gives *
+ * the free space without asking the driver, so a refill never blocks,  *
+ * and tells which buffer the DMA starts next. Each buffer keeps the    *
+ * stream position of what it holds, frames the DMA starts below the    *
+ * newest it played are stale, a replay of an older lap, and make that  *
+ * start an underrun. The first lap the DMA plays after start counts as *
+ * written, like the ULP prefill. No ESP-IDF dependencies, a host loop  *
+\* can stand in for the DMA.                                            */
+
+#define I2S_RING_MAX_BUFFERS 16
+
+typedef struct
+{
+	uint32_t laps;			  // DMA laps of the descriptor loop
+	uint32_t underruns;		  // buffers the DMA started with stale frames
+	uint32_t underrun_frames; // frames played from an older lap
+	uint32_t overruns;		  // refills that found every buffer written, the producer was ahead
+	uint32_t min_headroom;	  // fewest written frames ahead of the DMA, UINT32_MAX before the first refill
+} i2s_ring_telemetry_t;
+
+typedef struct
+{
+	uint16_t buffers;		// DMA descriptors in the loop, up to I2S_RING_MAX_BUFFERS
+	uint16_t buffer_frames; // frames per descriptor
+	uint8_t dma;			// buffer the DMA plays
+	uint8_t queue[I2S_RING_MAX_BUFFERS]; // finished buffers waiting in the driver queue, oldest first
+	uint8_t queue_head;
+	uint8_t queued;
+	bool holding;						// the writer took a buffer from the queue and has not filled it yet
+	uint8_t held;
+	uint16_t fill;						// frames written to the held buffer
+	uint64_t held_pos;					// stream position of the first frame written to the held buffer
+	bool written[I2S_RING_MAX_BUFFERS]; // filled since the DMA last started it
+	uint64_t pos[I2S_RING_MAX_BUFFERS]; // stream position of the first frame each full buffer holds
+	uint64_t play_pos;					// stream position after the newest frame the DMA started
+	uint64_t done;						// buffers the DMA finished since start
+	uint64_t write_pos;					// frames written, the first lap included
+	uint64_t stale_frames;				// frames played again from an older lap, never reset
+	i2s_ring_telemetry_t telemetry;
+} i2s_ring_t;
+
+void i2s_ring_init(i2s_ring_t *ring, uint16_t buffers, uint16_t buffer_frames);
+// the DMA finished a buffer, from the TX done event
+void i2s_ring_done(i2s_ring_t *ring);
+// frames the driver takes right now without waiting
+uint32_t i2s_ring_free_frames(const i2s_ring_t *ring);
+// once per refill, updates the headroom and overrun telemetry
+uint32_t i2s_ring_poll(i2s_ring_t *ring);
+// frames the driver took, up to i2s_ring_free_frames()
+void i2s_ring_commit(i2s_ring_t *ring, uint32_t frames);
+// the driver took fewer frames than counted, an event was lost, nothing is free until the next one
+void i2s_ring_resync(i2s_ring_t *ring);
+uint64_t i2s_ring_played(const i2s_ring_t *ring);
+void i2s_ring_get_telemetry(i2s_ring_t *ring, i2s_ring_telemetry_t *telemetry, bool reset);
@@ -0,0 +1,228 @@
+#include <string.h>
+
+#include "driver/i2s.h"
+#include "esp_log.h"
+
+#include "i2sSound.h"
+
+static const char *TAG = "i2sSound";
+
+// feeds the ring the buffers the DMA finished, waits up to timeout for the first one
+static uint32_t i2s_sound_drain_events(i2s_sound_t *i2s, TickType_t timeout)
+{
+	uint32_t done = 0;
+	i2s_event_t event;
+	while (xQueueReceive(i2s->events, &event, timeout) == pdTRUE)
+	{
+		switch (event.type)
+		{
+		case I2S_EVENT_TX_DONE:
+			i2s_ring_done(&i2s->ring);
+			done++;
+			break;
+		case I2S_EVENT_DMA_ERROR:
+			ESP_LOGE(TAG, "DMA error");
+			break;
+		default:
+			// the driver's own queue overflow, the ring counted it as an underrun already
+			break;
+		}
+		timeout = 0;
+	}
+	return done;
+}
+
+// frames of the stereo pairs or of the mono samples in each slot the DAC reads, both halves for mono
+static void i2s_sound_expand(i2s_sound_t *i2s, const uint8_t *samples, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++)
+	{
+		uint8_t dac1 = i2s->stereo ? samples[i * 2] : samples[i];
+		uint8_t dac2 = i2s->stereo ? samples[i * 2 + 1] : samples[i];
+		i2s->slots[i * 2 + I2SSOUND_DAC1_SLOT] = dac1 << 8;
+		i2s->slots[i * 2 + (I2SSOUND_DAC1_SLOT ^ 1)] = dac2 << 8;
+	}
+}
+
+void i2s_sound_init(i2s_sound_t *i2s, const i2s_sound_config_t *config)
+{
+	if (i2s->events != NULL)
+		i2s_sound_deinit(i2s);
+	i2s->stereo = config->stereo;
+	const i2s_config_t i2s_config = {
+		.mode = I2S_MODE_MASTER | I2S_MODE_TX | I2S_MODE_DAC_BUILT_IN,
+		.sample_rate = config->sampling_rate,
+		.bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+		.channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+		.communication_format = I2S_COMM_FORMAT_STAND_MSB,
+		.intr_alloc_flags = 0,
+		.dma_desc_num = I2SSOUND_DMA_BUFFERS,
+		.dma_frame_num = I2SSOUND_DMA_FRAMES,
+		.use_apll = false,
+		// an underrun replays the old lap like the ULP does, cleared buffers would pull the DAC to 0 V
+		.tx_desc_auto_clear = false,
+	};
+	// the driver starts the DMA on zeroed buffers right away, the ring counts that lap as written
+	ESP_ERROR_CHECK(i2s_driver_install(I2SSOUND_PORT, &i2s_config, I2SSOUND_EVENT_QUEUE_LEN, &i2s->events));
+	i2s_ring_init(&i2s->ring, I2SSOUND_DMA_BUFFERS, I2SSOUND_DMA_FRAMES);
+	i2s->sampling_rate = (uint32_t)(i2s_get_clk(I2SSOUND_PORT) + 0.5f);
+	ESP_LOGI(TAG, "Sampling rate %lu Hz, target %lu Hz", i2s->sampling_rate, config->sampling_rate);
+
+	// a lap of midscale, the pads only follow once the DMA is past the zeros
+	uint8_t silence[I2SSOUND_CHUNK_FRAMES * 2];
+	memset(silence, I2SSOUND_MIDSCALE, sizeof(silence));
+	uint64_t silent = i2s->ring.write_pos + (uint64_t)I2SSOUND_DMA_BUFFERS * I2SSOUND_DMA_FRAMES;
+	while (i2s->ring.write_pos < silent)
+	{
+		if (!i2s_sound_wait(i2s, pdMS_TO_TICKS(100)))
+		{
+			ESP_LOGE(TAG, "DMA does not run");
+			break;
+		}
+		while (i2s_sound_write(i2s, silence, sizeof(silence)) > 0)
+			;
+	}
+	ESP_ERROR_CHECK(i2s_set_dac_mode(i2s->stereo ? I2S_DAC_CHANNEL_BOTH_EN : I2S_DAC_CHANNEL_RIGHT_EN));
+}
+
+void i2s_sound_deinit(i2s_sound_t *i2s)
+{
+	ESP_ERROR_CHECK(i2s_set_dac_mode(I2S_DAC_CHANNEL_DISABLE));
+	ESP_ERROR_CHECK(i2s_driver_uninstall(I2SSOUND_PORT));
+	i2s->events = NULL;
+}
+
+uint16_t i2s_sound_get_buffer_diff(i2s_sound_t *i2s)
+{
+	i2s_sound_drain_events(i2s, 0);
+	uint32_t free_frames = i2s_ring_poll(&i2s->ring);
+	return i2s->stereo ? free_frames : free_frames / 2;
+}
+
+void i2s_sound_refill(i2s_sound_t *i2s, uint16_t packed_dual_sample)
+{
+	uint8_t samples[2] = {packed_dual_sample & 0xFF, packed_dual_sample >> 8};
+	i2s_sound_write(i2s, samples, 2);
+}
+
+size_t i2s_sound_write(i2s_sound_t *i2s, const uint8_t *samples, size_t len)
+{
+	i2s_sound_drain_events(i2s, 0);
+	// whole words like the ULP FIFO, a mono word is two frames
+	size_t frames = i2s->stereo ? len / 2 : len & ~(size_t)1;
+	uint32_t free_frames = i2s_ring_free_frames(&i2s->ring);
+	if (frames > free_frames)
+		frames = free_frames;
+
+	size_t sample_bytes = i2s->stereo ? 2 : 1;
+	size_t written = 0;
+	while (written < frames)
+	{
+		size_t chunk = frames - written;
+		if (chunk > I2SSOUND_CHUNK_FRAMES)
+			chunk = I2SSOUND_CHUNK_FRAMES;
+		i2s_sound_expand(i2s, samples + written * sample_bytes, chunk);
+		size_t bytes = 0;
+		i2s_write(I2SSOUND_PORT, i2s->slots, chunk * sizeof(uint16_t) * 2, &bytes, 0);
+		size_t taken = bytes / (sizeof(uint16_t) * 2);
+		i2s_ring_commit(&i2s->ring, taken);
+		written += taken;
+		if (taken < chunk)
+		{
+			ESP_LOGW(TAG, "Driver took %u of %u frames, resyncing", written, frames);
+			i2s_ring_resync(&i2s->ring);
+			break;
+		}
+	}
+	return written * sample_bytes;
+}
+
+void i2s_sound_get_position(i2s_sound_t *i2s, sound_sink_position_t *position)
+{
+	i2s_sound_drain_events(i2s, 0);
+	position->played = i2s_ring_played(&i2s->ring);
+	position->written = i2s->ring.write_pos;
+	position->stale = i2s->ring.stale_frames;
+	position->latency_us = 0;
+	if (position->written > position->played)
+		position->latency_us = i2s_sound_samples_to_us(i2s, position->written - position->played);
+}
+
+uint64_t i2s_sound_samples_to_us(i2s_sound_t *i2s, uint64_t samples)
+{
+	if (i2s->sampling_rate == 0)
+		return 0;
+	return samples * 1000000 / i2s->sampling_rate;
+}
+
+void i2s_sound_get_telemetry(i2s_sound_t *i2s, i2s_ring_telemetry_t *telemetry, bool reset)
+{
+	i2s_ring_get_telemetry(&i2s->ring, telemetry, reset);
+}
+
+bool i2s_sound_wait(i2s_sound_t *i2s, TickType_t timeout)
+{
+	return i2s_sound_drain_events(i2s, timeout) > 0;
+}
+
+static void i2s_sound_sink_start(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	i2s_sound_sink_t *i2s_sink = ctx;
+	i2s_sink->config.sampling_rate = sampling_rate;
+	i2s_sound_init(i2s_sink->i2s, &i2s_sink->config);
+	layout->channels = i2s_sink->config.stereo ? 2 : 1;
+	layout->dual = i2s_sink->config.stereo;
+	layout->fraction_bits = 0;
+}
+
+static uint16_t i2s_sound_sink_get_buffer_diff(void *ctx)
+{
+	return i2s_sound_get_buffer_diff(((i2s_sound_sink_t *)ctx)->i2s);
+}
+
+static size_t i2s_sound_sink_write(void *ctx, const uint8_t *samples, size_t len)
+{
+	return i2s_sound_write(((i2s_sound_sink_t *)ctx)->i2s, samples, len);
+}
+
+static void i2s_sound_sink_get_position(void *ctx, sound_sink_position_t *position)
+{
+	i2s_sound_get_position(((i2s_sound_sink_t *)ctx)->i2s, position);
+}
+
+static uint64_t i2s_sound_sink_samples_to_us(void *ctx, uint64_t samples)
+{
+	return i2s_sound_samples_to_us(((i2s_sound_sink_t *)ctx)->i2s, samples);
+}
+
+static void i2s_sound_sink_log_telemetry(void *ctx, bool dump)
+{
+	i2s_ring_telemetry_t telemetry;
+	i2s_sound_get_telemetry(((i2s_sound_sink_t *)ctx)->i2s, &telemetry, false);
+	ESP_LOGI(TAG, "%lu laps, %lu underruns (%lu frames), %lu overruns, min headroom %lu frames", telemetry.laps, telemetry.underruns, telemetry.underrun_frames, telemetry.overruns, telemetry.min_headroom);
+}
+
+static bool i2s_sound_sink_follow(void *ctx, uint32_t sampling_rate, uint64_t position)
+{
+	// the DMA ring holds samples of the old rate until it played through, only the same rate goes on
+	return sampling_rate == ((i2s_sound_sink_t *)ctx)->config.sampling_rate;
+}
+
+static const sound_sink_ops_t i2s_sound_sink_ops = {
+	.start = i2s_sound_sink_start,
+	.get_buffer_diff = i2s_sound_sink_get_buffer_diff,
+	.write = i2s_sound_sink_write,
+	.get_position = i2s_sound_sink_get_position,
+	.samples_to_us = i2s_sound_sink_samples_to_us,
+	.log_telemetry = i2s_sound_sink_log_telemetry,
+	.follow = i2s_sound_sink_follow,
+};
+
+void i2s_sound_sink_init(i2s_sound_sink_t *i2s_sink, i2s_sound_t *i2s, bool stereo)
+{
+	i2s_sink->sink.ops = &i2s_sound_sink_ops;
+	i2s_sink->sink.ctx = i2s_sink;
+	i2s_sink->i2s = i2s;
+	i2s_sink->config = (i2s_sound_config_t)I2SSOUND_DEFAULT_CONFIG(0);
+	i2s_sink->config.stereo = stereo;
+}
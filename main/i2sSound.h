@@ -0,0 +1,72 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "i2sRing.h"
+#include "soundSink.h"
+
+/* - I2S built in DAC output -                                  *\
+ * I2S0 streams 16 bit slots to the DAC pads by DMA, the DAC     *
+ * takes the high byte. No RTC clock limit and no CPU per        *
+ * sample, but the CPU and the APB clock stay up, so this is for *
+ * mains powered units. Follows the ULP contract: the buffer     *
+ * diff counts free words of two 8 bit samples, mono samples are *
+ * consecutive, stereo ones left then right. Mono plays on DAC1  *
+ * only, stereo puts the left channel on DAC1 like the ULP.      *
+ * Positions count samples, or frames in stereo, at buffer       *
+\* granularity, I2SSOUND_DMA_FRAMES / rate.                      */
+
+#define I2SSOUND_PORT I2S_NUM_0 // the built in DAC mode only exists on I2S0
+#define I2SSOUND_DMA_BUFFERS 8
+#define I2SSOUND_DMA_FRAMES 512 // 2 KB per descriptor, ~93 ms over the ring at 44.1 kHz
+#define I2SSOUND_EVENT_QUEUE_LEN (I2SSOUND_DMA_BUFFERS * 2) // a lost done event costs a buffer until the next resync
+#define I2SSOUND_CHUNK_FRAMES 128						  // frames expanded to DAC slots per i2s_write()
+#define I2SSOUND_DAC1_SLOT 1 // 16 bit half of a frame that feeds DAC1, the driver sends the right channel from the upper half
+#define I2SSOUND_MIDSCALE 0x80
+
+typedef struct
+{
+	uint32_t sampling_rate;
+	bool stereo;
+} i2s_sound_config_t;
+
+#define I2SSOUND_DEFAULT_CONFIG(rate) \
+	{                                 \
+		.sampling_rate = (rate),      \
+		.stereo = false,              \
+	}
+
+typedef struct
+{
+	bool stereo;
+	uint32_t sampling_rate; // as the driver set the clock
+	QueueHandle_t events;
+	i2s_ring_t ring;
+	uint16_t slots[I2SSOUND_CHUNK_FRAMES * 2];
+} i2s_sound_t;
+
+// I2S as a sound sink, each start inits it with config at the source rate
+typedef struct
+{
+	sound_sink_t sink;
+	i2s_sound_t *i2s;
+	i2s_sound_config_t config;
+} i2s_sound_sink_t;
+
+void i2s_sound_init(i2s_sound_t *i2s, const i2s_sound_config_t *config);
+void i2s_sound_deinit(i2s_sound_t *i2s);
+void i2s_sound_sink_init(i2s_sound_sink_t *i2s_sink, i2s_sound_t *i2s, bool stereo);
+uint16_t i2s_sound_get_buffer_diff(i2s_sound_t *i2s);
+void i2s_sound_refill(i2s_sound_t *i2s, uint16_t packed_dual_sample);
+// returns the samples written, even unless the driver had fewer buffers free than counted
+size_t i2s_sound_write(i2s_sound_t *i2s, const uint8_t *samples, size_t len);
+void i2s_sound_get_position(i2s_sound_t *i2s, sound_sink_position_t *position);
+uint64_t i2s_sound_samples_to_us(i2s_sound_t *i2s, uint64_t samples);
+void i2s_sound_get_telemetry(i2s_sound_t *i2s, i2s_ring_telemetry_t *telemetry, bool reset);
+// blocks until the DMA finished a buffer or the timeout passed, returns false on timeout
+bool i2s_sound_wait(i2s_sound_t *i2s, TickType_t timeout);
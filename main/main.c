@@ -1,30 +1,52 @@
 
+#include <math.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 
 #include "driver/dac.h"
+#include "driver/rtc_io.h"
 #include "driver/touch_sensor.h"
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_log.h"
+#include "esp_pm.h"
 #include "esp_sleep.h"
 #include "esp_timer.h"
 #include "sdkconfig.h"
 
 #include "ulpSound.h"
 #include "flacPlayer.h"
+#include "playerTask.h"
 #include "flac/fbi_openup44100.h"
 
 static const char *TAG = "main";
 
+// MIX2018 EN, Active LOW. GPIO26 is also the DAC2 pad, move the enable to another pin
+// (e.g. GPIO_NUM_32) before selecting a ULP program that drives DAC2
 #define MIX2018_NOT_ENABLE_GPIO_NUM (GPIO_NUM_26)
+// ULPSOUND_PROGRAM_PAIR for mono on DAC1: fewest cycles, one DAC write per sample and the transfer curve on the ULP,
+// ULPSOUND_PROGRAM_COMPACT trades those for a 30% longer FIFO, each sample can step up to 15 LSB off for 16 cycles,
+// ULPSOUND_PROGRAM_DPCM for voice, 4 bit deltas and twice the FIFO of PAIR,
+// ULPSOUND_PROGRAM_OVERSAMPLED for a 9 bit effective DAC1 up to ~41 kHz,
+// ULPSOUND_PROGRAM_STEREO or ULPSOUND_PROGRAM_BRIDGED for DAC1 + DAC2
+#define AUDIO_ULP_PROGRAM (ULPSOUND_PROGRAM_PAIR)
+// 1: a touch plays a short clip from the ULP while the CPU stays in deep sleep, 2: a two-tone beep synthesized
+// by the ULP, 0: a touch plays the FLAC file
+#define TOUCH_PLAYS_CHIME (0)
+#define CHIME_SAMPLING_RATE (16000)
+#define CHIME_LEN (ULPSOUND_NIBBLE_BUFF_LEN * 2) // ~240 ms at 16 kHz
+#define AUDIO_RAMP_MS (20) // DAC ramp from 0 to midscale at start and back after the last sample
+#define AUDIO_MUTE_AFTER_MS (500) // silence after which the ULP shuts the amplifier down
+#define PLAYER_POLL_MS (100) // app_main checks the player task this often until it is idle
 #define TOUCH_THRESHOLD_MIN (200)
 #define TOUCH_THRESHOLD_DYNAMIC_FACTOR (0.75f)
 
 ulp_sound_t ulp;
+ulp_sound_sink_t ulp_sink;
 flac_player_t flac_player;
+player_task_t player_task;
 
 void print_wakeup_reason(esp_sleep_wakeup_cause_t wakeup_reason)
 {
@@ -51,18 +73,12 @@ void print_wakeup_reason(esp_sleep_wakeup_cause_t wakeup_reason)
 	}
 }
 
-void set_amplifier_enable(bool enable)
+// hand the amplifier enable to the RTC IO mux, so the ULP can drive it while the CPU sleeps
+void hand_amplifier_to_ulp(bool enable)
 {
-	if (true == enable)
-	{
-		ESP_ERROR_CHECK(gpio_set_level(MIX2018_NOT_ENABLE_GPIO_NUM, 0));
-		ESP_ERROR_CHECK(dac_output_enable(DAC_CHAN_0));
-	}
-	else
-	{
-		ESP_ERROR_CHECK(gpio_set_level(MIX2018_NOT_ENABLE_GPIO_NUM, 1));
-		ESP_ERROR_CHECK(dac_output_disable(DAC_CHAN_0));
-	}
+	ESP_ERROR_CHECK(rtc_gpio_init(MIX2018_NOT_ENABLE_GPIO_NUM));
+	ESP_ERROR_CHECK(rtc_gpio_set_direction(MIX2018_NOT_ENABLE_GPIO_NUM, RTC_GPIO_MODE_OUTPUT_ONLY));
+	ESP_ERROR_CHECK(rtc_gpio_set_level(MIX2018_NOT_ENABLE_GPIO_NUM, enable ? 0 : 1));
 }
 
 void enter_deep_sleep()
@@ -71,9 +87,75 @@ void enter_deep_sleep()
 	esp_deep_sleep_start();
 }
 
+// two partials an octave apart under an exponential decay, settles on midscale
+static void generate_chime(uint8_t *samples, size_t len, uint32_t sampling_rate)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		float t = (float)i / sampling_rate;
+		float v = expf(-18.0f * t) * (0.7f * sinf(2.0f * M_PI * 1319.0f * t) + 0.3f * sinf(2.0f * M_PI * 2637.0f * t));
+		samples[i] = 128 + (int)(v * 127.0f);
+	}
+}
+
+// rising two-tone alert
+static bool load_tone()
+{
+	static const ulp_sound_tone_t tones[] = {
+		{.freq_start_hz = 880.0f, .freq_end_hz = 880.0f, .duration_ms = 120, .level = 15, .attack_ms = 3, .release_ms = 10},
+		{.duration_ms = 40},
+		{.freq_start_hz = 1319.0f, .freq_end_hz = 1319.0f, .duration_ms = 180, .level = 15, .attack_ms = 3, .release_ms = 60},
+	};
+	const ulp_sound_tone_config_t tone = {
+		.tones = tones,
+		.count = sizeof(tones) / sizeof(tones[0]),
+		.wave = NULL,
+		.sampling_rate = CHIME_SAMPLING_RATE,
+		.amp_shutdown_rtc_io = rtc_io_number_get(MIX2018_NOT_ENABLE_GPIO_NUM),
+	};
+	return ulp_sound_tone_load(&ulp, &tone);
+}
+
+static bool load_chime()
+{
+	if (TOUCH_PLAYS_CHIME == 2)
+		return load_tone();
+
+	static uint8_t samples[CHIME_LEN];
+	generate_chime(samples, CHIME_LEN, CHIME_SAMPLING_RATE);
+	const ulp_sound_chime_config_t chime = {
+		.samples = samples,
+		.len = CHIME_LEN,
+		.sampling_rate = CHIME_SAMPLING_RATE,
+		.amp_shutdown_rtc_io = rtc_io_number_get(MIX2018_NOT_ENABLE_GPIO_NUM),
+	};
+	return ulp_sound_chime_load(&ulp, &chime);
+}
+
+// the clip stays in RTC_SLOW_MEM across deep sleep, a wakeup only restarts the ULP
+void play_chime_and_sleep()
+{
+	bool loaded = (TOUCH_PLAYS_CHIME == 2) ? ulp_sound_tone_is_loaded() : ulp_sound_chime_is_loaded();
+	if (!loaded && !load_chime())
+		enter_deep_sleep();
+
+	// the ULP drives the amplifier enable high once the clip ended
+	hand_amplifier_to_ulp(true);
+	ESP_ERROR_CHECK(dac_output_enable(DAC_CHAN_0));
+	if (TOUCH_PLAYS_CHIME == 2)
+		ulp_sound_tone_play();
+	else
+		ulp_sound_chime_play();
+
+	// keep the DAC, the RTC IO and RTC8M (the ULP clock) powered while the CPU sleeps
+	ESP_ERROR_CHECK(esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON));
+	ESP_ERROR_CHECK(esp_sleep_pd_config(ESP_PD_DOMAIN_RTC8M, ESP_PD_OPTION_ON));
+	enter_deep_sleep();
+}
+
 void app_main(void)
 {
-	// GPIO26 used for MIX2018 EN, Active LOW
+	// MIX2018 EN, Active LOW
 	ESP_ERROR_CHECK(gpio_sleep_set_pull_mode(MIX2018_NOT_ENABLE_GPIO_NUM, GPIO_PULLUP_ONLY));
 	ESP_ERROR_CHECK(gpio_pullup_en(MIX2018_NOT_ENABLE_GPIO_NUM));
 	ESP_ERROR_CHECK(gpio_set_level(MIX2018_NOT_ENABLE_GPIO_NUM, 1));
@@ -117,25 +199,65 @@ void app_main(void)
 
 	printf("Setup took %6.3f ms\r\n", esp_timer_get_time() / 1000.0f);
 
+	if (TOUCH_PLAYS_CHIME)
+	{
+		if (ESP_SLEEP_WAKEUP_TOUCHPAD != wakeup_reason)
+		{
+			load_chime();
+			enter_deep_sleep();
+		}
+		play_chime_and_sleep();
+	}
+
 	if (ESP_SLEEP_WAKEUP_TOUCHPAD != wakeup_reason)
 		enter_deep_sleep();
 
 	ESP_LOGI(TAG, "Linking");
 	flac_player_init(&flac_player);
-	flac_player_link(&flac_player, &ulp);
-	flac_player_play(&flac_player, flacFile, sizeof(flacFile));
+	if (ulp_sound_program_uses_dac2(AUDIO_ULP_PROGRAM) && (MIX2018_NOT_ENABLE_GPIO_NUM == GPIO_NUM_26))
+	{
+		ESP_LOGE(TAG, "Amplifier enable is on the DAC2 pad, staying on DAC1");
+		ulp_sound_sink_init(&ulp_sink, &ulp, ULPSOUND_PROGRAM_PAIR);
+	}
+	else
+		ulp_sound_sink_init(&ulp_sink, &ulp, AUDIO_ULP_PROGRAM);
+	// the ULP enables the amplifier and the DAC pads with the ramp at start
+	hand_amplifier_to_ulp(false);
+	ulp_sink.config.amp_shutdown_rtc_io = rtc_io_number_get(MIX2018_NOT_ENABLE_GPIO_NUM);
+	ulp_sink.config.ramp_ms = AUDIO_RAMP_MS;
+	ulp_sink.config.mute_after_ms = AUDIO_MUTE_AFTER_MS;
+	ulp_sink.config.wake_at_end = true;
+	// the player's refill scheduler sets the wakeups, the watermark would only cut its sleeps short
+	ulp_sink.config.wake_watermark = 0;
+	flac_player_link(&flac_player, &ulp_sink.sink);
 
-	set_amplifier_enable(true);
+#if CONFIG_PM_ENABLE && CONFIG_FREERTOS_USE_TICKLESS_IDLE
+	// the CPU light sleeps only while every task is blocked, a ready task or a command still wakes it; the
+	// frequency stays, only the sleep is wanted
+	esp_pm_config_t pm_config = {
+		.max_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+		.min_freq_mhz = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+		.light_sleep_enable = true,
+	};
+	ESP_ERROR_CHECK(esp_pm_configure(&pm_config));
+#endif
+
+	// off the core of app_main, which only polls it; the refills block on the notification between themselves
+	player_task_config_t player_config = PLAYER_TASK_DEFAULT_CONFIG();
+	player_config.core = portNUM_PROCESSORS - 1;
+	if (!player_task_start(&player_task, &flac_player, &player_config))
+		enter_deep_sleep();
+	player_task_play(&player_task, flacFile, sizeof(flacFile));
 
 	while (1)
 	{
-		while (flac_player_is_playing(&flac_player))
-		{
-			flac_player_refill(&flac_player);
-			vTaskDelay(pdMS_TO_TICKS(10));
-		}
-		vTaskDelay(pdMS_TO_TICKS(100));
-		set_amplifier_enable(false);
+		// the player task ends the stream after the last sample, the ULP plays out the FIFO, ramps down,
+		// shuts the amplifier down and halts, then the task is idle. The player and the ULP are the task's
+		while (!player_task_is_idle(&player_task))
+			vTaskDelay(pdMS_TO_TICKS(PLAYER_POLL_MS));
+		ESP_LOGI(TAG, "Played to the end at %6.3f sec", player_task_get_position_ms(&player_task) / 1000.0f);
+		// the ULP is done, only the amplifier enable has to stay driven
+		ESP_ERROR_CHECK(esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON));
 		enter_deep_sleep();
 	}
 }
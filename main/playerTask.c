@@ -0,0 +1,277 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "playerTask.h"
+
+static const char *TAG = "playerTask";
+
+static void player_task_publish(player_task_t *player_task, player_task_state_t state)
+{
+	player_task->state = state;
+	atomic_store_explicit(&player_task->published_state, state, memory_order_release);
+}
+
+// sleep_us as the refill scheduler hands it out, a command ends a blocked wait early
+static void player_task_wait(uint32_t sleep_us)
+{
+	if (sleep_us == 0)
+		return;
+	// rounded up to at least a tick, a shorter wait would not block at all. It ends at the n-th tick
+	// interrupt, after n - 1 to n tick periods
+	TickType_t ticks = ((uint64_t)sleep_us * configTICK_RATE_HZ + 999999) / 1000000;
+	ulTaskNotifyTake(pdTRUE, ticks);
+}
+
+static void player_task_end(player_task_t *player_task)
+{
+	player_task->ended = false;
+	player_task_publish(player_task, PLAYER_TASK_ENDING);
+}
+
+static player_task_item_t *player_task_pop(player_task_t *player_task)
+{
+	player_task_item_t *item = &player_task->playlist[player_task->playlist_head];
+	player_task->playlist_head = (player_task->playlist_head + 1) % PLAYER_TASK_PLAYLIST_LEN;
+	player_task->playlist_len--;
+	return item;
+}
+
+static void player_task_play_next(player_task_t *player_task)
+{
+	player_task_item_t *item = player_task_pop(player_task);
+	flac_player_play(player_task->player, item->file, item->size);
+	atomic_store_explicit(&player_task->position_ms, 0, memory_order_relaxed);
+	player_task_publish(player_task, PLAYER_TASK_PLAYING);
+}
+
+static void player_task_enqueue_item(player_task_t *player_task, const unsigned char *file, uint32_t size)
+{
+	if (player_task->playlist_len == PLAYER_TASK_PLAYLIST_LEN)
+	{
+		ESP_LOGW(TAG, "Playlist full, dropping %p", file);
+		return;
+	}
+	player_task_item_t *item = &player_task->playlist[(player_task->playlist_head + player_task->playlist_len) % PLAYER_TASK_PLAYLIST_LEN];
+	item->file = file;
+	item->size = size;
+	player_task->playlist_len++;
+}
+
+static void player_task_apply(player_task_t *player_task, const player_task_command_t *command)
+{
+	flac_player_t *player = player_task->player;
+	bool playing = (player_task->state == PLAYER_TASK_PLAYING) || (player_task->state == PLAYER_TASK_PAUSED);
+	bool draining = player_task->state == PLAYER_TASK_DRAINING;
+	switch (command->type)
+	{
+	case PLAYER_TASK_PLAY:
+		player_task->playlist_len = 0;
+		player_task_enqueue_item(player_task, command->file, command->size);
+		player_task_play_next(player_task); // drops the player's next file too
+		break;
+	case PLAYER_TASK_ENQUEUE:
+		player_task_enqueue_item(player_task, command->file, command->size);
+		if (!playing && !draining)
+			player_task_play_next(player_task);
+		break;
+	case PLAYER_TASK_STOP:
+		player_task->playlist_len = 0;
+		if (playing || draining)
+		{
+			flac_player_stop(player);
+			player_task_end(player_task);
+		}
+		break;
+	case PLAYER_TASK_PAUSE:
+		if (player_task->state == PLAYER_TASK_PLAYING)
+		{
+			flac_player_set_paused(player, true);
+			player_task_publish(player_task, PLAYER_TASK_PAUSED);
+		}
+		break;
+	case PLAYER_TASK_RESUME:
+		if (player_task->state == PLAYER_TASK_PAUSED)
+		{
+			flac_player_set_paused(player, false);
+			player_task_publish(player_task, PLAYER_TASK_PLAYING);
+		}
+		break;
+	case PLAYER_TASK_SEEK:
+		if (playing)
+			flac_player_seek(player, (uint64_t)command->position_ms * flac_player_get_sampling_rate(player) / 1000);
+		break;
+	default:
+		ESP_LOGE(TAG, "Unknown command %d", command->type);
+		break;
+	}
+}
+
+static void player_task_run(void *arg)
+{
+	player_task_t *player_task = arg;
+	flac_player_t *player = player_task->player;
+	while (true)
+	{
+		player_task_command_t command;
+		while (spsc_queue_pop(&player_task->commands, &command))
+		{
+			player_task_apply(player_task, &command);
+			atomic_fetch_add_explicit(&player_task->commands_done, 1, memory_order_release);
+		}
+
+		switch (player_task->state)
+		{
+		case PLAYER_TASK_IDLE:
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			break;
+		case PLAYER_TASK_ENDING:
+		{
+			// until the sink played on enough to take its end, then until it played that out
+			sound_sink_position_t position;
+			if (!player_task->ended && sound_sink_end(player->sink))
+			{
+				player_task->ended = true;
+				sound_sink_get_position(player->sink, &position);
+				ESP_LOGI(TAG, "Stream ends in %lu ms", position.latency_us / 1000);
+			}
+			atomic_store_explicit(&player_task->position_ms, flac_player_get_position_us(player) / 1000, memory_order_relaxed);
+			if (player_task->ended && sound_sink_is_done(player->sink))
+			{
+				player_task_publish(player_task, PLAYER_TASK_IDLE);
+				break;
+			}
+			sound_sink_get_position(player->sink, &position);
+			player_task_wait(position.latency_us / 2 + PLAYER_TASK_END_POLL_US);
+			break;
+		}
+		case PLAYER_TASK_DRAINING:
+		{
+			// a start drops what the FIFO holds, the old file plays out first
+			sound_sink_position_t position;
+			sound_sink_get_position(player->sink, &position);
+			if (position.played < position.written)
+			{
+				player_task_wait(position.latency_us);
+				break;
+			}
+			if (flac_player_play_next(player))
+			{
+				atomic_store_explicit(&player_task->position_ms, 0, memory_order_relaxed);
+				player_task_publish(player_task, PLAYER_TASK_PLAYING);
+			}
+			else if (player_task->playlist_len > 0)
+				player_task_play_next(player_task);
+			else
+				player_task_end(player_task);
+			break;
+		}
+		default:
+			if (!flac_player_is_playing(player))
+			{
+				// the sink could not follow, the next file starts it over
+				if (flac_player_has_next(player) || (player_task->playlist_len > 0))
+					player_task_publish(player_task, PLAYER_TASK_DRAINING);
+				else
+					player_task_end(player_task);
+				break;
+			}
+			// the player opens the next file as the one playing ends and plays it without a gap
+			if (!flac_player_has_next(player) && (player_task->playlist_len > 0))
+			{
+				player_task_item_t *item = player_task_pop(player_task);
+				flac_player_set_next(player, item->file, item->size);
+			}
+			flac_player_refill(player);
+			atomic_store_explicit(&player_task->position_ms, flac_player_get_position_us(player) / 1000, memory_order_relaxed);
+			player_task_wait(flac_player_get_sleep_us(player));
+			break;
+		}
+	}
+}
+
+bool player_task_start(player_task_t *player_task, flac_player_t *player, const player_task_config_t *config)
+{
+	player_task->player = player;
+	spsc_queue_init(&player_task->commands, player_task->command_slots, sizeof(player_task_command_t), PLAYER_TASK_QUEUE_LEN);
+	player_task->commands_sent = 0;
+	player_task->playlist_head = 0;
+	player_task->playlist_len = 0;
+	player_task->state = PLAYER_TASK_IDLE;
+	player_task->ended = false;
+	atomic_init(&player_task->published_state, PLAYER_TASK_IDLE);
+	atomic_init(&player_task->position_ms, 0);
+	atomic_init(&player_task->commands_done, 0);
+	if (xTaskCreatePinnedToCore(player_task_run, "player", config->stack_size, player_task, config->priority, &player_task->task, config->core) != pdPASS)
+	{
+		ESP_LOGE(TAG, "Cannot create the player task");
+		return false;
+	}
+	return true;
+}
+
+static bool player_task_send(player_task_t *player_task, const player_task_command_t *command)
+{
+	if (!spsc_queue_push(&player_task->commands, command))
+	{
+		ESP_LOGW(TAG, "Command queue full, dropping command %d", command->type);
+		return false;
+	}
+	player_task->commands_sent++;
+	xTaskNotifyGive(player_task->task);
+	return true;
+}
+
+bool player_task_play(player_task_t *player_task, const unsigned char *flac_file, uint32_t file_size)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_PLAY, .file = flac_file, .size = file_size};
+	return player_task_send(player_task, &command);
+}
+
+bool player_task_enqueue(player_task_t *player_task, const unsigned char *flac_file, uint32_t file_size)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_ENQUEUE, .file = flac_file, .size = file_size};
+	return player_task_send(player_task, &command);
+}
+
+bool player_task_stop(player_task_t *player_task)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_STOP};
+	return player_task_send(player_task, &command);
+}
+
+bool player_task_pause(player_task_t *player_task)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_PAUSE};
+	return player_task_send(player_task, &command);
+}
+
+bool player_task_resume(player_task_t *player_task)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_RESUME};
+	return player_task_send(player_task, &command);
+}
+
+bool player_task_seek(player_task_t *player_task, uint32_t position_ms)
+{
+	player_task_command_t command = {.type = PLAYER_TASK_SEEK, .position_ms = position_ms};
+	return player_task_send(player_task, &command);
+}
+
+player_task_state_t player_task_get_state(player_task_t *player_task)
+{
+	return atomic_load_explicit(&player_task->published_state, memory_order_acquire);
+}
+
+uint32_t player_task_get_position_ms(player_task_t *player_task)
+{
+	return atomic_load_explicit(&player_task->position_ms, memory_order_relaxed);
+}
+
+bool player_task_is_idle(player_task_t *player_task)
+{
+	// the state is published before the command counts as done
+	if (atomic_load_explicit(&player_task->commands_done, memory_order_acquire) != player_task->commands_sent)
+		return false;
+	return player_task_get_state(player_task) == PLAYER_TASK_IDLE;
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "flacPlayer.h"
+#include "spscQueue.h"
+
+/* - player task -                                               *\
+ * Runs a flac player in a task of its own, pinned and at its    *
+ * own priority. The control calls come from one other task, the *
+ * single producer of the command queue: they push a command,    *
+ * notify the player task and return, false if the queue is      *
+ * full. They never wait for a refill or a decode. The player    *
+ * task takes every queued command before each refill, then      *
+ * blocks on its notification as long as the refill scheduler    *
+ * says, a command cuts the wait short. The CPU only sleeps      *
+ * through the power manager, automatic light sleep while every  *
+ * task is blocked. State, position and the commands done are    *
+ * published through atomics. Pause holds the level once the     *
+ * FIFO played out, so it and stop take effect after the sink    *
+ * headroom, seek lands on a frame, see flac_player_seek(). The  *
+ * playlist hands one file at a time to the player as its next,  *
+ * which follows the file playing without a gap. A sink that     *
+ * cannot follow plays out what it has first, the next file then *
+\* starts it over.                                               */
+
+#define PLAYER_TASK_QUEUE_LEN 8 // commands in flight, a power of two
+#define PLAYER_TASK_PLAYLIST_LEN 4
+#define PLAYER_TASK_STACK_SIZE 4096
+#define PLAYER_TASK_PRIORITY 10 // above app_main, below the esp_timer task
+#define PLAYER_TASK_END_POLL_US 5000 // while the sink plays out its end, e.g. a ramp
+
+typedef enum
+{
+	PLAYER_TASK_PLAY = 0, // drops the playlist and plays the file
+	PLAYER_TASK_ENQUEUE,  // plays the file after the last one queued, at once if idle
+	PLAYER_TASK_STOP,	  // drops the playlist, the sink plays what it has and ends
+	PLAYER_TASK_PAUSE,
+	PLAYER_TASK_RESUME,
+	PLAYER_TASK_SEEK,
+} player_task_command_type_t;
+
+typedef struct
+{
+	player_task_command_type_t type;
+	const unsigned char *file;
+	uint32_t size;
+	uint32_t position_ms;
+} player_task_command_t;
+
+typedef enum
+{
+	PLAYER_TASK_IDLE = 0,
+	PLAYER_TASK_PLAYING,
+	PLAYER_TASK_PAUSED,
+	PLAYER_TASK_ENDING,	  // the sink has no room for its end yet, or it plays out after it
+	PLAYER_TASK_DRAINING, // the sink could not follow, it plays out before the next file starts it over
+} player_task_state_t;
+
+typedef struct
+{
+	const unsigned char *file;
+	uint32_t size;
+} player_task_item_t;
+
+typedef struct
+{
+	UBaseType_t priority;
+	BaseType_t core;	 // tskNO_AFFINITY to let the scheduler pick
+	uint32_t stack_size; // bytes
+} player_task_config_t;
+
+#define PLAYER_TASK_DEFAULT_CONFIG()           \
+	{                                          \
+		.priority = PLAYER_TASK_PRIORITY,      \
+		.core = tskNO_AFFINITY,                \
+		.stack_size = PLAYER_TASK_STACK_SIZE,  \
+	}
+
+typedef struct
+{
+	flac_player_t *player;
+	TaskHandle_t task;
+	spsc_queue_t commands;
+	player_task_command_t command_slots[PLAYER_TASK_QUEUE_LEN];
+	uint32_t commands_sent; // producer only
+	// player task only
+	player_task_item_t playlist[PLAYER_TASK_PLAYLIST_LEN];
+	uint8_t playlist_head;
+	uint8_t playlist_len;
+	player_task_state_t state;
+	bool ended; // the sink took its end
+	// published by the player task
+	atomic_uint published_state;
+	atomic_uint position_ms;
+	atomic_uint commands_done;
+} player_task_t;
+
+// the player has to be linked to its sink, returns false if the task could not be created
+bool player_task_start(player_task_t *player_task, flac_player_t *player, const player_task_config_t *config);
+bool player_task_play(player_task_t *player_task, const unsigned char *flac_file, uint32_t file_size);
+bool player_task_enqueue(player_task_t *player_task, const unsigned char *flac_file, uint32_t file_size);
+bool player_task_stop(player_task_t *player_task);
+bool player_task_pause(player_task_t *player_task);
+bool player_task_resume(player_task_t *player_task);
+bool player_task_seek(player_task_t *player_task, uint32_t position_ms);
+player_task_state_t player_task_get_state(player_task_t *player_task);
+// of the file playing, as of the last refill
+uint32_t player_task_get_position_ms(player_task_t *player_task);
+// every command sent is done and nothing plays, the sink played out its end too
+bool player_task_is_idle(player_task_t *player_task);
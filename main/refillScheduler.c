@@ -0,0 +1,63 @@
+#include <string.h>
+
+#include "refillScheduler.h"
+
+void refill_scheduler_init(refill_scheduler_t *scheduler, uint32_t guard_us, uint32_t min_sleep_us, uint32_t max_sleep_us)
+{
+	memset(scheduler, 0, sizeof(*scheduler));
+	scheduler->guard_us = guard_us;
+	scheduler->min_sleep_us = min_sleep_us;
+	scheduler->max_sleep_us = max_sleep_us;
+	scheduler->telemetry.min_margin_us = UINT32_MAX;
+}
+
+void refill_scheduler_begin(refill_scheduler_t *scheduler, uint32_t headroom_us)
+{
+	if (headroom_us < scheduler->telemetry.min_margin_us)
+		scheduler->telemetry.min_margin_us = headroom_us;
+}
+
+uint32_t refill_scheduler_end(refill_scheduler_t *scheduler, uint32_t elapsed_us, uint32_t written_us, uint32_t headroom_us)
+{
+	scheduler->telemetry.refills++;
+	if (elapsed_us > scheduler->telemetry.max_refill_us)
+		scheduler->telemetry.max_refill_us = elapsed_us;
+
+	// a full FIFO writes nothing and tells nothing about the cost
+	if (written_us > 0)
+	{
+		uint64_t cost = ((uint64_t)elapsed_us * REFILL_SCHEDULER_COST_ONE) / written_us;
+		if (cost > UINT32_MAX)
+			cost = UINT32_MAX;
+		if (cost >= scheduler->cost)
+			scheduler->cost = cost;
+		else
+			scheduler->cost -= (scheduler->cost - cost) >> REFILL_SCHEDULER_COST_DECAY;
+	}
+
+	uint64_t sleep_us = 0;
+	if (headroom_us > scheduler->guard_us)
+		sleep_us = ((uint64_t)(headroom_us - scheduler->guard_us) * REFILL_SCHEDULER_COST_ONE) / (REFILL_SCHEDULER_COST_ONE + (uint64_t)scheduler->cost);
+	if (sleep_us > scheduler->max_sleep_us)
+		sleep_us = scheduler->max_sleep_us;
+	if (sleep_us < scheduler->min_sleep_us)
+		sleep_us = 0;
+
+	scheduler->sleep_us = sleep_us;
+	if (sleep_us > 0)
+	{
+		scheduler->telemetry.sleeps++;
+		scheduler->telemetry.slept_us += sleep_us;
+	}
+	return sleep_us;
+}
+
+void refill_scheduler_get_telemetry(refill_scheduler_t *scheduler, refill_scheduler_telemetry_t *telemetry, bool reset)
+{
+	*telemetry = scheduler->telemetry;
+	if (reset)
+	{
+		memset(&scheduler->telemetry, 0, sizeof(scheduler->telemetry));
+		scheduler->telemetry.min_margin_us = UINT32_MAX;
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* - refill scheduler -                                                 *\
+ * Picks how long the player may sleep after a refill. The sink reports *
+ * its headroom as time (written - played at the measured rate), the    *
+ * scheduler keeps the refill cost as time spent per time of audio      *
+ * written, taking a slower refill at once and letting a faster one in  *
+ * slowly, since a FLAC frame boundary costs more than the blocks in    *
+ * between. After sleeping T the next refill has to write T of audio,  *
+ * the sink plays on while it decodes, so the headroom must still cover *
+ * guard_us after T + cost * T:                                         *
+ *     T = (headroom - guard) / (1 + cost)                              *
+ * A sleep shorter than min_sleep_us does not pay for the light sleep   *
+ * entry and exit, the refill follows at once. No ESP-IDF dependencies, *
+\* a host loop can stand in for the sink and the clock.                 */
+
+#define REFILL_SCHEDULER_COST_ONE 65536 // cost of decoding in real time
+#define REFILL_SCHEDULER_COST_DECAY 4	// log2 of the refills a lower cost takes to settle
+
+typedef struct
+{
+	uint32_t refills;
+	uint32_t sleeps;		 // refills followed by a sleep, the wakeups
+	uint32_t min_margin_us;	 // least headroom found when a refill started, UINT32_MAX before the first one
+	uint32_t max_refill_us;	 // longest refill
+	uint64_t slept_us;		 // sum of the sleeps handed out
+} refill_scheduler_telemetry_t;
+
+typedef struct
+{
+	uint32_t guard_us;	   // headroom left when the refill is done
+	uint32_t min_sleep_us; // shorter sleeps are skipped
+	uint32_t max_sleep_us; // bounds a sleep on a wrong headroom reading
+	uint32_t cost;		   // refill time per time of audio written, 1/65536
+	uint32_t sleep_us;	   // handed out after the last refill
+	refill_scheduler_telemetry_t telemetry;
+} refill_scheduler_t;
+
+void refill_scheduler_init(refill_scheduler_t *scheduler, uint32_t guard_us, uint32_t min_sleep_us, uint32_t max_sleep_us);
+// headroom_us as the refill starts, feeds the margin telemetry
+void refill_scheduler_begin(refill_scheduler_t *scheduler, uint32_t headroom_us);
+// the refill took elapsed_us to write written_us of audio and left headroom_us, returns the time to sleep, 0 for none
+uint32_t refill_scheduler_end(refill_scheduler_t *scheduler, uint32_t elapsed_us, uint32_t written_us, uint32_t headroom_us);
+void refill_scheduler_get_telemetry(refill_scheduler_t *scheduler, refill_scheduler_telemetry_t *telemetry, bool reset);
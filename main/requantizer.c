@@ -0,0 +1,91 @@
+#include "requantizer.h"
+
+#define REQUANTIZER_LFSR_SEED 0x2545F491UL
+
+void requantizer_init(requantizer_t *requantizer, uint8_t source_bits)
+{
+	requantizer->error[0] = 0;
+	requantizer->error[1] = 0;
+	requantizer->lfsr = REQUANTIZER_LFSR_SEED;
+	requantizer->bypass = source_bits <= 8;
+}
+
+void requantizer_process(requantizer_t *requantizer, const int32_t *in, uint8_t *out, size_t len)
+{
+	requantizer_process_stride(requantizer, in, out, len, 1);
+}
+
+// x limited to [low, high] with masks instead of compares, the sign of the distance selects the bound
+static inline __attribute__((always_inline)) int32_t requantizer_clamp(int32_t x, int32_t low, int32_t high)
+{
+	int32_t over = high - x;
+	x += over & (over >> 31);
+	int32_t under = x - low;
+	return x - (under & (under >> 31));
+}
+
+// one noise shaped step at the resolution given by step, 16 bit offset binary with the bits below step cleared
+static inline __attribute__((always_inline)) int32_t requantizer_step(int32_t in, int32_t *e1, int32_t *e2, uint32_t *lfsr, int32_t step)
+{
+	// xorshift32, one step gives both uniform draws of the TPDF dither
+	uint32_t x = *lfsr;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*lfsr = x;
+	int32_t dither = (int32_t)(x & (step - 1)) - (int32_t)((x >> 8) & (step - 1));
+
+	// 16 bit offset binary, so the output code is just the upper bits
+	int32_t v = (in >> 16) + 0x8000 - (*e1 + (*e1 >> 1) - (*e2 >> 1));
+	// the top code carries no fraction, code + 1 would leave the DAC table
+	int32_t y = requantizer_clamp(v + dither + step / 2, 0, 0xFF00 | (step - 1)) & ~(step - 1);
+
+	// clip the error so a saturated output cannot wind up the filter
+	int32_t e = requantizer_clamp(y - v, -step * 2, step * 2);
+	*e2 = *e1;
+	*e1 = e;
+	return y;
+}
+
+void requantizer_process_stride(requantizer_t *requantizer, const int32_t *in, uint8_t *out, size_t len, size_t stride)
+{
+	if (requantizer->bypass)
+	{
+		// nothing below bit 24, plain truncation is exact
+		for (size_t i = 0; i < len; i += stride)
+			out[i] = ((in[i] >> 24) & 0xFF) + 0x80;
+		return;
+	}
+
+	// keep the state in registers for the whole block
+	int32_t e1 = requantizer->error[0];
+	int32_t e2 = requantizer->error[1];
+	uint32_t lfsr = requantizer->lfsr;
+	for (size_t i = 0; i < len; i += stride)
+		out[i] = requantizer_step(in[i], &e1, &e2, &lfsr, 0x100) >> 8;
+	requantizer->error[0] = e1;
+	requantizer->error[1] = e2;
+	requantizer->lfsr = lfsr;
+}
+
+void requantizer_process_fine(requantizer_t *requantizer, const int32_t *in, uint16_t *out, size_t len)
+{
+	if (requantizer->bypass)
+	{
+		for (size_t i = 0; i < len; i++)
+			out[i] = ((in[i] >> 24) & 0xFF) + 0x80;
+		return;
+	}
+
+	int32_t e1 = requantizer->error[0];
+	int32_t e2 = requantizer->error[1];
+	uint32_t lfsr = requantizer->lfsr;
+	for (size_t i = 0; i < len; i++)
+	{
+		int32_t y = requantizer_step(in[i], &e1, &e2, &lfsr, 0x80);
+		out[i] = (y >> 8) | (y & 0x80) << 1;
+	}
+	requantizer->error[0] = e1;
+	requantizer->error[1] = e2;
+	requantizer->lfsr = lfsr;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* - 16 to 8 bit requantizer -                                          *\
+ * y[n] = Q(x[n] + d[n] - (1.5 * e[n-1] - 0.5 * e[n-2]))                 *
+ * e[n] = y[n] - v[n], the quantizer error fed back through the filter  *
+ * NTF(z) = (1 - z^-1)(1 - 0.5z^-1): zero at DC, 3x (9.5 dB) at fs/2    *
+ * d[n]: TPDF dither, two 8 bit uniform draws from one xorshift32 step  *
+ *                                                                      *
+ * The inner loop has no branches, the clamps are masks on the sign of  *
+ * the distance to the bound, so every sample costs the same whatever   *
+ * the signal. Measured with test/requantizerBench.c on 64 sample       *
+ * blocks as the player hands them over, built -Os as the firmware, on  *
+ * an x86-64 Xeon host: 19 TSC cycles per sample for process_stride,    *
+ * stride 1 or both channels at stride 2, 20 for process_fine, within   *
+ * 1 cycle for noise, silence and clipping. Not measured on the chip,   *
+ * there it is part of the refill cost the refill scheduler measures,   *
+ * refill time per time of audio written.                               *
+ * The fine variant quantizes to 9 bits, 0.5 LSB steps with the dither, *
+ * error clip and feedback scaled along, and packs the ninth bit above  *
+\* the code as ULPSOUND_PROGRAM_OVERSAMPLED reads it.                   */
+
+typedef struct
+{
+	int32_t error[2]; // e[n-1], e[n-2] in 1/256 of an output LSB
+	uint32_t lfsr;	  // dither generator state, never zero
+	bool bypass;	  // source has no bits below the DAC resolution
+} requantizer_t;
+
+void requantizer_init(requantizer_t *requantizer, uint8_t source_bits);
+void requantizer_process(requantizer_t *requantizer, const int32_t *in, uint8_t *out, size_t len);
+// every stride-th sample of in[0..len), for one channel of an interleaved block
+void requantizer_process_stride(requantizer_t *requantizer, const int32_t *in, uint8_t *out, size_t len, size_t stride);
+// code | half LSB << 8 per sample, the code is below 255 whenever the half LSB is set
+void requantizer_process_fine(requantizer_t *requantizer, const int32_t *in, uint16_t *out, size_t len);
@@ -0,0 +1,128 @@
+#include "soundSink.h"
+
+void sound_sink_start(sound_sink_t *sink, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	sink->ops->start(sink->ctx, sampling_rate, layout);
+}
+
+uint16_t sound_sink_get_buffer_diff(sound_sink_t *sink)
+{
+	return sink->ops->get_buffer_diff(sink->ctx);
+}
+
+size_t sound_sink_write(sound_sink_t *sink, const uint8_t *samples, size_t len)
+{
+	return sink->ops->write(sink->ctx, samples, len);
+}
+
+size_t sound_sink_write_words(sound_sink_t *sink, const uint16_t *words, size_t len)
+{
+	if (sink->ops->write_words == NULL)
+		return 0;
+	return sink->ops->write_words(sink->ctx, words, len);
+}
+
+void sound_sink_get_position(sound_sink_t *sink, sound_sink_position_t *position)
+{
+	sink->ops->get_position(sink->ctx, position);
+}
+
+uint64_t sound_sink_samples_to_us(sound_sink_t *sink, uint64_t samples)
+{
+	return sink->ops->samples_to_us(sink->ctx, samples);
+}
+
+void sound_sink_log_telemetry(sound_sink_t *sink, bool dump)
+{
+	if (sink->ops->log_telemetry != NULL)
+		sink->ops->log_telemetry(sink->ctx, dump);
+}
+
+bool sound_sink_follow(sound_sink_t *sink, uint32_t sampling_rate, uint64_t position)
+{
+	if (sink->ops->follow == NULL)
+		return false;
+	return sink->ops->follow(sink->ctx, sampling_rate, position);
+}
+
+bool sound_sink_end(sound_sink_t *sink)
+{
+	if (sink->ops->end == NULL)
+		return true;
+	return sink->ops->end(sink->ctx);
+}
+
+static void null_sink_start(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	null_sink_t *null_sink = ctx;
+	null_sink->sampling_rate = sampling_rate;
+	null_sink->samples = 0;
+	null_sink->checksum = 0;
+	layout->channels = null_sink->channels;
+	layout->dual = null_sink->channels == 2;
+	layout->fraction_bits = 0;
+}
+
+static uint16_t null_sink_get_buffer_diff(void *ctx)
+{
+	return NULL_SINK_WORDS;
+}
+
+static size_t null_sink_write(void *ctx, const uint8_t *samples, size_t len)
+{
+	null_sink_t *null_sink = ctx;
+	len &= ~(size_t)1;
+	for (size_t i = 0; i < len; i++)
+		null_sink->checksum = null_sink->checksum * 31 + samples[i];
+	null_sink->samples += len;
+	return len;
+}
+
+static void null_sink_get_position(void *ctx, sound_sink_position_t *position)
+{
+	null_sink_t *null_sink = ctx;
+	position->played = null_sink->samples / null_sink->channels;
+	position->written = position->played;
+	position->stale = 0;
+	position->latency_us = 0;
+}
+
+static uint64_t null_sink_samples_to_us(void *ctx, uint64_t samples)
+{
+	null_sink_t *null_sink = ctx;
+	if (null_sink->sampling_rate == 0)
+		return 0;
+	return samples * 1000000 / null_sink->sampling_rate;
+}
+
+static bool null_sink_follow(void *ctx, uint32_t sampling_rate, uint64_t position)
+{
+	((null_sink_t *)ctx)->sampling_rate = sampling_rate;
+	return true;
+}
+
+static const sound_sink_ops_t null_sink_ops = {
+	.start = null_sink_start,
+	.get_buffer_diff = null_sink_get_buffer_diff,
+	.write = null_sink_write,
+	.get_position = null_sink_get_position,
+	.samples_to_us = null_sink_samples_to_us,
+	.follow = null_sink_follow,
+};
+
+void null_sink_init(null_sink_t *null_sink, uint8_t channels)
+{
+	null_sink->sink.ops = &null_sink_ops;
+	null_sink->sink.ctx = null_sink;
+	null_sink->channels = channels == 2 ? 2 : 1;
+	null_sink->sampling_rate = 0;
+	null_sink->samples = 0;
+	null_sink->checksum = 0;
+}
+
+bool sound_sink_is_done(sound_sink_t *sink)
+{
+	if (sink->ops->is_done == NULL)
+		return true;
+	return sink->ops->is_done(sink->ctx);
+}
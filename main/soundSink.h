@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* - sound sink -                                               *\
+ * Where the player puts its 8 bit unsigned samples. The sink    *
+ * reports how it packs them when started, then takes whole      *
+ * 16 bit words of two samples up to the capacity it reports:    *
+ * consecutive mono samples, or left then right. The ULP and the *
+ * I2S backends are sinks, so are a WAV file writer and a null   *
+ * sink, which let the decode path run and be timed or diffed on *
+\* host.                                                         */
+
+typedef struct
+{
+	uint8_t channels;	   // 2 plays the two samples of a word as left and right
+	bool dual;			   // both samples of a word reach an output, a mono source is duplicated
+	uint8_t fraction_bits; // takes one word per sample with bits below the LSB, see write_words
+} sound_sink_layout_t;
+
+/* - playback position -                                        *\
+ * In samples, or frames when the sink plays two channels,       *
+ * counted since start, a prefill the sink plays first included. *
+\* The ULP gives a finer definition, see ulp_sound_position_t.   */
+typedef struct
+{
+	uint64_t played;	 // reached the DAC
+	uint64_t written;	 // written to the FIFO
+	uint64_t stale;		 // played again from an older lap during underruns, never written
+	uint32_t latency_us; // written - played at the measured rate, how long a sample written now takes to the DAC
+} sound_sink_position_t;
+
+typedef struct
+{
+	void (*start)(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout);
+	uint16_t (*get_buffer_diff)(void *ctx); // free words
+	size_t (*write)(void *ctx, const uint8_t *samples, size_t len);
+	size_t (*write_words)(void *ctx, const uint16_t *words, size_t len); // NULL without fraction bits
+	void (*get_position)(void *ctx, sound_sink_position_t *position);
+	uint64_t (*samples_to_us)(void *ctx, uint64_t samples);
+	void (*log_telemetry)(void *ctx, bool dump); // NULL if there is nothing to tell, dump adds the backend state
+	bool (*follow)(void *ctx, uint32_t sampling_rate, uint64_t position); // NULL if a stream always starts over
+	bool (*end)(void *ctx); // NULL if nothing has to follow the last sample
+	bool (*is_done)(void *ctx); // NULL if the sink is through once it took its end
+} sound_sink_ops_t;
+
+typedef struct
+{
+	const sound_sink_ops_t *ops;
+	void *ctx;
+} sound_sink_t;
+
+void sound_sink_start(sound_sink_t *sink, uint32_t sampling_rate, sound_sink_layout_t *layout);
+uint16_t sound_sink_get_buffer_diff(sound_sink_t *sink);
+// returns the samples taken, always even, the rest has to be offered again
+size_t sound_sink_write(sound_sink_t *sink, const uint8_t *samples, size_t len);
+// one word per sample, only for a layout with fraction bits, returns the words taken
+size_t sound_sink_write_words(sound_sink_t *sink, const uint16_t *words, size_t len);
+void sound_sink_get_position(sound_sink_t *sink, sound_sink_position_t *position);
+uint64_t sound_sink_samples_to_us(sound_sink_t *sink, uint64_t samples);
+void sound_sink_log_telemetry(sound_sink_t *sink, bool dump);
+// the next stream goes on from position, the first sample it writes, in the layout of the last start. False if
+// the sink cannot take it without a start
+bool sound_sink_follow(sound_sink_t *sink, uint32_t sampling_rate, uint64_t position);
+// after the last sample, nothing may be written until the next start. False while the sink has no room
+// for its end yet, call again once it played on
+bool sound_sink_end(sound_sink_t *sink);
+// after sound_sink_end(), the sink played out what it had and whatever follows the last sample, e.g. a ramp
+bool sound_sink_is_done(sound_sink_t *sink);
+
+/* - null sink -                                                *\
+ * Takes NULL_SINK_WORDS words per refill and counts them, every *
+\* sample is played as it is written.                            */
+#define NULL_SINK_WORDS 1024
+
+typedef struct
+{
+	sound_sink_t sink;
+	uint8_t channels; // played as mono or stereo
+	uint32_t sampling_rate;
+	uint64_t samples;
+	uint32_t checksum; // over the written samples, to compare runs
+} null_sink_t;
+
+void null_sink_init(null_sink_t *null_sink, uint8_t channels);
@@ -0,0 +1,46 @@
+#include <string.h>
+
+#include "spscQueue.h"
+
+bool spsc_queue_init(spsc_queue_t *queue, void *slots, uint16_t slot_size, uint16_t len)
+{
+	if ((len == 0) || (len & (len - 1)))
+		return false;
+	queue->slots = slots;
+	queue->slot_size = slot_size;
+	queue->len = len;
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+	return true;
+}
+
+bool spsc_queue_push(spsc_queue_t *queue, const void *item)
+{
+	// only this side writes head, the tail may lag which only makes the queue look fuller
+	unsigned head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	if (head - tail >= queue->len)
+		return false;
+	memcpy(queue->slots + (size_t)(head & (queue->len - 1)) * queue->slot_size, item, queue->slot_size);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return true;
+}
+
+bool spsc_queue_pop(spsc_queue_t *queue, void *item)
+{
+	unsigned tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	if (head == tail)
+		return false;
+	memcpy(item, queue->slots + (size_t)(tail & (queue->len - 1)) * queue->slot_size, queue->slot_size);
+	// the slot is copied out before the producer may reuse it
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+uint16_t spsc_queue_count(spsc_queue_t *queue)
+{
+	unsigned tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	unsigned head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	return head - tail;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/* - single producer single consumer queue -                            *\
+ * Fixed size slots in caller memory, one task pushes and one task pops *
+ * without a lock. head and tail run free and wrap at 2^32, a slot is   *
+ * head & (len - 1), so len is a power of two. The producer fills a     *
+ * slot before it publishes head with release order, the consumer reads *
+ * head with acquire order before it copies the slot out, and the same  *
+ * holds for tail the other way round. Neither side ever waits, a push  *
+ * to a full queue or a pop from an empty one returns false. No ESP-IDF *
+\* dependencies, host threads can stand in for the tasks.               */
+
+typedef struct
+{
+	uint8_t *slots;
+	uint16_t slot_size;
+	uint16_t len;	   // slots, a power of two
+	atomic_uint head; // pushed, written by the producer only
+	atomic_uint tail; // popped, written by the consumer only
+} spsc_queue_t;
+
+// slots holds len * slot_size bytes, returns false unless len is a power of two
+bool spsc_queue_init(spsc_queue_t *queue, void *slots, uint16_t slot_size, uint16_t len);
+// producer side, copies slot_size bytes of item, false if full
+bool spsc_queue_push(spsc_queue_t *queue, const void *item);
+// consumer side, copies the oldest item out, false if empty
+bool spsc_queue_pop(spsc_queue_t *queue, void *item);
+// a snapshot, either side may have moved on when it returns
+uint16_t spsc_queue_count(spsc_queue_t *queue);
@@ -0,0 +1,479 @@
+#include <string.h>
+
+#include "ulpAsm.h"
+
+// opcodes and sub-opcodes as laid out in the ESP32 TRM ULP FSM instruction set
+#define OP_WR_REG 1
+#define OP_DELAY 4
+#define OP_ST 6
+#define OP_ALU 7
+#define OP_BRANCH 8
+#define OP_END 9
+#define OP_HALT 11
+#define OP_LD 13
+
+#define SUB_ALU_REG 0
+#define SUB_ALU_IMM 1
+#define SUB_BX 0
+#define SUB_BR 1
+#define SUB_ST 4
+
+#define BITS(insn, low, len) (((insn) >> (low)) & ((1UL << (len)) - 1))
+
+#define LABEL_NONE UINT16_MAX
+
+typedef enum
+{
+	FIXUP_JUMP = 0, // JUMP[12:2] = label
+	FIXUP_JUMPR,	// JUMPR[24:17] = label - addr, sign and magnitude
+	FIXUP_MOVI,		// ALU imm = label
+	FIXUP_LDST,		// LD/ST offset = value - label
+} ulp_asm_fixup_kind_t;
+
+void ulp_asm_init(ulp_asm_t *a, uint32_t *mem, uint16_t start, uint16_t stop)
+{
+	memset(a, 0, sizeof(ulp_asm_t));
+	a->mem = mem;
+	a->start = start;
+	a->stop = stop;
+	a->pc = start;
+	for (uint8_t i = 0; i < ULP_ASM_MAX_LABELS; i++)
+		a->label[i] = LABEL_NONE;
+}
+
+static void ulp_asm_fail(ulp_asm_t *a, ulp_asm_err_t err)
+{
+	if (a->err == ULP_ASM_OK)
+		a->err = err;
+}
+
+void ulp_asm_label(ulp_asm_t *a, uint8_t label)
+{
+	if ((label >= ULP_ASM_MAX_LABELS) || (a->label[label] != LABEL_NONE))
+	{
+		ulp_asm_fail(a, ULP_ASM_ERR_LABEL);
+		return;
+	}
+	a->label[label] = a->pc;
+}
+
+uint16_t ulp_asm_label_addr(const ulp_asm_t *a, uint8_t label)
+{
+	return (label < ULP_ASM_MAX_LABELS) ? a->label[label] : LABEL_NONE;
+}
+
+void ulp_asm_emit(ulp_asm_t *a, uint32_t insn)
+{
+	if (a->pc > a->stop)
+	{
+		ulp_asm_fail(a, ULP_ASM_ERR_TOO_LONG);
+		return;
+	}
+	a->mem[a->pc++] = insn;
+}
+
+static void ulp_asm_emit_fixup(ulp_asm_t *a, uint32_t insn, uint8_t label, ulp_asm_fixup_kind_t kind, int16_t value)
+{
+	if (a->fixup_count == ULP_ASM_MAX_FIXUPS)
+		ulp_asm_fail(a, ULP_ASM_ERR_TABLE_FULL);
+	else
+		a->fixup[a->fixup_count++] = (ulp_asm_fixup_t){.addr = a->pc, .label = label, .kind = kind, .value = value};
+	ulp_asm_emit(a, insn);
+}
+
+void ulp_asm_alu_r(ulp_asm_t *a, ulp_asm_alu_t op, uint8_t rd, uint8_t rs, uint8_t rt)
+{
+	ulp_asm_emit(a, OP_ALU << 28 | SUB_ALU_REG << 25 | op << 21 | (rt & 3) << 4 | (rs & 3) << 2 | (rd & 3));
+}
+
+void ulp_asm_alu_i(ulp_asm_t *a, ulp_asm_alu_t op, uint8_t rd, uint8_t rs, uint16_t imm)
+{
+	ulp_asm_emit(a, OP_ALU << 28 | SUB_ALU_IMM << 25 | op << 21 | (uint32_t)imm << 4 | (rs & 3) << 2 | (rd & 3));
+}
+
+void ulp_asm_movi(ulp_asm_t *a, uint8_t rd, uint16_t imm)
+{
+	ulp_asm_alu_i(a, ULP_ASM_ALU_MOV, rd, 0, imm);
+}
+
+// rd = address of label, e.g. the return address of a table call
+void ulp_asm_movi_label(ulp_asm_t *a, uint8_t rd, uint8_t label)
+{
+	ulp_asm_emit_fixup(a, OP_ALU << 28 | SUB_ALU_IMM << 25 | ULP_ASM_ALU_MOV << 21 | (rd & 3), label, FIXUP_MOVI, 0);
+}
+
+void ulp_asm_addi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm)
+{
+	ulp_asm_alu_i(a, ULP_ASM_ALU_ADD, rd, rs, imm);
+}
+
+void ulp_asm_andi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm)
+{
+	ulp_asm_alu_i(a, ULP_ASM_ALU_AND, rd, rs, imm);
+}
+
+void ulp_asm_lshi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm)
+{
+	ulp_asm_alu_i(a, ULP_ASM_ALU_LSH, rd, rs, imm);
+}
+
+void ulp_asm_rshi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm)
+{
+	ulp_asm_alu_i(a, ULP_ASM_ALU_RSH, rd, rs, imm);
+}
+
+void ulp_asm_rshr(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint8_t rt)
+{
+	ulp_asm_alu_r(a, ULP_ASM_ALU_RSH, rd, rs, rt);
+}
+
+static uint32_t ulp_asm_insn_ldst(uint8_t opcode, uint8_t sub_opcode, uint8_t r, uint8_t rs, uint16_t offset)
+{
+	return (uint32_t)opcode << 28 | sub_opcode << 25 | (uint32_t)(offset & 0x7FF) << 10 | (rs & 3) << 2 | (r & 3);
+}
+
+void ulp_asm_ld(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t offset)
+{
+	ulp_asm_emit(a, ulp_asm_insn_ldst(OP_LD, 0, rd, rs, offset));
+}
+
+void ulp_asm_st(ulp_asm_t *a, uint8_t rv, uint8_t rs, uint16_t offset)
+{
+	ulp_asm_emit(a, ulp_asm_insn_ldst(OP_ST, SUB_ST, rv, rs, offset));
+}
+
+void ulp_asm_ld_rel(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint8_t base_label, uint16_t addr)
+{
+	ulp_asm_emit_fixup(a, ulp_asm_insn_ldst(OP_LD, 0, rd, rs, 0), base_label, FIXUP_LDST, addr);
+}
+
+void ulp_asm_st_rel(ulp_asm_t *a, uint8_t rv, uint8_t rs, uint8_t base_label, uint16_t addr)
+{
+	ulp_asm_emit_fixup(a, ulp_asm_insn_ldst(OP_ST, SUB_ST, rv, rs, 0), base_label, FIXUP_LDST, addr);
+}
+
+void ulp_asm_jump(ulp_asm_t *a, uint8_t label)
+{
+	ulp_asm_emit_fixup(a, OP_BRANCH << 28 | SUB_BX << 25, label, FIXUP_JUMP, 0);
+}
+
+static void ulp_asm_jumpr(ulp_asm_t *a, uint8_t label, uint16_t threshold, bool ge)
+{
+	ulp_asm_emit_fixup(a, OP_BRANCH << 28 | SUB_BR << 25 | ge << 16 | threshold, label, FIXUP_JUMPR, 0);
+}
+
+void ulp_asm_jump_ge(ulp_asm_t *a, uint8_t label, uint16_t threshold)
+{
+	ulp_asm_jumpr(a, label, threshold, true);
+}
+
+void ulp_asm_jump_lt(ulp_asm_t *a, uint8_t label, uint16_t threshold)
+{
+	ulp_asm_jumpr(a, label, threshold, false);
+}
+
+uint32_t ulp_asm_insn_jump_reg(uint8_t rd)
+{
+	return OP_BRANCH << 28 | SUB_BX << 25 | 1 << 21 | (rd & 3);
+}
+
+// jumps to the table entry in rd, the table writes the DAC of channel and jumps back to return_label
+void ulp_asm_call(ulp_asm_t *a, uint8_t rd, uint8_t return_label, uint16_t table_cycles, uint8_t channel)
+{
+	if (a->call_count == ULP_ASM_MAX_CALLS)
+		ulp_asm_fail(a, ULP_ASM_ERR_TABLE_FULL);
+	else
+		a->call[a->call_count++] = (ulp_asm_call_t){.addr = a->pc, .return_label = return_label, .channel = channel, .table_cycles = table_cycles};
+	ulp_asm_emit(a, ulp_asm_insn_jump_reg(rd));
+}
+
+// cycles including the fetch of the next instruction (ESP32 TRM), 0 for the ones the programs do not use
+uint32_t ulp_asm_insn_cycles(uint32_t insn)
+{
+	switch (BITS(insn, 28, 4))
+	{
+	case OP_ALU:
+		return 6;
+	case OP_ST:
+	case OP_LD:
+		return 8;
+	case OP_BRANCH:
+		return 4;
+	case OP_DELAY:
+		return 6 + BITS(insn, 0, 16);
+	case OP_WR_REG:
+		return 12;
+	case OP_END:
+		return 6;
+	case OP_HALT:
+		return 2;
+	default:
+		return 0;
+	}
+}
+
+uint32_t ulp_asm_insn_delay(uint16_t cycles)
+{
+	return OP_DELAY << 28 | cycles;
+}
+
+// delay slot, holds delay_time + extra once ulp_asm_write_delay() ran
+void ulp_asm_delay(ulp_asm_t *a, uint16_t extra)
+{
+	if (a->delay_count == ULP_ASM_MAX_DELAYS)
+		ulp_asm_fail(a, ULP_ASM_ERR_TABLE_FULL);
+	else
+		a->delay[a->delay_count++] = (ulp_asm_delay_t){.addr = a->pc, .extra = extra};
+	ulp_asm_emit(a, ulp_asm_insn_delay(extra));
+}
+
+// jump through a dither pattern, both targets are followed by ulp_asm_timing()
+void ulp_asm_dither(ulp_asm_t *a, uint8_t rd, uint8_t short_label, uint8_t long_label)
+{
+	if (a->dither_count == ULP_ASM_MAX_DITHERS)
+		ulp_asm_fail(a, ULP_ASM_ERR_TABLE_FULL);
+	else
+		a->dither[a->dither_count++] = (ulp_asm_dither_t){.addr = a->pc, .short_label = short_label, .long_label = long_label};
+	ulp_asm_emit(a, ulp_asm_insn_jump_reg(rd));
+}
+
+// delay slot of a dither target, the long one gets one more cycle than ulp_asm_timing() counts
+void ulp_asm_delay_dither(ulp_asm_t *a, uint16_t extra, bool long_slot)
+{
+	ulp_asm_delay(a, extra);
+	if (a->delay_count > 0)
+		a->delay[a->delay_count - 1].kind = long_slot ? ULP_ASM_DELAY_LONG : ULP_ASM_DELAY_SHORT;
+}
+
+// fixed I_DELAY, 6 + cycles
+void ulp_asm_wait(ulp_asm_t *a, uint16_t cycles)
+{
+	ulp_asm_emit(a, ulp_asm_insn_delay(cycles));
+}
+
+uint32_t ulp_asm_insn_reg_wr(uint16_t reg_wr_addr, uint8_t high_bit, uint8_t low_bit, uint8_t data)
+{
+	return OP_WR_REG << 28 | (uint32_t)(high_bit & 0x1F) << 23 | (uint32_t)(low_bit & 0x1F) << 18 | (uint32_t)data << 10 | (reg_wr_addr & 0x3FF);
+}
+
+void ulp_asm_reg_wr(ulp_asm_t *a, uint16_t reg_wr_addr, uint8_t high_bit, uint8_t low_bit, uint8_t data)
+{
+	ulp_asm_emit(a, ulp_asm_insn_reg_wr(reg_wr_addr, high_bit, low_bit, data));
+}
+
+void ulp_asm_wake(ulp_asm_t *a)
+{
+	ulp_asm_emit(a, OP_END << 28 | 1);
+}
+
+void ulp_asm_halt(ulp_asm_t *a)
+{
+	ulp_asm_emit(a, OP_HALT << 28);
+}
+
+// resolves the labels, returns the first error of the whole build
+ulp_asm_err_t ulp_asm_finish(ulp_asm_t *a)
+{
+	for (uint8_t i = 0; (i < a->fixup_count) && (a->err == ULP_ASM_OK); i++)
+	{
+		const ulp_asm_fixup_t *f = &a->fixup[i];
+		uint16_t target = ulp_asm_label_addr(a, f->label);
+		if (target == LABEL_NONE)
+		{
+			ulp_asm_fail(a, ULP_ASM_ERR_LABEL);
+			break;
+		}
+
+		uint32_t *insn = &a->mem[f->addr];
+		int32_t offset = (int32_t)target - f->addr;
+		int32_t rel = (int32_t)f->value - target;
+		switch (f->kind)
+		{
+		case FIXUP_JUMP:
+			*insn |= (uint32_t)target << 2;
+			break;
+		case FIXUP_JUMPR:
+			if ((offset > 127) || (offset < -127))
+				ulp_asm_fail(a, ULP_ASM_ERR_RANGE);
+			*insn |= (offset < 0) << 24 | (uint32_t)((offset < 0) ? -offset : offset) << 17;
+			break;
+		case FIXUP_MOVI:
+			*insn |= (uint32_t)target << 4;
+			break;
+		case FIXUP_LDST:
+			if ((rel < 0) || (rel > 0x7FF))
+				ulp_asm_fail(a, ULP_ASM_ERR_RANGE);
+			*insn |= (uint32_t)(rel & 0x7FF) << 10;
+			break;
+		}
+	}
+	return a->err;
+}
+
+// single word writes, the ULP fetches either the old or the new delay
+void ulp_asm_write_delay(uint32_t *mem, const ulp_asm_delay_t *delay, uint8_t delay_count, uint32_t delay_time, uint32_t dither_time)
+{
+	for (uint8_t i = 0; i < delay_count; i++)
+	{
+		if (delay[i].kind == ULP_ASM_DELAY_PLAIN)
+			mem[delay[i].addr] = ulp_asm_insn_delay(delay_time + delay[i].extra);
+		else
+			mem[delay[i].addr] = ulp_asm_insn_delay(dither_time + delay[i].extra + (delay[i].kind == ULP_ASM_DELAY_LONG));
+	}
+}
+
+// spreads long_count long targets evenly over the len pattern words, first order error diffusion
+void ulp_asm_write_dither(uint32_t *mem, uint16_t start, uint16_t len, uint16_t short_addr, uint16_t long_addr, uint16_t long_count)
+{
+	uint16_t error = len / 2;
+	for (uint16_t i = 0; i < len; i++)
+	{
+		error += long_count;
+		bool long_slot = (error >= len);
+		if (long_slot)
+			error -= len;
+		mem[start + i] = long_slot ? long_addr : short_addr;
+	}
+}
+
+static const ulp_asm_call_t *ulp_asm_find_call(const ulp_asm_t *a, uint16_t addr)
+{
+	for (uint8_t i = 0; i < a->call_count; i++)
+		if (a->call[i].addr == addr)
+			return &a->call[i];
+	return NULL;
+}
+
+static const ulp_asm_dither_t *ulp_asm_find_dither(const ulp_asm_t *a, uint16_t addr)
+{
+	for (uint8_t i = 0; i < a->dither_count; i++)
+		if (a->dither[i].addr == addr)
+			return &a->dither[i];
+	return NULL;
+}
+
+static bool ulp_asm_is_delay_slot(const ulp_asm_t *a, uint16_t addr)
+{
+	for (uint8_t i = 0; i < a->delay_count; i++)
+		if (a->delay[i].addr == addr)
+			return true;
+	return false;
+}
+
+typedef struct
+{
+	uint16_t pc;
+	uint16_t steps;
+	uint32_t cycles;
+	uint8_t delays;
+} ulp_asm_walk_t;
+
+/* Walks from every sample call to the next sample call on the same  *\
+ * channel, both ways at each JUMPR since the analysis knows no      *
+ * register values, JUMPR GE 0 is always taken. Dither jumps go to   *
+ * both targets. Calls on another channel and their tables are part  *
+ * of the path. Paths that halt or reach a ULP_ASM_NO_SAMPLE call    *
+\* end without a DAC write.                                          */
+ulp_asm_err_t ulp_asm_timing(const ulp_asm_t *a, ulp_asm_timing_t *timing)
+{
+	memset(timing, 0, sizeof(ulp_asm_timing_t));
+	timing->words = a->pc - a->start;
+	timing->min_cycles = UINT32_MAX;
+	timing->min_delays = UINT8_MAX;
+	if (a->err != ULP_ASM_OK)
+		return a->err;
+
+	ulp_asm_walk_t stack[ULP_ASM_MAX_PATHS];
+	for (uint8_t c = 0; c < a->call_count; c++)
+	{
+		const ulp_asm_call_t *from = &a->call[c];
+		if (from->channel == ULP_ASM_NO_SAMPLE)
+			continue;
+
+		uint8_t depth = 0;
+		stack[depth++] = (ulp_asm_walk_t){.pc = ulp_asm_label_addr(a, from->return_label), .cycles = 4 + from->table_cycles};
+		while (depth > 0)
+		{
+			ulp_asm_walk_t w = stack[--depth];
+			while (true)
+			{
+				if ((w.pc < a->start) || (w.pc >= a->pc) || (w.steps++ > ULP_ASM_MAX_PATH_STEPS))
+					return ULP_ASM_ERR_PATHS;
+
+				uint32_t insn = a->mem[w.pc];
+				const ulp_asm_call_t *call = ulp_asm_find_call(a, w.pc);
+				if (call != NULL)
+				{
+					if (call->channel == ULP_ASM_NO_SAMPLE)
+						break;
+					if (call->channel == from->channel)
+					{
+						timing->paths++;
+						if (w.cycles < timing->min_cycles)
+							timing->min_cycles = w.cycles;
+						if (w.cycles > timing->max_cycles)
+							timing->max_cycles = w.cycles;
+						if (w.delays < timing->min_delays)
+							timing->min_delays = w.delays;
+						if (w.delays > timing->max_delays)
+							timing->max_delays = w.delays;
+						break;
+					}
+					w.cycles += 4 + call->table_cycles;
+					w.pc = ulp_asm_label_addr(a, call->return_label);
+					continue;
+				}
+
+				w.cycles += ulp_asm_insn_cycles(insn);
+				w.delays += ulp_asm_is_delay_slot(a, w.pc);
+				const ulp_asm_dither_t *dither = ulp_asm_find_dither(a, w.pc);
+				if (dither != NULL)
+				{
+					if (depth == ULP_ASM_MAX_PATHS)
+						return ULP_ASM_ERR_PATHS;
+					stack[depth] = w;
+					stack[depth++].pc = ulp_asm_label_addr(a, dither->long_label);
+					w.pc = ulp_asm_label_addr(a, dither->short_label);
+					continue;
+				}
+				uint8_t opcode = BITS(insn, 28, 4);
+				if (opcode == OP_HALT)
+					break;
+				if ((opcode == OP_BRANCH) && (BITS(insn, 25, 3) == SUB_BX))
+				{
+					if (BITS(insn, 21, 1))
+						return ULP_ASM_ERR_UNKNOWN_JUMP;
+					w.pc = BITS(insn, 2, 11);
+					continue;
+				}
+				if ((opcode == OP_BRANCH) && (BITS(insn, 25, 3) == SUB_BR))
+				{
+					int16_t offset = BITS(insn, 17, 7);
+					uint16_t taken = w.pc + (BITS(insn, 24, 1) ? -offset : offset);
+					// R0 >= 0 always holds
+					if (BITS(insn, 16, 1) && (BITS(insn, 0, 16) == 0))
+					{
+						w.pc = taken;
+						continue;
+					}
+					if (depth == ULP_ASM_MAX_PATHS)
+						return ULP_ASM_ERR_PATHS;
+					stack[depth] = w;
+					stack[depth++].pc = taken;
+				}
+				w.pc++;
+			}
+		}
+	}
+	if (timing->paths == 0)
+		return ULP_ASM_ERR_PATHS;
+	return ULP_ASM_OK;
+}
+
+// I_DELAY value for the rate, 0 if the program cannot go that fast
+uint32_t ulp_asm_delay_for_rate(uint32_t cycles, uint32_t rtc_freq_hz, uint32_t rate)
+{
+	if ((rate == 0) || (rtc_freq_hz / rate < cycles))
+		return 0;
+	return rtc_freq_hz / rate - cycles;
+}
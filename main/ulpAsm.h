@@ -0,0 +1,163 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* - ULP FSM program builder -                                          *\
+ * Emits instructions into a RTC_SLOW_MEM image with labels instead of  *
+ * hand counted offsets, JUMP targets, JUMPR offsets, return addresses  *
+ * and base relative LD/ST offsets are resolved by ulp_asm_finish().    *
+ * I_DELAY words marked as delay slots hold their balancing extra and   *
+ * get delay_time added later. Jumps into a DAC opcode table are        *
+ * declared as calls with the table cycles and the return label, which  *
+ * lets ulp_asm_timing() walk every path from one DAC write to the next *
+ * on the same channel and report its cycles. Cycle counts are the TRM  *
+ * ones of ulp_asm_insn_cycles(), the host emulator in test/ uses them. *
+ * A dither jump goes to the address a pattern in RTC memory holds for  *
+ * the current index, the short or the long one of a pair of delay      *
+ * slots. The long slot runs one cycle longer, which the timing leaves  *
+ * out, so a fraction of the pattern entries adds a fraction of a cycle *
+ * to the average sample period.                                        *
+\* No ESP-IDF dependencies, runs on host next to the emulator.          */
+
+#define ULP_ASM_MAX_LABELS 16
+#define ULP_ASM_MAX_FIXUPS 32
+#define ULP_ASM_MAX_DELAYS 8
+#define ULP_ASM_MAX_CALLS 8
+#define ULP_ASM_MAX_DITHERS 2
+#define ULP_ASM_MAX_PATHS 64
+#define ULP_ASM_MAX_PATH_STEPS 256
+
+#define ULP_ASM_NO_SAMPLE 0xFF // call channel of a table jump that is not a sample, e.g. parking the DAC
+
+typedef enum
+{
+	ULP_ASM_ALU_ADD = 0,
+	ULP_ASM_ALU_SUB,
+	ULP_ASM_ALU_AND,
+	ULP_ASM_ALU_OR,
+	ULP_ASM_ALU_MOV,
+	ULP_ASM_ALU_LSH,
+	ULP_ASM_ALU_RSH,
+} ulp_asm_alu_t;
+
+typedef enum
+{
+	ULP_ASM_OK = 0,
+	ULP_ASM_ERR_TOO_LONG,	   // program runs past the stop address
+	ULP_ASM_ERR_LABEL,		   // label used but never placed, placed twice or out of range
+	ULP_ASM_ERR_RANGE,		   // offset or immediate does not fit its field
+	ULP_ASM_ERR_TABLE_FULL,	   // more fixups, delay slots or calls than the builder holds
+	ULP_ASM_ERR_UNKNOWN_JUMP,  // register jump that was not declared as a call
+	ULP_ASM_ERR_PATHS,		   // too many paths or a path without DAC write
+} ulp_asm_err_t;
+
+typedef struct
+{
+	uint16_t addr;
+	uint8_t label;
+	uint8_t kind;
+	int16_t value;
+} ulp_asm_fixup_t;
+
+typedef enum
+{
+	ULP_ASM_DELAY_PLAIN = 0, // holds delay_time + extra
+	ULP_ASM_DELAY_SHORT,	 // holds dither_time + extra
+	ULP_ASM_DELAY_LONG,		 // holds dither_time + extra + 1
+} ulp_asm_delay_kind_t;
+
+typedef struct
+{
+	uint16_t addr;
+	uint16_t extra; // cycles added to delay_time to balance its path
+	uint8_t kind;
+} ulp_asm_delay_t;
+
+typedef struct
+{
+	uint16_t addr;
+	uint8_t return_label;
+	uint8_t channel;
+	uint16_t table_cycles; // REG_WR and JUMP words executed in the table
+} ulp_asm_call_t;
+
+typedef struct
+{
+	uint16_t addr;
+	uint8_t short_label;
+	uint8_t long_label;
+} ulp_asm_dither_t;
+
+typedef struct
+{
+	uint32_t *mem;
+	uint16_t start;
+	uint16_t stop;
+	uint16_t pc;
+	ulp_asm_err_t err;
+
+	uint16_t label[ULP_ASM_MAX_LABELS];
+	ulp_asm_fixup_t fixup[ULP_ASM_MAX_FIXUPS];
+	uint8_t fixup_count;
+	ulp_asm_delay_t delay[ULP_ASM_MAX_DELAYS];
+	uint8_t delay_count;
+	ulp_asm_call_t call[ULP_ASM_MAX_CALLS];
+	uint8_t call_count;
+	ulp_asm_dither_t dither[ULP_ASM_MAX_DITHERS];
+	uint8_t dither_count;
+} ulp_asm_t;
+
+typedef struct
+{
+	uint16_t words;		 // program length
+	uint16_t paths;		 // DAC write to DAC write paths
+	uint32_t min_cycles; // per path, without delay_time
+	uint32_t max_cycles;
+	uint8_t min_delays; // delay slots passed per path, 1 for a rate that follows delay_time
+	uint8_t max_delays;
+} ulp_asm_timing_t;
+
+void ulp_asm_init(ulp_asm_t *a, uint32_t *mem, uint16_t start, uint16_t stop);
+void ulp_asm_label(ulp_asm_t *a, uint8_t label);
+uint16_t ulp_asm_label_addr(const ulp_asm_t *a, uint8_t label);
+ulp_asm_err_t ulp_asm_finish(ulp_asm_t *a);
+
+void ulp_asm_emit(ulp_asm_t *a, uint32_t insn);
+void ulp_asm_alu_r(ulp_asm_t *a, ulp_asm_alu_t op, uint8_t rd, uint8_t rs, uint8_t rt);
+void ulp_asm_alu_i(ulp_asm_t *a, ulp_asm_alu_t op, uint8_t rd, uint8_t rs, uint16_t imm);
+void ulp_asm_movi(ulp_asm_t *a, uint8_t rd, uint16_t imm);
+void ulp_asm_movi_label(ulp_asm_t *a, uint8_t rd, uint8_t label);
+void ulp_asm_addi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm);
+void ulp_asm_andi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm);
+void ulp_asm_lshi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm);
+void ulp_asm_rshi(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t imm);
+void ulp_asm_rshr(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint8_t rt);
+void ulp_asm_ld(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint16_t offset);
+void ulp_asm_st(ulp_asm_t *a, uint8_t rv, uint8_t rs, uint16_t offset);
+// rs holds the address of base_label, reaches addr
+void ulp_asm_ld_rel(ulp_asm_t *a, uint8_t rd, uint8_t rs, uint8_t base_label, uint16_t addr);
+void ulp_asm_st_rel(ulp_asm_t *a, uint8_t rv, uint8_t rs, uint8_t base_label, uint16_t addr);
+void ulp_asm_jump(ulp_asm_t *a, uint8_t label);
+void ulp_asm_jump_ge(ulp_asm_t *a, uint8_t label, uint16_t threshold); // JUMPR, R0 >= threshold
+void ulp_asm_jump_lt(ulp_asm_t *a, uint8_t label, uint16_t threshold); // JUMPR, R0 < threshold
+void ulp_asm_call(ulp_asm_t *a, uint8_t rd, uint8_t return_label, uint16_t table_cycles, uint8_t channel);
+void ulp_asm_delay(ulp_asm_t *a, uint16_t extra);
+// jumps to the address in rd, which a dither pattern holds, short_label or long_label
+void ulp_asm_dither(ulp_asm_t *a, uint8_t rd, uint8_t short_label, uint8_t long_label);
+void ulp_asm_delay_dither(ulp_asm_t *a, uint16_t extra, bool long_slot);
+void ulp_asm_wait(ulp_asm_t *a, uint16_t cycles);
+void ulp_asm_reg_wr(ulp_asm_t *a, uint16_t reg_wr_addr, uint8_t high_bit, uint8_t low_bit, uint8_t data);
+void ulp_asm_wake(ulp_asm_t *a);
+void ulp_asm_halt(ulp_asm_t *a);
+
+uint32_t ulp_asm_insn_cycles(uint32_t insn);
+uint32_t ulp_asm_insn_delay(uint16_t cycles);
+uint32_t ulp_asm_insn_reg_wr(uint16_t reg_wr_addr, uint8_t high_bit, uint8_t low_bit, uint8_t data);
+uint32_t ulp_asm_insn_jump_reg(uint8_t rd);
+
+void ulp_asm_write_delay(uint32_t *mem, const ulp_asm_delay_t *delay, uint8_t delay_count, uint32_t delay_time, uint32_t dither_time);
+void ulp_asm_write_dither(uint32_t *mem, uint16_t start, uint16_t len, uint16_t short_addr, uint16_t long_addr, uint16_t long_count);
+ulp_asm_err_t ulp_asm_timing(const ulp_asm_t *a, ulp_asm_timing_t *timing);
+uint32_t ulp_asm_delay_for_rate(uint32_t cycles, uint32_t rtc_freq_hz, uint32_t rate);
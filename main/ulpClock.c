@@ -0,0 +1,73 @@
+#include "ulpClock.h"
+
+void ulp_clock_init(ulp_clock_t *clock, uint32_t rtc_freq_hz, uint32_t target_rate, uint32_t program_cycles, uint32_t delay, uint16_t delay_frac, bool fractional)
+{
+	clock->target_rate = target_rate;
+	clock->program_cycles = program_cycles;
+	clock->delay = delay;
+	clock->delay_frac = fractional ? delay_frac : 0;
+	clock->fractional = fractional;
+	clock->rtc_freq_hz = rtc_freq_hz;
+	ulp_clock_discard_window(clock);
+}
+
+void ulp_clock_discard_window(ulp_clock_t *clock)
+{
+	clock->window_samples = 0;
+	clock->window_us = 0;
+}
+
+// sample period in 1/65536 cycles
+static uint64_t ulp_clock_period_q16(const ulp_clock_t *clock)
+{
+	return ((uint64_t)(clock->program_cycles + clock->delay) << 16) + clock->delay_frac;
+}
+
+// returns true when clock->delay or clock->delay_frac has changed and has to be written to the ULP program
+bool ulp_clock_feed(ulp_clock_t *clock, uint32_t samples, uint32_t elapsed_us)
+{
+	clock->window_samples += samples;
+	clock->window_us += elapsed_us;
+	if (clock->window_us < ULP_CLOCK_WINDOW_US)
+		return false;
+	// a stalled timer or a long light sleep in one feed, the samples may not match the time
+	if (clock->window_us > ULP_CLOCK_STALL_US)
+	{
+		ulp_clock_discard_window(clock);
+		return false;
+	}
+
+	// RTC clock seen by the ULP during this window, cycles * 1e6 / window_us split so it cannot pass 2^64
+	uint64_t cycles_q16 = clock->window_samples * ulp_clock_period_q16(clock);
+	uint64_t quotient = cycles_q16 / clock->window_us;
+	uint64_t remainder = cycles_q16 % clock->window_us;
+	int64_t measured_hz = (quotient * 1000000 + remainder * 1000000 / clock->window_us) >> 16;
+	ulp_clock_discard_window(clock);
+	clock->rtc_freq_hz += (measured_hz - (int64_t)clock->rtc_freq_hz) >> ULP_CLOCK_FILTER_SHIFT;
+
+	if (clock->target_rate == 0)
+		return false;
+
+	// ideal delay in 1/65536 cycles
+	int64_t ideal_q16 = (((uint64_t)clock->rtc_freq_hz << 16) + clock->target_rate / 2) / clock->target_rate - ((uint64_t)clock->program_cycles << 16);
+	if (ideal_q16 < 0)
+		ideal_q16 = 0;
+	if (ideal_q16 > ((int64_t)ULP_CLOCK_DELAY_MAX << 16))
+		ideal_q16 = (int64_t)ULP_CLOCK_DELAY_MAX << 16;
+
+	const int64_t hysteresis_q16 = clock->fractional ? ULP_CLOCK_FRAC_HYSTERESIS_Q16 : ULP_CLOCK_HYSTERESIS_Q16;
+	int64_t error_q16 = ideal_q16 - (((int64_t)clock->delay << 16) + clock->delay_frac);
+	if ((error_q16 < hysteresis_q16) && (error_q16 > -hysteresis_q16))
+		return false;
+
+	if (!clock->fractional)
+		ideal_q16 = (ideal_q16 + 0x8000) & ~0xFFFFLL;
+	clock->delay = ideal_q16 >> 16;
+	clock->delay_frac = ideal_q16 & 0xFFFF;
+	return true;
+}
+
+uint32_t ulp_clock_get_rate(const ulp_clock_t *clock)
+{
+	return ((uint64_t)clock->rtc_freq_hz << 16) / ulp_clock_period_q16(clock);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* - ULP sample clock control loop -                                    *\
+ * Estimates the RTC fast clock from ULP samples counted over wall      *
+ * clock time and derives the I_DELAY value that hits the target rate.  *
+ * f_est = samples / elapsed * (program cycles + delay)                 *
+ * A wrong program cycle count only biases f_est, the loop still        *
+ * settles where the measured rate equals the target rate.              *
+ * The delay is kept in 1/65536 cycles, programs that dither it between *
+ * two I_DELAY values realize the fraction, the others round it.        *
+\* No ESP-IDF dependencies, can be driven on host by a simulated clock. */
+
+#define ULP_CLOCK_WINDOW_US 2000000 // samples are accumulated this long before each correction
+#define ULP_CLOCK_STALL_US (4 * ULP_CLOCK_WINDOW_US) // a window this long spans a stall, it is discarded
+#define ULP_CLOCK_FILTER_SHIFT 2	// f_est moves 1/4 of the way to each new measurement
+#define ULP_CLOCK_HYSTERESIS_Q16 (160 << 8) // only move an integer delay once it is off by 0.625 cycles
+#define ULP_CLOCK_FRAC_HYSTERESIS_Q16 256	  // a fractional one once off by 1/256 cycle, 20 ppm at 190 cycles
+#define ULP_CLOCK_DELAY_MAX (UINT16_MAX - 8) // headroom for the balancing cycles some I_DELAY words add
+
+typedef struct
+{
+	uint32_t target_rate;	 // Hz, 0 runs the program without delay and disables the loop
+	uint32_t program_cycles; // cycles per sample excluding the delay
+	uint32_t delay;			 // current I_DELAY value
+	uint16_t delay_frac;	 // 1/65536 cycles on top of delay, always 0 unless fractional
+	bool fractional;		 // the program dithers the delay
+	uint32_t rtc_freq_hz;	 // filtered RTC fast clock estimate
+	uint64_t window_samples;
+	uint64_t window_us;
+} ulp_clock_t;
+
+void ulp_clock_init(ulp_clock_t *clock, uint32_t rtc_freq_hz, uint32_t target_rate, uint32_t program_cycles, uint32_t delay, uint16_t delay_frac, bool fractional);
+void ulp_clock_discard_window(ulp_clock_t *clock);
+bool ulp_clock_feed(ulp_clock_t *clock, uint32_t samples, uint32_t elapsed_us);
+uint32_t ulp_clock_get_rate(const ulp_clock_t *clock);
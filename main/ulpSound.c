@@ -1,5 +1,7 @@
 
+#include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include "ctype.h"
 
@@ -7,152 +9,1919 @@
 #include <driver/dac.h>
 
 #include "ulp.h"
+#include "soc/rtc_cntl_reg.h"
+#include "soc/rtc_io_reg.h"
 #include "esp_sleep.h"
+#include "esp_rom_sys.h"
 #include "esp_log.h"
 
+#include "ulpAsm.h"
 #include "ulpSound.h"
 
 static const char *TAG = "ulpSound";
 
-void ulp_sound_init(ulp_sound_t *ulp, uint32_t target_sampling_rate)
+// labels of the program builder
+enum
 {
-	esp_sleep_enable_timer_wakeup(1000);
+	ULPSOUND_LABEL_LOOP = 0,
+	ULPSOUND_LABEL_RET_LOW, // table return of the low byte, the only sample or the left channel
+	ULPSOUND_LABEL_RET_HIGH,
+	ULPSOUND_LABEL_RET_PARK,
+	ULPSOUND_LABEL_JOIN,
+	ULPSOUND_LABEL_END,
+	ULPSOUND_LABEL_TAIL,
+	ULPSOUND_LABEL_TAIL_WATERMARK,
+	ULPSOUND_LABEL_TAIL_PAST,
+	ULPSOUND_LABEL_TAIL_WRAP,
+	ULPSOUND_LABEL_DITHER_SHORT,
+	ULPSOUND_LABEL_DITHER_LONG,
+	ULPSOUND_LABEL_SEGMENT,
+};
 
-	ulp->last_filled_word = 0;
+// REG_WR + JUMP per table, the nibble tables are chained
+#define ULPSOUND_TABLE_CYCLES 16
+#define ULPSOUND_NIBBLE_TABLE_CYCLES 32
 
-	for (size_t i = ULPSOUND_PROG_START; i < ULPSOUND_PROG_STOP; i++)
-		RTC_SLOW_MEM[i] = 11 << 28; // STOP ULP
+// RTC_SLOW_MEM layout, regions back to back and clear of the words reserved for ESP-IDF
+_Static_assert(ULPSOUND_WRAP_ADDR > ULPSOUND_PROG_STOP, "wrap counter overlaps the program");
+_Static_assert(ULPSOUND_READ_ADDR > ULPSOUND_WRAP_ADDR, "index tracker overlaps the wrap counter");
+_Static_assert(ULPSOUND_DITHER_START > ULPSOUND_READ_ADDR, "dither pattern overlaps the index tracker");
+_Static_assert(ULPSOUND_BUFF_START == ULPSOUND_DITHER_START + ULPSOUND_DITHER_LEN, "buffer does not follow the dither pattern");
+_Static_assert((ULPSOUND_DITHER_LEN & (ULPSOUND_DITHER_LEN - 1)) == 0, "dither pattern is indexed by a mask");
+_Static_assert(ULPSOUND_NIBBLE_HIGH_MAP_START == ULPSOUND_NIBBLE_BUFF_STOP + 1, "nibble tables do not follow the buffer");
+_Static_assert(ULPSOUND_NIBBLE_LOW_MAP_START == ULPSOUND_NIBBLE_HIGH_MAP_START + 32, "nibble tables are 16 x 2 words");
+_Static_assert(ULPSOUND_NIBBLE_MAP_STOP == ULPSOUND_NIBBLE_LOW_MAP_START + 31, "nibble tables are 16 x 2 words");
+_Static_assert(ULPSOUND_DAC_MAP_LEN == 512, "DAC table is 256 x 2 words");
+_Static_assert(ULPSOUND_DAC_MAP_START == ULPSOUND_BUFF_STOP + 1, "DAC table does not follow the buffer");
+_Static_assert(ULPSOUND_DAC2_MAP_START == ULPSOUND_STEREO_BUFF_STOP + 1, "DAC2 table does not follow the buffer");
+_Static_assert(ULPSOUND_DAC2_MAP_STOP + 1 == ULPSOUND_DAC_MAP_START, "DAC2 table does not end at the DAC1 table");
+_Static_assert(ULPSOUND_DPCM_STEP_START == ULPSOUND_DPCM_BUFF_STOP + 1, "DPCM step table does not follow the buffer");
+_Static_assert(ULPSOUND_DPCM_VALUE_ADDR == ULPSOUND_DPCM_STEP_START + ULPSOUND_DPCM_STEP_LEN, "DPCM value does not follow the step table");
+_Static_assert(ULPSOUND_DPCM_SYNC_ADDR + 1 == ULPSOUND_DAC_MAP_START, "DPCM sync does not end at the DAC table");
+_Static_assert(ULPSOUND_TONE_NEXT_ADDR < ULPSOUND_DAC_MAP_START, "tone state reaches the DAC table");
+_Static_assert(ULPSOUND_TONE_WAVE_LEN == 1 << (16 - 11), "the tone plays the top 5 bits of the phase");
+_Static_assert(ULPSOUND_DAC_MAP_STOP < 2044 && ULPSOUND_NIBBLE_MAP_STOP < 2044, "tables reach the ESP-IDF words");
+// index tracker and wrap counter are the low 16 bits of a word, JUMPR thresholds as well
+_Static_assert(ULPSOUND_NIBBLE_BUFF_LEN * 2 <= UINT16_MAX, "sample index does not fit 16 bits");
+_Static_assert(ULPSOUND_DPCM_BUFF_LEN * 4 <= UINT16_MAX, "DPCM sample index does not fit 16 bits");
 
-	rtc_clk_8m_enable(1, 1); // enable the 8 MHz RTC clock with /256 divider
-	dac_output_disable(DAC_CHAN_0);
-	ESP_LOGI(TAG, "Sampling rate target: %luHz", target_sampling_rate);
-	while ((!rtc_clk_8m_enabled()) || (!rtc_clk_8md256_enabled()))
-		ulp_sound_lightsleep_delay(1000);
-	uint32_t rtc_fast_freq_hz = 1000000.0 * (double)(1 << RTC_CLK_CAL_FRACT) * 256.0 / (double)rtc_clk_cal(RTC_CAL_8MD256, 1000);
-	rtc_clk_8m_enable(1, 0); // disable the /256 divider
-	ESP_LOGI(TAG, "RTC freq: %luHz", rtc_fast_freq_hz);
-	ESP_LOGI(TAG, "Maximum sampling rate at current RTC clock: %luHz", rtc_fast_freq_hz / ULPSOUND_PROGRAM_CLOCKCYCLE);
-	int32_t dt_tmp = (rtc_fast_freq_hz / target_sampling_rate) - ULPSOUND_PROGRAM_CLOCKCYCLE;
-	uint32_t delay_time = 0;
-	if ((target_sampling_rate == 0) || (dt_tmp < 0))
-		ESP_LOGW(TAG, "Sampling rate has been set to %luHz", rtc_fast_freq_hz / ULPSOUND_PROGRAM_CLOCKCYCLE);
-	else
-		delay_time = dt_tmp;
-	ESP_LOGI(TAG, "Delay time: %lu", delay_time);
-	ulp->sampling_rate = rtc_fast_freq_hz / (ULPSOUND_PROGRAM_CLOCKCYCLE + delay_time);
-	ESP_LOGI(TAG, "Sampling rate current: %luHz", ulp->sampling_rate);
-	const ulp_insn_t mono[] = {
-		// R3: zero reg
-		I_MOVI(R3, 0), // 6 cycles
-		// delay to get the right sampling rate
-		/* label: index reset */
-		I_DELAY(delay_time), // 6 + delay_time
-		// reset sample index, R0: holds sample index
-		I_MOVI(R0, 0), // 6 cycles
-		// write the index back to RTC_SLOW_MEM[17]
-		/* label: write fifo head index */
-		I_ST(R0, R3, ULPSOUND_READ_ADDR), // 8 cycles
-		// divide index by two since we store two samples in each dword, R2: holds sample word index
-		I_RSHI(R2, R0, 1), // 6 cycles
-		// load the samples, R1: holds sample word
-		I_LD(R1, R2, ULPSOUND_BUFF_START), // 8 cycles
-		// get if odd or even sample, R2: 1 if odd 0 if even
-		I_ANDI(R2, R0, 1), // 6 cycles
-		// multiply by 8, R2: 8 if odd 0 if even
-		I_LSHI(R2, R2, 3), // 6 cycles
-		// shift the bits to have the right sample in the lower 8 bits, R1: holds sample at lower 8 bits
-		I_RSHR(R1, R1, R2), // 6 cycles
-		// mask the lower 8 bits, R1: holds sample at lower 8 bits, higher bits are zeroed out
-		I_ANDI(R1, R1, 0xFF), // 6 cycles
-		// multiply sample by 2 to address the dac table, R1: contains value of 0, 2, 4, ..., 510
-		I_LSHI(R1, R1, 1), // 6 cycles
-		// add start position, R1: contains value of ULPSOUND_DAC_MAP_START + (0, 2, 4, ..., 510)
-		I_ADDI(R1, R1, ULPSOUND_DAC_MAP_START), // 6 cycles
-		// jump to the dac opcode to write dac1 output value
-		I_BXR(R1), // (JUMP) 4 cycles
-		// write io and jump back takes another 12(REG_WR) + 4(JUMP) cycles
-		// here we get back from writing a sample
-		// increment the sample index
-		I_ADDI(R0, R0, 1), // 6 cycles
-		// if reached end of the buffer, jump relative to [index reset]
-		I_BGE(-13, ULPSOUND_BUFF_LEN * 2), // (JUMPR GE) 4 cycles
-		// wait to get the right sample rate (2 cycles more to compensate the [index reset])
-		I_DELAY(delay_time + 2), // 8 + delay_time
-		// if not, jump absolute to [write fifo head index]
-		I_BXI(3)}; // 4 cycles
-
-	size_t size = sizeof(mono) / sizeof(ulp_insn_t);
-	ulp_process_macros_and_load(0, mono, &size);
-	ESP_LOGI(TAG, "Macros loaded, %d Bytes", size);
+// REG_WR addresses of RTCIO_PAD_DAC1_REG and RTCIO_PAD_DAC2_REG
+#define ULPSOUND_DAC1_REG_WR_ADDR ((0x400 + 0x84) / 4)
+#define ULPSOUND_DAC2_REG_WR_ADDR ((0x400 + 0x88) / 4)
 
-	// create DAC opcode tables
-	for (int i = 0; i <= 0xFF; i++)
+typedef struct
+{
+	uint16_t buff_len;		// words of audio buffer
+	uint8_t index_shift;	// log2 of the samples per word when the index counts samples, 0: index counts words
+	uint8_t channels;		// independent channels in a word
+	bool dac2;				// DAC2 table is built and driven
+	bool dac2_inverted;		// DAC2 table writes 255 - code
+	bool nibble;			// DAC1 is written through the two nibble tables
+	uint8_t dither_samples; // samples per dither jump, 0 rounds the delay
+	uint8_t oversampling;	// DAC writes per index step, 0 for 1
+	uint8_t fraction_bits;	// bits below the DAC LSB in each word, played as sub-samples
+	bool dpcm;				// words carry deltas against the value the ULP keeps, see ulp_sound_write_dpcm()
+} ulp_sound_program_info_t;
+
+static const ulp_sound_program_info_t ulp_sound_programs[] = {
+	[ULPSOUND_PROGRAM_SINGLE] = {
+		.buff_len = ULPSOUND_BUFF_LEN,
+		.index_shift = 1,
+		.channels = 1,
+	},
+	[ULPSOUND_PROGRAM_PAIR] = {
+		.buff_len = ULPSOUND_BUFF_LEN,
+		.index_shift = 1,
+		.channels = 1,
+		.dither_samples = 2,
+	},
+	[ULPSOUND_PROGRAM_STEREO] = {
+		.buff_len = ULPSOUND_STEREO_BUFF_LEN,
+		.index_shift = 0,
+		.channels = 2,
+		.dac2 = true,
+	},
+	[ULPSOUND_PROGRAM_BRIDGED] = {
+		.buff_len = ULPSOUND_STEREO_BUFF_LEN,
+		.index_shift = 0,
+		.channels = 1,
+		.dac2 = true,
+		.dac2_inverted = true,
+	},
+	[ULPSOUND_PROGRAM_COMPACT] = {
+		.buff_len = ULPSOUND_NIBBLE_BUFF_LEN,
+		.index_shift = 1,
+		.channels = 1,
+		.nibble = true,
+		.dither_samples = 2,
+	},
+	[ULPSOUND_PROGRAM_CHIME] = {
+		.buff_len = ULPSOUND_NIBBLE_BUFF_LEN,
+		.index_shift = 1,
+		.channels = 1,
+		.nibble = true,
+	},
+	[ULPSOUND_PROGRAM_OVERSAMPLED] = {
+		.buff_len = ULPSOUND_BUFF_LEN,
+		.index_shift = 0,
+		.channels = 1,
+		.dither_samples = 2,
+		.oversampling = 2,
+		.fraction_bits = 1,
+	},
+	[ULPSOUND_PROGRAM_DPCM] = {
+		.buff_len = ULPSOUND_DPCM_BUFF_LEN,
+		.index_shift = 2,
+		.channels = 1,
+		.dpcm = true,
+	},
+	[ULPSOUND_PROGRAM_TONE] = {
+		.channels = 1,
+	},
+};
+
+// DPCM delta of each nibble, sorted in two's complement order: nibble ^ 8 ranks them
+static const int8_t ulp_sound_dpcm_steps[ULPSOUND_DPCM_STEP_LEN] = {0, 1, 2, 4, 7, 12, 20, 36, -64, -36, -20, -12, -7, -4, -2, -1};
+
+// nibble of the step closest to each sample - value + 255, ties to the smaller step
+static uint8_t ulp_sound_dpcm_lut[511];
+static bool ulp_sound_dpcm_lut_valid;
+
+static void ulp_sound_dpcm_build_lut(void)
+{
+	if (ulp_sound_dpcm_lut_valid)
+		return;
+	for (int32_t diff = -255; diff <= 255; diff++)
 	{
-		/* REG_WR - https://www.espressif.com/sites/default/files/documentation/esp32_technical_reference_manual_en.pdf#subsubsection.30.4.14 */
-		const uint32_t inst_reg_wr = 1 << 28; // Indicates a REG_WR instuction, should be put in REG_WR[31:28]
+		uint8_t best = 0;
+		for (uint8_t nibble = 1; nibble < ULPSOUND_DPCM_STEP_LEN; nibble++)
+		{
+			int32_t error = abs(diff - ulp_sound_dpcm_steps[nibble]);
+			int32_t best_error = abs(diff - ulp_sound_dpcm_steps[best]);
+			if ((error < best_error) || ((error == best_error) && (abs(ulp_sound_dpcm_steps[nibble]) < abs(ulp_sound_dpcm_steps[best]))))
+				best = nibble;
+		}
+		ulp_sound_dpcm_lut[diff + 255] = best;
+	}
+	ulp_sound_dpcm_lut_valid = true;
+}
+
+// the closest step that keeps value on the DAC range. A step past the range is never closer to the
+// sample than the next step back, which is in range, so one rank down (or up) is enough
+static uint8_t ulp_sound_dpcm_nibble(uint8_t value, uint8_t sample)
+{
+	uint8_t nibble = ulp_sound_dpcm_lut[sample - value + 255];
+	int32_t next = value + ulp_sound_dpcm_steps[nibble];
+	if (next > 255)
+		nibble = ((nibble ^ 8) - 1) ^ 8;
+	else if (next < 0)
+		nibble = ((nibble ^ 8) + 1) ^ 8;
+	return nibble;
+}
+
+// DAC writes per index step
+static uint8_t ulp_sound_oversampling(ulp_sound_program_t program)
+{
+	return ulp_sound_programs[program].oversampling ? ulp_sound_programs[program].oversampling : 1;
+}
+
+uint8_t ulp_sound_program_channels(ulp_sound_program_t program)
+{
+	return ulp_sound_programs[program].channels;
+}
+
+bool ulp_sound_program_uses_dac2(ulp_sound_program_t program)
+{
+	return ulp_sound_programs[program].dac2;
+}
+
+uint8_t ulp_sound_program_fraction_bits(ulp_sound_program_t program)
+{
+	return ulp_sound_programs[program].fraction_bits;
+}
 
-		// RTCIO_PAD_DAC1_REG - https://www.espressif.com/sites/default/files/documentation/esp32_technical_reference_manual_en.pdf#Regfloat.4.49
-		// We are going to write to RTCIO_PAD_DAC1_REG[26:19], aka dac1 value
-		const uint32_t reg_wr_high_bit = 26 << 23; // RTCIO_PAD_PDAC1_DAC high bit, should be put in REG_WR[27:23]
-		const uint32_t reg_wr_low_bit = 19 << 18;  // RTCIO_PAD_PDAC1_DAC low bit, should be put in REG_WR[22:18]
+// REG_WR of value to DAC bits [low_bit + bits - 1:low_bit] of the pad register at reg_wr_addr
+static uint32_t ulp_sound_dac_reg_wr(uint32_t reg_wr_addr, uint8_t low_bit, uint8_t bits, uint32_t value)
+{
+	/* REG_WR - https://www.espressif.com/sites/default/files/documentation/esp32_technical_reference_manual_en.pdf#subsubsection.30.4.14 */
+	const uint32_t inst_reg_wr = 1 << 28; // Indicates a REG_WR instuction, should be put in REG_WR[31:28]
+
+	// RTCIO_PAD_DAC1_REG - https://www.espressif.com/sites/default/files/documentation/esp32_technical_reference_manual_en.pdf#Regfloat.4.49
+	// We are going to write to RTCIO_PAD_DACx_REG[26:19], aka dac value, same field in both pads, or one nibble of it
+	const uint32_t reg_wr_high_bit = (low_bit + bits - 1) << 23; // high bit, should be put in REG_WR[27:23]
+	const uint32_t reg_wr_low_bit = low_bit << 18;				 // low bit, should be put in REG_WR[22:18]
 
-		// Shift data into place as described in REG_WR[17:10], aka data to write
-		uint32_t reg_dac1_dac_value = i << 10;
+	// Shift data into place as described in REG_WR[17:10], aka data to write
+	uint32_t reg_dac_value = value << 10;
 
-		// Calculate the address of RTCIO_PAD_DAC1_REG
-		// 0x400 - RTC IO MUX Register Base
-		// 0x84  - RTCIO_PAD_DAC1_REG within RTC IO MUX Register Base
-		// div/4 as described in REG_WR[9:0], it uses 32bit addressing space instead of 8bit
-		const uint32_t reg_wr_addr = (0x400 + 0x84) / 4; // RTCIO_PAD_PDAC1_DAC addr
+	// reg_wr_addr as described in REG_WR[9:0], it uses 32bit addressing space instead of 8bit
+	return inst_reg_wr | reg_wr_high_bit | reg_wr_low_bit | reg_dac_value | reg_wr_addr;
+}
 
-		RTC_SLOW_MEM[ULPSOUND_DAC_MAP_START + i * 2] = inst_reg_wr | reg_wr_high_bit | reg_wr_low_bit | reg_dac1_dac_value | reg_wr_addr; // dac1 write i
-		// RTC_SLOW_MEM[ULPSOUND_DAC_MAP_START + i * 2] = 0x1D4C0121 | (i << 10);	// dac1 write i
+// [REG_WR code, JUMP return_reg] entries, each entry writes its index to DAC bits [low_bit + bits - 1:low_bit]
+static void ulp_sound_build_dac_table(uint32_t *mem, uint16_t start, uint32_t reg_wr_addr, uint8_t low_bit, uint8_t bits, bool inverted, uint8_t return_reg)
+{
+	const uint32_t max_code = (1 << bits) - 1;
+	for (uint32_t i = 0; i <= max_code; i++)
+	{
+		mem[start + i * 2] = ulp_sound_dac_reg_wr(reg_wr_addr, low_bit, bits, inverted ? max_code - i : i); // dac write i
+		// mem[start + i * 2] = 0x1D4C0121 | (i << 10);	// dac1 write i
 
 		/* JUMP - https://www.espressif.com/sites/default/files/documentation/esp32_technical_reference_manual_en.pdf#subsubsection.30.4.4 */
 		const uint32_t inst_jump = 8 << 28; // Indicates a REG_WR instuction
 
-		// Shift address into place as described in JUMP[12:2], aka jump to RTC_SLOW_MEM[13]
-		const uint32_t jump_imm_addr = 13 << 2;
+		// JUMP[21] selects the register form, JUMP[1:0] the register, aka jump to RTC_SLOW_MEM[return_reg]
+		const uint32_t jump_reg = (1 << 21) | return_reg;
+
+		mem[start + 1 + i * 2] = inst_jump | jump_reg; // return
+		// mem[start + 1 + i * 2] = 0x80200003; // return
+	}
+}
+
+/* - index tail -                                                *\
+ * Shared by all programs right after R0 moved to the next       *
+ * index, falls through to [join] with R0 wrapped. 44 cycles +   *
+ * delay_time on all four paths, checked by ulp_asm_timing():    *
+ * below watermark: 4 + 4 + (32 + delay_time) + 4                *
+ * at watermark:    4 + 4 + 4 + 6 (WAKE) + (22 + delay_time) + 4 *
+ * past watermark:  4 + 4 + 4 + (28 + delay_time) + 4            *
+ * wrap:            4 + 8 + 6 + 8 + 6 + 6 (WAKE) + (6 + delay)   *
+ * The wrap bumps the counter at ULPSOUND_WRAP_ADDR through R3,  *
+ * which holds the address of ret_label in all programs.         *
+ * JUMPR GE 0 is always taken, it keeps the tail relocatable.    *
+ * WAKE is replaced by a 6 cycle I_DELAY if wake is false. With  *
+ * sync the wrap also copies ULPSOUND_DPCM_SYNC_ADDR to the DPCM *
+\* value, 16 cycles more on every path.                          */
+static void ulp_sound_emit_wake(ulp_asm_t *a, bool wake)
+{
+	if (wake)
+		ulp_asm_wake(a);
+	else
+		ulp_asm_wait(a, 0);
+}
+
+static void ulp_sound_emit_index_tail(ulp_asm_t *a, uint16_t index_len, uint16_t wake_index, uint8_t step, bool wake, uint8_t ret_label, bool sync)
+{
+	const uint16_t sync_cycles = sync ? 16 : 0;
+	ulp_asm_label(a, ULPSOUND_LABEL_TAIL);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_TAIL_WRAP, index_len);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_TAIL_WATERMARK, wake_index);
+	/* label: below watermark */
+	ulp_asm_delay(a, 26 + sync_cycles);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_JOIN, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_TAIL_WATERMARK);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_TAIL_PAST, wake_index + step);
+	ulp_sound_emit_wake(a, wake);
+	ulp_asm_delay(a, 16 + sync_cycles);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_JOIN, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_TAIL_PAST);
+	ulp_asm_delay(a, 22 + sync_cycles);
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_JOIN, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_TAIL_WRAP);
+	ulp_asm_ld_rel(a, R0, R3, ret_label, ULPSOUND_WRAP_ADDR);
+	ulp_asm_addi(a, R0, R0, 1);
+	ulp_asm_st_rel(a, R0, R3, ret_label, ULPSOUND_WRAP_ADDR);
+	if (sync)
+	{
+		ulp_asm_ld_rel(a, R0, R3, ret_label, ULPSOUND_DPCM_SYNC_ADDR);
+		ulp_asm_st_rel(a, R0, R3, ret_label, ULPSOUND_DPCM_VALUE_ADDR);
+	}
+	ulp_asm_movi(a, R0, 0);
+	ulp_sound_emit_wake(a, wake);
+	ulp_asm_delay(a, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_JOIN);
+}
+
+// R0: holds sample index, R3: return address of the DAC table
+static void ulp_sound_emit_single(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	// reset sample index
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	// write the index back to RTC_SLOW_MEM[ULPSOUND_READ_ADDR]
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	// divide index by two since we store two samples in each dword, R2: holds sample word index
+	ulp_asm_rshi(a, R2, R0, 1);
+	// load the samples, R1: holds sample word
+	ulp_asm_ld(a, R1, R2, ULPSOUND_BUFF_START);
+	// shift by 8 if odd to have the right sample in the lower 8 bits
+	ulp_asm_andi(a, R2, R0, 1);
+	ulp_asm_lshi(a, R2, R2, 3);
+	ulp_asm_rshr(a, R1, R1, R2);
+	// mask the lower 8 bits, multiply by 2 and add the table start to address the dac table
+	ulp_asm_andi(a, R1, R1, 0xFF);
+	ulp_asm_lshi(a, R1, R1, 1);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_DAC_MAP_START);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	// increment the sample index, then wrap, wake and wait to get the right sample rate
+	ulp_asm_addi(a, R0, R0, 1);
+	ulp_sound_emit_index_tail(a, ULPSOUND_BUFF_LEN * 2, wake_index, 1, wake, ULPSOUND_LABEL_RET_LOW, false);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+}
+
+// R0: sample index, four per word, R3: return address of the DAC table, also the base of the RTC_SLOW_MEM
+// words the program keeps. The value is 2 x the sample and an even offset into the table, the step table
+// holds 2 x delta, the mask keeps a value that drifted after an underrun inside the table
+static void ulp_sound_emit_dpcm(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	// R1: the word, shifted by 4 x (index & 3) to get the nibble of this sample into the low bits
+	ulp_asm_rshi(a, R2, R0, 2);
+	ulp_asm_ld(a, R1, R2, ULPSOUND_BUFF_START);
+	ulp_asm_andi(a, R2, R0, 3);
+	ulp_asm_lshi(a, R2, R2, 2);
+	ulp_asm_rshr(a, R1, R1, R2);
+	ulp_asm_andi(a, R1, R1, 0x0F);
+	// R1: the value plus the step of the nibble, kept for the next sample
+	ulp_asm_ld(a, R1, R1, ULPSOUND_DPCM_STEP_START);
+	ulp_asm_ld_rel(a, R2, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_DPCM_VALUE_ADDR);
+	ulp_asm_alu_r(a, ULP_ASM_ALU_ADD, R1, R1, R2);
+	ulp_asm_andi(a, R1, R1, 0x1FE);
+	ulp_asm_st_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_DPCM_VALUE_ADDR);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_DAC_MAP_START);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_addi(a, R0, R0, 1);
+	ulp_sound_emit_index_tail(a, ULPSOUND_DPCM_BUFF_LEN * 4, wake_index, 1, wake, ULPSOUND_LABEL_RET_LOW, true);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+}
+
+// R2: free, R0: index past the tail, spends the idle cycles of the word on the dither jump
+// short or long delay slot by the pattern entry of the word, 34 (28 for a word index) + extra + delay_time cycles to LOOP
+static void ulp_sound_emit_dither(ulp_asm_t *a, uint8_t index_shift, uint16_t extra)
+{
+	if (index_shift)
+	{
+		ulp_asm_rshi(a, R2, R0, index_shift);
+		ulp_asm_andi(a, R2, R2, ULPSOUND_DITHER_LEN - 1);
+	}
+	else
+		ulp_asm_andi(a, R2, R0, ULPSOUND_DITHER_LEN - 1);
+	ulp_asm_ld(a, R2, R2, ULPSOUND_DITHER_START);
+	ulp_asm_dither(a, R2, ULPSOUND_LABEL_DITHER_SHORT, ULPSOUND_LABEL_DITHER_LONG);
+	ulp_asm_label(a, ULPSOUND_LABEL_DITHER_SHORT);
+	ulp_asm_delay_dither(a, extra, false);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_label(a, ULPSOUND_LABEL_DITHER_LONG);
+	ulp_asm_delay_dither(a, extra, true);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+}
+
+// R0 counts samples and only ever holds even values, the low byte is played before the tail and the
+// high byte after it, the dither jump after the high byte balances both halves of the word
+static void ulp_sound_emit_pair(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	// load both samples once, R1: holds sample word
+	ulp_asm_rshi(a, R2, R0, 1);
+	ulp_asm_ld(a, R1, R2, ULPSOUND_BUFF_START);
+	// R2: DAC table entry of the low byte
+	ulp_asm_andi(a, R2, R1, 0xFF);
+	ulp_asm_lshi(a, R2, R2, 1);
+	ulp_asm_addi(a, R2, R2, ULPSOUND_DAC_MAP_START);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_call(a, R2, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_addi(a, R0, R0, 2);
+	ulp_sound_emit_index_tail(a, ULPSOUND_BUFF_LEN * 2, wake_index, 2, wake, ULPSOUND_LABEL_RET_LOW, false);
+	// publish the next pair already, this word has been loaded
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	// R1: DAC table entry of the high byte
+	ulp_asm_rshi(a, R1, R1, 8);
+	ulp_asm_lshi(a, R1, R1, 1);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_DAC_MAP_START);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_HIGH);
+	ulp_sound_emit_dither(a, 1, 10);
+}
+
+// PAIR over one word per sample, R0 counts words: the code in the low byte, then the code plus the
+// fraction bit 8, which lands one table entry further, so the two DAC writes average to 9 bits
+static void ulp_sound_emit_oversampled(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_ld(a, R1, R0, ULPSOUND_BUFF_START);
+	// R2: DAC table entry of the code
+	ulp_asm_andi(a, R2, R1, 0xFF);
+	ulp_asm_lshi(a, R2, R2, 1);
+	ulp_asm_addi(a, R2, R2, ULPSOUND_DAC_MAP_START);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_call(a, R2, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_addi(a, R0, R0, 1);
+	ulp_sound_emit_index_tail(a, ULPSOUND_BUFF_LEN, wake_index, 1, wake, ULPSOUND_LABEL_RET_LOW, false);
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	// R1: the entry of the code, or of the code + 1 if bit 8 is set
+	ulp_asm_rshi(a, R1, R1, 7);
+	ulp_asm_andi(a, R1, R1, 2);
+	ulp_asm_alu_r(a, ULP_ASM_ALU_ADD, R1, R1, R2);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_HIGH);
+	ulp_sound_emit_dither(a, 0, 22);
+}
+
+// R0 counts frames, one word each, both channels are written back to back
+static void ulp_sound_emit_stereo(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	// load the frame, R1: left sample low byte, right sample high byte
+	ulp_asm_ld(a, R1, R0, ULPSOUND_BUFF_START);
+	// R2: DAC1 table entry of the left sample
+	ulp_asm_andi(a, R2, R1, 0xFF);
+	ulp_asm_lshi(a, R2, R2, 1);
+	ulp_asm_addi(a, R2, R2, ULPSOUND_DAC_MAP_START);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_call(a, R2, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	// R1: DAC2 table entry of the right sample
+	ulp_asm_rshi(a, R1, R1, 8);
+	ulp_asm_lshi(a, R1, R1, 1);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_DAC2_MAP_START);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_TABLE_CYCLES, 1);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_addi(a, R0, R0, 1);
+	ulp_sound_emit_index_tail(a, ULPSOUND_STEREO_BUFF_LEN, wake_index, 1, wake, ULPSOUND_LABEL_RET_HIGH, false);
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_READ_ADDR);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+}
+
+// R1, R2: nibble table entries of the byte in the low or high half of the word R2 points at
+static void ulp_sound_emit_nibble_entries(ulp_asm_t *a, bool high)
+{
+	ulp_asm_ld(a, R1, R2, ULPSOUND_BUFF_START);
+	if (high)
+		ulp_asm_rshi(a, R1, R1, 8);
+	ulp_asm_andi(a, R2, R1, 0x0F);
+	ulp_asm_lshi(a, R2, R2, 1);
+	ulp_asm_addi(a, R2, R2, ULPSOUND_NIBBLE_LOW_MAP_START);
+	// (R1 >> 4) * 2
+	ulp_asm_rshi(a, R1, R1, 3);
+	ulp_asm_andi(a, R1, R1, 0x1E);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_NIBBLE_HIGH_MAP_START);
+}
+
+// PAIR with both bytes split into nibbles, the word is loaded again for the high byte since
+// the four registers are taken by index, entries and return address
+static void ulp_sound_emit_compact(ulp_asm_t *a, uint16_t wake_index, bool wake)
+{
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_rshi(a, R2, R0, 1);
+	ulp_sound_emit_nibble_entries(a, false);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_LOW, ULPSOUND_NIBBLE_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_rshi(a, R2, R0, 1);
+	ulp_sound_emit_nibble_entries(a, true);
+	ulp_asm_addi(a, R0, R0, 2);
+	ulp_sound_emit_index_tail(a, ULPSOUND_NIBBLE_BUFF_LEN * 2, wake_index, 2, wake, ULPSOUND_LABEL_RET_LOW, false);
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_NIBBLE_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_HIGH);
+	ulp_sound_emit_dither(a, 1, 30);
+}
+
+// one-shot COMPACT without index tail: plays len samples, parks the DAC at midscale, shuts the amp
+// down through amp_shutdown_rtc_io (-1 for none), stops the ULP timer and halts
+static void ulp_sound_emit_chime(ulp_asm_t *a, uint16_t len, int8_t amp_shutdown_rtc_io)
+{
+	ulp_asm_movi(a, R0, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_rshi(a, R2, R0, 1);
+	ulp_sound_emit_nibble_entries(a, false);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_LOW, ULPSOUND_NIBBLE_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_rshi(a, R2, R0, 1);
+	ulp_sound_emit_nibble_entries(a, true);
+	ulp_asm_addi(a, R0, R0, 2);
+	ulp_asm_st_rel(a, R0, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_READ_ADDR);
+	ulp_asm_delay(a, 0);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_HIGH);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_HIGH, ULPSOUND_NIBBLE_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_HIGH);
+	// played the whole clip
+	ulp_asm_jump_ge(a, ULPSOUND_LABEL_END, len + (len & 1));
+	ulp_asm_delay(a, 12);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_label(a, ULPSOUND_LABEL_END);
+	// write 0x80 through the nibble tables
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_PARK);
+	ulp_asm_movi(a, R2, ULPSOUND_NIBBLE_LOW_MAP_START);
+	ulp_asm_movi(a, R1, ULPSOUND_NIBBLE_HIGH_MAP_START + 0x8 * 2);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_PARK, ULPSOUND_NIBBLE_TABLE_CYCLES, ULP_ASM_NO_SAMPLE);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_PARK);
+	if (amp_shutdown_rtc_io >= 0)
+		ulp_asm_emit(a, ((ulp_insn_t)I_WR_REG_BIT(RTC_GPIO_OUT_W1TS_REG, RTC_GPIO_OUT_DATA_W1TS_S + amp_shutdown_rtc_io, 1)).instruction);
+	else
+		ulp_asm_wait(a, 0);
+	// keep the ULP timer from starting the clip again
+	ulp_asm_emit(a, ((ulp_insn_t)I_END()).instruction);
+	ulp_asm_halt(a);
+}
+
+// R0 counts down the samples of the segment, phase, step, wave level and the next segment are kept in
+// RTC_SLOW_MEM through R3. A segment of 0 samples ends the list: parks the DAC at midscale, shuts the amp
+// down through amp_shutdown_rtc_io (-1 for none), stops the ULP timer and halts
+static void ulp_sound_emit_tone(ulp_asm_t *a, int8_t amp_shutdown_rtc_io)
+{
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_movi(a, R1, 0);
+	ulp_asm_st_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_PHASE_ADDR);
+	ulp_asm_movi(a, R1, ULPSOUND_TONE_SEGMENT_START);
+	ulp_asm_st_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_NEXT_ADDR);
+	ulp_asm_jump(a, ULPSOUND_LABEL_SEGMENT);
+	ulp_asm_label(a, ULPSOUND_LABEL_LOOP);
+	// R1: phase + step, its top 5 bits pick the entry in the wave of the segment level
+	ulp_asm_ld_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_PHASE_ADDR);
+	ulp_asm_ld_rel(a, R2, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_STEP_ADDR);
+	ulp_asm_alu_r(a, ULP_ASM_ALU_ADD, R1, R1, R2);
+	ulp_asm_st_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_PHASE_ADDR);
+	ulp_asm_rshi(a, R1, R1, 11);
+	ulp_asm_ld_rel(a, R2, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_WAVE_ADDR);
+	ulp_asm_alu_r(a, ULP_ASM_ALU_ADD, R1, R1, R2);
+	// the wave holds DAC table entries
+	ulp_asm_ld(a, R1, R1, 0);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TABLE_CYCLES, 0);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_LOW);
+	ulp_asm_alu_i(a, ULP_ASM_ALU_SUB, R0, R0, 1);
+	ulp_asm_jump_lt(a, ULPSOUND_LABEL_SEGMENT, 1);
+	ulp_asm_delay(a, 66);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+	// R1: the next segment, R0: its samples
+	ulp_asm_label(a, ULPSOUND_LABEL_SEGMENT);
+	ulp_asm_ld_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_NEXT_ADDR);
+	ulp_asm_ld(a, R2, R1, 0);
+	ulp_asm_st_rel(a, R2, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_STEP_ADDR);
+	ulp_asm_ld(a, R2, R1, 1);
+	ulp_asm_st_rel(a, R2, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_WAVE_ADDR);
+	ulp_asm_ld(a, R0, R1, 2);
+	ulp_asm_addi(a, R1, R1, ULPSOUND_TONE_SEGMENT_WORDS);
+	ulp_asm_st_rel(a, R1, R3, ULPSOUND_LABEL_RET_LOW, ULPSOUND_TONE_NEXT_ADDR);
+	ulp_asm_jump_lt(a, ULPSOUND_LABEL_END, 1);
+	ulp_asm_delay(a, 0);
+	ulp_asm_jump(a, ULPSOUND_LABEL_LOOP);
+	ulp_asm_label(a, ULPSOUND_LABEL_END);
+	ulp_asm_movi_label(a, R3, ULPSOUND_LABEL_RET_PARK);
+	ulp_asm_movi(a, R1, ULPSOUND_DAC_MAP_START + 0x80 * 2);
+	ulp_asm_call(a, R1, ULPSOUND_LABEL_RET_PARK, ULPSOUND_TABLE_CYCLES, ULP_ASM_NO_SAMPLE);
+	ulp_asm_label(a, ULPSOUND_LABEL_RET_PARK);
+	if (amp_shutdown_rtc_io >= 0)
+		ulp_asm_emit(a, ((ulp_insn_t)I_WR_REG_BIT(RTC_GPIO_OUT_W1TS_REG, RTC_GPIO_OUT_DATA_W1TS_S + amp_shutdown_rtc_io, 1)).instruction);
+	else
+		ulp_asm_wait(a, 0);
+	ulp_asm_emit(a, ((ulp_insn_t)I_END()).instruction);
+	ulp_asm_halt(a);
+}
+
+// assembles the program into mem[ULPSOUND_PROG_START..ULPSOUND_PROG_STOP], delay slots hold their extra only
+static ulp_asm_err_t ulp_sound_assemble(ulp_asm_t *a, uint32_t *mem, ulp_sound_program_t program, uint16_t wake_watermark, uint16_t chime_len, int8_t amp_shutdown_rtc_io)
+{
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[program];
+	// index of the first sample of the watermark word
+	const uint16_t wake_index = wake_watermark << info->index_shift;
+	const bool wake = (wake_watermark != 0);
+
+	ulp_asm_init(a, mem, ULPSOUND_PROG_START, ULPSOUND_PROG_STOP);
+	if (program == ULPSOUND_PROGRAM_SINGLE)
+		ulp_sound_emit_single(a, wake_index, wake);
+	else if (program == ULPSOUND_PROGRAM_PAIR)
+		ulp_sound_emit_pair(a, wake_index, wake);
+	else if (info->dac2)
+		ulp_sound_emit_stereo(a, wake_index, wake);
+	else if (program == ULPSOUND_PROGRAM_CHIME)
+		ulp_sound_emit_chime(a, chime_len, amp_shutdown_rtc_io);
+	else if (program == ULPSOUND_PROGRAM_OVERSAMPLED)
+		ulp_sound_emit_oversampled(a, wake_index, wake);
+	else if (info->dpcm)
+		ulp_sound_emit_dpcm(a, wake_index, wake);
+	else if (program == ULPSOUND_PROGRAM_TONE)
+		ulp_sound_emit_tone(a, amp_shutdown_rtc_io);
+	else
+		ulp_sound_emit_compact(a, wake_index, wake);
+	return ulp_asm_finish(a);
+}
+
+/* - program layout -                                            *\
+ * Cycles per sample and delay slots of each program, taken from *
+ * a build into a scratch image the first time they are needed. *
+ * Every path from one DAC write to the next has to pass exactly *
+\* one delay slot and take the same cycles.                      */
+typedef struct
+{
+	bool valid;
+	bool dither;
+	uint16_t clockcycle;
+	uint16_t loop_addr; // top of the loop, between two words
+	uint8_t delay_count;
+	ulp_asm_delay_t delay[ULP_ASM_MAX_DELAYS];
+	uint16_t dither_short_addr;
+	uint16_t dither_long_addr;
+	bool tail;				  // has the index tail, the watermark slot can be moved
+	uint16_t watermark_addr;  // JUMPR to the watermark path, threshold at the first index of the watermark word
+	uint16_t past_addr;		  // JUMPR past it, threshold one index step further
+	uint16_t wake_addr;		  // WAKE, the delay slot and the jump back follow
+	uint8_t watermark_step;	  // index step of the program
+} ulp_sound_layout_t;
+
+static ulp_sound_layout_t ulp_sound_layouts[sizeof(ulp_sound_programs) / sizeof(ulp_sound_program_info_t)];
+
+static const ulp_sound_layout_t *ulp_sound_get_layout(ulp_sound_program_t program)
+{
+	ulp_sound_layout_t *layout = &ulp_sound_layouts[program];
+	if (layout->valid)
+		return layout;
+
+	uint32_t scratch[ULPSOUND_PROG_STOP + 1];
+	ulp_asm_t a;
+	ulp_asm_timing_t timing;
+	ulp_asm_err_t err = ulp_sound_assemble(&a, scratch, program, 1, 2, -1);
+	if (err == ULP_ASM_OK)
+		err = ulp_asm_timing(&a, &timing);
+	if (err != ULP_ASM_OK)
+		ESP_LOGE(TAG, "Program %d does not assemble, error %d", program, err);
+	else if ((timing.min_cycles != timing.max_cycles) || (timing.min_delays != 1) || (timing.max_delays != 1))
+		ESP_LOGE(TAG, "Program %d is unbalanced, %lu..%lu cycles, %u..%u delay slots", program, timing.min_cycles, timing.max_cycles, timing.min_delays, timing.max_delays);
+	else
+		ESP_LOGD(TAG, "Program %d: %u words, %u paths, %lu cycles", program, timing.words, timing.paths, timing.max_cycles);
+
+	if ((a.dither_count > 0) != (ulp_sound_programs[program].dither_samples > 0))
+		ESP_LOGE(TAG, "Program %d has %u dither jumps", program, a.dither_count);
+
+	layout->clockcycle = timing.max_cycles;
+	layout->loop_addr = ulp_asm_label_addr(&a, ULPSOUND_LABEL_LOOP);
+	layout->delay_count = a.delay_count;
+	memcpy(layout->delay, a.delay, sizeof(layout->delay));
+	layout->dither = (a.dither_count > 0) && (ulp_sound_programs[program].dither_samples > 0);
+	layout->dither_short_addr = ulp_asm_label_addr(&a, ULPSOUND_LABEL_DITHER_SHORT);
+	layout->dither_long_addr = ulp_asm_label_addr(&a, ULPSOUND_LABEL_DITHER_LONG);
+	layout->tail = (err == ULP_ASM_OK) && (ulp_asm_label_addr(&a, ULPSOUND_LABEL_TAIL) <= ULPSOUND_PROG_STOP);
+	if (layout->tail)
+	{
+		layout->watermark_addr = ulp_asm_label_addr(&a, ULPSOUND_LABEL_TAIL) + 1;
+		layout->past_addr = ulp_asm_label_addr(&a, ULPSOUND_LABEL_TAIL_WATERMARK);
+		layout->wake_addr = layout->past_addr + 1;
+		layout->watermark_step = (scratch[layout->past_addr] & 0xFFFF) - (scratch[layout->watermark_addr] & 0xFFFF);
+	}
+	layout->valid = true;
+	return layout;
+}
 
-		RTC_SLOW_MEM[ULPSOUND_DAC_MAP_START + 1 + i * 2] = inst_jump | jump_imm_addr; // return
-																					  // RTC_SLOW_MEM[ULPSOUND_DAC_MAP_START + 1 + i * 2] = 0x80000000 + 13 * 4; // return
+uint16_t ulp_sound_program_cycles(ulp_sound_program_t program)
+{
+	return ulp_sound_get_layout(program)->clockcycle;
+}
+
+// writes the program and DAC opcode tables into a RTC_SLOW_MEM image, which can also be an emulator memory
+// wake_watermark: FIFO word at which the ULP wakes the CPU, besides the wrap, 0 never wakes it
+void ulp_sound_build_program(uint32_t *mem, ulp_sound_program_t program, uint32_t delay_time, uint16_t wake_watermark)
+{
+	if (program == ULPSOUND_PROGRAM_CHIME)
+	{
+		ulp_sound_build_chime(mem, delay_time, ULPSOUND_NIBBLE_BUFF_LEN * 2, -1);
+		return;
+	}
+	if (program == ULPSOUND_PROGRAM_TONE)
+	{
+		ulp_sound_build_tone(mem, delay_time, NULL, -1);
+		return;
+	}
+
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[program];
+	ulp_asm_t a;
+	ulp_asm_err_t err = ulp_sound_assemble(&a, mem, program, wake_watermark, 0, -1);
+	if (err != ULP_ASM_OK)
+	{
+		ESP_LOGE(TAG, "Program %d does not assemble, error %d", program, err);
+		return;
+	}
+	ulp_sound_write_delay(mem, program, delay_time, 0);
+
+	// create DAC opcode tables
+	if (info->nibble)
+	{
+		// the high nibble continues at the low nibble entry held in R2
+		ulp_sound_build_dac_table(mem, ULPSOUND_NIBBLE_HIGH_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 23, 4, false, R2);
+		ulp_sound_build_dac_table(mem, ULPSOUND_NIBBLE_LOW_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 19, 4, false, R3);
+	}
+	else
+		ulp_sound_build_dac_table(mem, ULPSOUND_DAC_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 19, 8, false, R3);
+	if (info->dac2)
+		ulp_sound_build_dac_table(mem, ULPSOUND_DAC2_MAP_START, ULPSOUND_DAC2_REG_WR_ADDR, 19, 8, info->dac2_inverted, R3);
+	if (info->dpcm)
+	{
+		for (uint32_t i = 0; i < ULPSOUND_DPCM_STEP_LEN; i++)
+			mem[ULPSOUND_DPCM_STEP_START + i] = (uint16_t)(ulp_sound_dpcm_steps[i] * 2);
+		// starts from midscale, like the writer
+		mem[ULPSOUND_DPCM_VALUE_ADDR] = 0x80 * 2;
+		mem[ULPSOUND_DPCM_SYNC_ADDR] = 0x80 * 2;
 	}
 	// ESP_LOGI(TAG, "Opcode created");
+}
 
-	// initialize audio buffer
-	dac_output_voltage(DAC_CHAN_0, 0x80);
+void ulp_sound_build_chime(uint32_t *mem, uint32_t delay_time, uint16_t len, int8_t amp_shutdown_rtc_io)
+{
+	ulp_asm_t a;
+	ulp_asm_err_t err = ulp_sound_assemble(&a, mem, ULPSOUND_PROGRAM_CHIME, 0, len, amp_shutdown_rtc_io);
+	if (err != ULP_ASM_OK)
+	{
+		ESP_LOGE(TAG, "Chime does not assemble, error %d", err);
+		return;
+	}
+	ulp_sound_write_delay(mem, ULPSOUND_PROGRAM_CHIME, delay_time, 0);
+
+	ulp_sound_build_dac_table(mem, ULPSOUND_NIBBLE_HIGH_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 23, 4, false, R2);
+	ulp_sound_build_dac_table(mem, ULPSOUND_NIBBLE_LOW_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 19, 4, false, R3);
+}
+
+void ulp_sound_build_tone(uint32_t *mem, uint32_t delay_time, const int8_t *wave, int8_t amp_shutdown_rtc_io)
+{
+	ulp_asm_t a;
+	ulp_asm_err_t err = ulp_sound_assemble(&a, mem, ULPSOUND_PROGRAM_TONE, 0, 0, amp_shutdown_rtc_io);
+	if (err != ULP_ASM_OK)
+	{
+		ESP_LOGE(TAG, "Tone does not assemble, error %d", err);
+		return;
+	}
+	ulp_sound_write_delay(mem, ULPSOUND_PROGRAM_TONE, delay_time, 0);
+	ulp_sound_build_dac_table(mem, ULPSOUND_DAC_MAP_START, ULPSOUND_DAC1_REG_WR_ADDR, 19, 8, false, R3);
+
+	// level 0 is silence, each level above is 3 dB louder than the one below, up to the wave as given
+	for (uint32_t level = 0; level < ULPSOUND_TONE_LEVELS; level++)
+	{
+		float gain = (level == 0) ? 0.0f : powf(10.0f, -3.0f * (ULPSOUND_TONE_LEVELS - 1 - level) / 20.0f);
+		for (uint32_t i = 0; i < ULPSOUND_TONE_WAVE_LEN; i++)
+		{
+			float sample = (wave == NULL) ? 127.0f * sinf(2.0f * (float)M_PI * i / ULPSOUND_TONE_WAVE_LEN) : wave[i];
+			int32_t code = 128 + (int32_t)lroundf(sample * gain);
+			code = (code < 0) ? 0 : ((code > 255) ? 255 : code);
+			mem[ULPSOUND_TONE_WAVE_START + level * ULPSOUND_TONE_WAVE_LEN + i] = ULPSOUND_DAC_MAP_START + code * 2;
+		}
+	}
+	mem[ULPSOUND_TONE_SEGMENT_START + 2] = 0;
+}
+
+uint16_t ulp_sound_tone_step(float freq_hz, uint32_t sampling_rate)
+{
+	if ((sampling_rate == 0) || (freq_hz <= 0.0f) || (freq_hz * 2.0f >= sampling_rate))
+		return 0;
+	return (uint16_t)lroundf(freq_hz * 65536.0f / sampling_rate);
+}
+
+float ulp_sound_tone_frequency(uint16_t step, uint32_t sampling_rate)
+{
+	return (float)step * sampling_rate / 65536.0f;
+}
+
+// appends a segment of samples at level, split where it exceeds the 16 bit count, false if the list is full
+static bool ulp_sound_tone_put(uint32_t *mem, size_t *n, uint16_t step, uint8_t level, uint32_t samples)
+{
+	while (samples > 0)
+	{
+		if (*n == ULPSOUND_TONE_SEGMENTS)
+			return false;
+		uint32_t count = (samples > UINT16_MAX) ? UINT16_MAX : samples;
+		uint32_t *segment = mem + ULPSOUND_TONE_SEGMENT_START + *n * ULPSOUND_TONE_SEGMENT_WORDS;
+		segment[0] = (level == 0) ? 0 : step;
+		segment[1] = ULPSOUND_TONE_WAVE_START + level * ULPSOUND_TONE_WAVE_LEN;
+		segment[2] = count;
+		samples -= count;
+		(*n)++;
+	}
+	return true;
+}
+
+// samples [start, end) of the tone at level, a sweep in pieces of ULPSOUND_TONE_SWEEP_MS at the
+// frequency of their middle
+static bool ulp_sound_tone_range(uint32_t *mem, size_t *n, const ulp_sound_tone_t *tone, uint32_t len, uint32_t start, uint32_t end, uint8_t level, uint32_t sampling_rate)
+{
+	const bool sweep = (tone->freq_end_hz != tone->freq_start_hz) && (level > 0);
+	const uint32_t piece = sweep ? (uint64_t)ULPSOUND_TONE_SWEEP_MS * sampling_rate / 1000 : end - start;
+	while (start < end)
+	{
+		uint32_t stop = ((piece == 0) || (end - start <= piece)) ? end : start + piece;
+		float freq = tone->freq_start_hz + (tone->freq_end_hz - tone->freq_start_hz) * (start + stop) / 2.0f / len;
+		if (!ulp_sound_tone_put(mem, n, ulp_sound_tone_step(freq, sampling_rate), level, stop - start))
+			return false;
+		start = stop;
+	}
+	return true;
+}
+
+// segment bounds are counted from the start of each tone, rounding does not add up over its steps.
+// The attack climbs from level 1, the release steps down to silence
+size_t ulp_sound_tone_segments(uint32_t *mem, const ulp_sound_tone_t *tones, size_t count, uint32_t sampling_rate)
+{
+	size_t n = 0;
+	for (size_t t = 0; t < count; t++)
+	{
+		const ulp_sound_tone_t *tone = &tones[t];
+		const uint32_t len = (uint64_t)tone->duration_ms * sampling_rate / 1000;
+		const uint8_t level = (tone->freq_start_hz <= 0.0f) ? 0 : ((tone->level >= ULPSOUND_TONE_LEVELS) ? ULPSOUND_TONE_LEVELS - 1 : tone->level);
+		uint32_t attack = (level == 0) ? 0 : (uint64_t)tone->attack_ms * sampling_rate / 1000;
+		uint32_t release = (level == 0) ? 0 : (uint64_t)tone->release_ms * sampling_rate / 1000;
+		if (attack > len)
+			attack = len;
+		if (release > len - attack)
+			release = len - attack;
+		const uint32_t sustain_end = len - release;
+
+		bool fits = true;
+		for (uint8_t i = 0; (i < level) && (attack > 0) && fits; i++)
+			fits = ulp_sound_tone_range(mem, &n, tone, len, attack * i / level, attack * (i + 1) / level, i + 1, sampling_rate);
+		if (fits)
+			fits = ulp_sound_tone_range(mem, &n, tone, len, attack, sustain_end, level, sampling_rate);
+		for (uint8_t i = 0; (i < level) && (release > 0) && fits; i++)
+			fits = ulp_sound_tone_range(mem, &n, tone, len, sustain_end + release * i / level, sustain_end + release * (i + 1) / level, level - 1 - i, sampling_rate);
+		if (!fits)
+			return 0;
+	}
+	// terminating segment
+	mem[ULPSOUND_TONE_SEGMENT_START + n * ULPSOUND_TONE_SEGMENT_WORDS + 2] = 0;
+	return n;
+}
+
+// long dither pattern entries for delay_frac in 1/65536 entries, and the delay of the dither slots
+// the fraction of a word that does not fit the pattern is a whole cycle more on both of them
+static uint32_t ulp_sound_dither_split(const ulp_sound_layout_t *layout, ulp_sound_program_t program, uint32_t delay_time, uint16_t delay_frac, uint32_t *dither_time)
+{
+	if (!layout->dither)
+	{
+		*dither_time = delay_time + (delay_frac >= 0x8000);
+		return 0;
+	}
+	uint32_t word_frac = (uint32_t)delay_frac * ulp_sound_programs[program].dither_samples;
+	*dither_time = delay_time + (word_frac >> 16);
+	return (word_frac & 0xFFFF) * ULPSOUND_DITHER_LEN;
+}
+
+// rounds, or error diffuses across calls when error is given
+static uint16_t ulp_sound_dither_count(uint32_t count_q16, uint16_t *error)
+{
+	if (error == NULL)
+		return (count_q16 + 0x8000) >> 16;
+	count_q16 += *error;
+	*error = count_q16 & 0xFFFF;
+	return count_q16 >> 16;
+}
+
+static uint16_t ulp_sound_write_delay_diffused(uint32_t *mem, ulp_sound_program_t program, uint32_t delay_time, uint16_t delay_frac, uint16_t *error)
+{
+	const ulp_sound_layout_t *layout = ulp_sound_get_layout(program);
+	uint32_t dither_time;
+	uint16_t count = ulp_sound_dither_count(ulp_sound_dither_split(layout, program, delay_time, delay_frac, &dither_time), error);
+	ulp_asm_write_delay(mem, layout->delay, layout->delay_count, layout->dither ? delay_time : dither_time, dither_time);
+	if (layout->dither)
+		ulp_asm_write_dither(mem, ULPSOUND_DITHER_START, ULPSOUND_DITHER_LEN, layout->dither_short_addr, layout->dither_long_addr, count);
+	return count;
+}
+
+// single word writes, the ULP fetches either the old or the new delay, and the old or the new pattern entry
+void ulp_sound_write_delay(uint32_t *mem, ulp_sound_program_t program, uint32_t delay_time, uint16_t delay_frac)
+{
+	ulp_sound_write_delay_diffused(mem, program, delay_time, delay_frac, NULL);
+}
+
+// rewrites the REG_WR words of the 256 entry tables with code curve[i] for sample i, NULL for identity.
+// Every entry is a single word write, a running ULP can play a word or frame through a mix of both curves,
+// ulp_sound_set_curve() parks it for the rewrite. Returns false for the nibble programs, a byte cannot be
+// mapped through two nibble tables and the CPU has to apply it
+bool ulp_sound_write_curve(uint32_t *mem, ulp_sound_program_t program, const uint8_t *curve)
+{
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[program];
+	if (info->nibble)
+		return false;
+
+	for (uint32_t i = 0; i < 256; i++)
+	{
+		uint8_t code = (curve == NULL) ? i : curve[i];
+		mem[ULPSOUND_DAC_MAP_START + i * 2] = ulp_sound_dac_reg_wr(ULPSOUND_DAC1_REG_WR_ADDR, 19, 8, code);
+		if (info->dac2)
+			mem[ULPSOUND_DAC2_MAP_START + i * 2] = ulp_sound_dac_reg_wr(ULPSOUND_DAC2_REG_WR_ADDR, 19, 8, info->dac2_inverted ? 255 - code : code);
+	}
+	return true;
+}
+
+// gain around midscale, clipped to the DAC range
+void ulp_sound_curve_gain(uint8_t *curve, float gain)
+{
+	for (int32_t i = 0; i < 256; i++)
+	{
+		int32_t code = 128 + (int32_t)lroundf((i - 128) * gain);
+		curve[i] = (code < 0) ? 0 : ((code > 255) ? 255 : code);
+	}
+}
+
+// running: the ULP plays from the tables, else they are rewritten in place
+static void ulp_sound_load_curve(ulp_sound_t *ulp, const uint8_t *curve, bool running)
+{
+	ulp->curve_enabled = (curve != NULL);
+	if ((curve != NULL) && (curve != ulp->curve))
+		memcpy(ulp->curve, curve, sizeof(ulp->curve));
+	if (ulp_sound_programs[ulp->program].nibble)
+	{
+		ulp->cpu_curve = ulp->curve_enabled;
+		return;
+	}
+
+	// RTC_SLOW_MEM has no room for a second table to switch to. A jump to itself at the top of the loop parks
+	// the ULP once the word or frame it plays is through, two word times cover one that just started
+	const uint16_t loop_addr = ulp_sound_get_layout(ulp->program)->loop_addr;
+	const uint32_t loop_insn = RTC_SLOW_MEM[loop_addr];
+	// the parked index would count as a slow clock, the recal window starts over after the park
+	bool recal = running && ulp->recal_running;
+	if (recal)
+		ulp_sound_recal_stop(ulp);
+	if (running)
+	{
+		RTC_SLOW_MEM[loop_addr] = ((ulp_insn_t)I_BXI(loop_addr)).instruction;
+		esp_rom_delay_us(ulp_sound_samples_to_us(ulp, 2 << ulp->index_shift) + 1);
+	}
+	ulp_sound_write_curve(RTC_SLOW_MEM, ulp->program, curve);
+	RTC_SLOW_MEM[loop_addr] = loop_insn;
+	ulp->cpu_curve = false;
+	if (recal)
+		ulp_sound_recal_start(ulp);
+}
+
+// switches between two words or frames, the DAC holds its code for the park and the table rewrite. The
+// nibble programs map the next written samples instead
+void ulp_sound_set_curve(ulp_sound_t *ulp, const uint8_t *curve)
+{
+	ulp_sound_load_curve(ulp, curve, true);
+}
+
+// raised cosine from one value to another, step i of n, ends on to
+static uint8_t ulp_sound_ramp(uint8_t from, uint8_t to, uint32_t i, uint32_t n)
+{
+	float t = (1.0f - cosf((float)M_PI * (i + 1) / n)) / 2.0f;
+	return (uint8_t)lroundf(from + ((float)to - from) * t);
+}
+
+// both bytes of the word ramp on their own, a fraction bit as well
+static uint16_t ulp_sound_ramp_word(uint16_t from, uint16_t to, uint32_t i, uint32_t n)
+{
+	return ulp_sound_ramp(from & 0xFF, to & 0xFF, i, n) | ulp_sound_ramp(from >> 8, to >> 8, i, n) << 8;
+}
+
+// FIFO word that holds every DAC of the program at midscale
+static uint16_t ulp_sound_silence_word(const ulp_sound_program_info_t *info)
+{
+	return (info->fraction_bits > 0) ? 0x0080 : 0x8080;
+}
+
+// FIFO word that holds every DAC of the program at code 0
+static uint16_t ulp_sound_floor_word(const ulp_sound_program_info_t *info)
+{
+	return info->dac2_inverted ? 0xFF00 : 0x0000;
+}
+
+// the lap the ULP plays first: ramp_words from code 0 up to midscale, then silence
+static void ulp_sound_prefill(ulp_sound_t *ulp)
+{
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[ulp->program];
+	if (!info->dpcm)
+	{
+		const uint16_t silence = ulp_sound_silence_word(info);
+		const uint16_t floor = ulp_sound_floor_word(info);
+		for (uint16_t i = 0; i < ulp->buff_len; i++)
+			RTC_SLOW_MEM[ULPSOUND_BUFF_START + i] = (i < ulp->ramp_words) ? ulp_sound_ramp_word(floor, silence, i, ulp->ramp_words) : silence;
+		return;
+	}
+
+	// encoded like the writer does, silence is a run of zero steps from midscale
+	const uint32_t ramp_samples = (uint32_t)ulp->ramp_words * 4;
+	uint8_t value = (ramp_samples > 0) ? 0 : 0x80;
+	RTC_SLOW_MEM[ULPSOUND_DPCM_VALUE_ADDR] = value * 2;
+	for (uint16_t i = 0; i < ulp->buff_len; i++)
+	{
+		uint16_t word = 0;
+		for (uint32_t n = 0; n < 4; n++)
+		{
+			uint32_t sample = i * 4 + n;
+			uint8_t nibble = ulp_sound_dpcm_nibble(value, (sample < ramp_samples) ? ulp_sound_ramp(0, 0x80, sample, ramp_samples) : 0x80);
+			value += ulp_sound_dpcm_steps[nibble];
+			word |= nibble << (n * 4);
+		}
+		RTC_SLOW_MEM[ULPSOUND_BUFF_START + i] = word;
+	}
+	RTC_SLOW_MEM[ULPSOUND_DPCM_SYNC_ADDR] = value * 2;
+	ulp->dpcm_value = value;
+	ulp->dpcm_base = value;
+}
+
+// from the CPU, the ULP drives the same pad through the same set and clear registers
+static void ulp_sound_amp_enable(ulp_sound_t *ulp, bool enable)
+{
+	if (ulp->amp_shutdown_rtc_io < 0)
+		return;
+	if (enable)
+		REG_WRITE(RTC_GPIO_OUT_W1TC_REG, 1 << (RTC_GPIO_OUT_DATA_W1TC_S + ulp->amp_shutdown_rtc_io));
+	else
+		REG_WRITE(RTC_GPIO_OUT_W1TS_REG, 1 << (RTC_GPIO_OUT_DATA_W1TS_S + ulp->amp_shutdown_rtc_io));
+}
+
+// REG_WR that shuts the amp down, a 6 cycle I_DELAY without one
+static uint32_t ulp_sound_amp_shutdown_insn(int8_t amp_shutdown_rtc_io)
+{
+	if (amp_shutdown_rtc_io < 0)
+		return ((ulp_insn_t)I_DELAY(0)).instruction;
+	return ((ulp_insn_t)I_WR_REG_BIT(RTC_GPIO_OUT_W1TS_REG, RTC_GPIO_OUT_DATA_W1TS_S + amp_shutdown_rtc_io, 1)).instruction;
+}
+
+// the JUMPR thresholds around the watermark path to the first index of word. The ULP only takes the path at
+// that word, which the callers keep at least a word ahead of it
+static void ulp_sound_move_watermark(ulp_sound_t *ulp, uint16_t word)
+{
+	const ulp_sound_layout_t *layout = ulp_sound_get_layout(ulp->program);
+	const uint16_t index = word << ulp->index_shift;
+	RTC_SLOW_MEM[layout->watermark_addr] = (RTC_SLOW_MEM[layout->watermark_addr] & ~0xFFFF) | index;
+	RTC_SLOW_MEM[layout->past_addr] = (RTC_SLOW_MEM[layout->past_addr] & ~0xFFFF) | (uint16_t)(index + layout->watermark_step);
+}
+
+// back to WAKE at the wake watermark, the instruction first, so the old position only sees a spare WAKE
+static void ulp_sound_restore_watermark(ulp_sound_t *ulp)
+{
+	RTC_SLOW_MEM[ulp_sound_get_layout(ulp->program)->wake_addr] = ulp->watermark_insn;
+	ulp_sound_move_watermark(ulp, ulp->wake_watermark);
+}
+
+void ulp_sound_init(ulp_sound_t *ulp, uint32_t target_sampling_rate)
+{
+	const ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(target_sampling_rate);
+	ulp_sound_init_with_config(ulp, &config);
+}
+
+// derives the delay that gets the program to the target rate at the given RTC fast clock
+static void ulp_sound_derive_delay(ulp_sound_t *ulp, ulp_sound_program_t program, uint32_t rtc_fast_freq_hz, uint32_t target_sampling_rate)
+{
+	const uint16_t clockcycle = ulp_sound_program_cycles(program);
+	// the clock loop runs on DAC writes, the rates reported are index steps
+	const uint8_t oversampling = ulp_sound_oversampling(program);
+	const uint32_t dac_rate = target_sampling_rate * oversampling;
+	ESP_LOGI(TAG, "Maximum sampling rate at current RTC clock: %luHz", rtc_fast_freq_hz / clockcycle / oversampling);
+	// delay in 1/65536 cycles
+	int64_t dt_tmp = (dac_rate == 0) ? -1 : (((uint64_t)rtc_fast_freq_hz << 16) / dac_rate) - ((uint64_t)clockcycle << 16);
+	uint64_t delay_q16 = 0;
+	if (dt_tmp < 0)
+		ESP_LOGW(TAG, "Sampling rate has been set to %luHz", rtc_fast_freq_hz / clockcycle / oversampling);
+	else
+		delay_q16 = dt_tmp;
+	if (delay_q16 > ((uint64_t)ULP_CLOCK_DELAY_MAX << 16))
+	{
+		ESP_LOGW(TAG, "Sampling rate too low, delay clamped");
+		delay_q16 = (uint64_t)ULP_CLOCK_DELAY_MAX << 16;
+	}
+	const bool fractional = ulp_sound_get_layout(program)->dither;
+	if (!fractional)
+		delay_q16 = (delay_q16 + 0x8000) & ~0xFFFFULL;
+	ulp->target_sampling_rate = target_sampling_rate;
+	ulp->rtc_fast_freq_hz = rtc_fast_freq_hz;
+	ulp->delay_time = delay_q16 >> 16;
+	ulp->delay_frac = delay_q16 & 0xFFFF;
+	ulp->dither_error = 0;
+	ESP_LOGI(TAG, "Delay time: %lu + %u/65536", ulp->delay_time, ulp->delay_frac);
+	ulp_clock_init(&ulp->clock, rtc_fast_freq_hz, (dt_tmp < 0) ? 0 : dac_rate, clockcycle, ulp->delay_time, ulp->delay_frac, fractional);
+	ulp->sampling_rate = ulp_clock_get_rate(&ulp->clock) / oversampling;
+	ESP_LOGI(TAG, "Sampling rate current: %luHz", ulp->sampling_rate);
+}
+
+// measures the RTC fast clock and derives the delay that gets the program to the target rate
+static uint32_t ulp_sound_setup_clock(ulp_sound_t *ulp, ulp_sound_program_t program, uint32_t target_sampling_rate)
+{
+	rtc_clk_8m_enable(1, 1); // enable the 8 MHz RTC clock with /256 divider
+	ESP_LOGI(TAG, "Sampling rate target: %luHz", target_sampling_rate);
+	while ((!rtc_clk_8m_enabled()) || (!rtc_clk_8md256_enabled()))
+		ulp_sound_lightsleep_delay(1000);
+	uint32_t rtc_fast_freq_hz = 1000000.0 * (double)(1 << RTC_CLK_CAL_FRACT) * 256.0 / (double)rtc_clk_cal(RTC_CAL_8MD256, 1000);
+	rtc_clk_8m_enable(1, 0); // disable the /256 divider
+	ESP_LOGI(TAG, "RTC freq: %luHz", rtc_fast_freq_hz);
+	ulp_sound_derive_delay(ulp, program, rtc_fast_freq_hz, target_sampling_rate);
+	return ulp->delay_time;
+}
+
+void ulp_sound_init_with_config(ulp_sound_t *ulp, const ulp_sound_config_t *config)
+{
+	ulp_sound_recal_stop(ulp); // do not patch a program that is being replaced
+
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[config->program];
+	ulp->program = config->program;
+	ulp->buff_len = info->buff_len;
+	ulp->index_shift = info->index_shift;
+	ulp->last_filled_word = 0;
+	ulp->read_wraps = 0;
+	ulp->read_laps = 0;
+	ulp->read_pos = 0;
+	ulp->write_pos = ulp->buff_len;
+	ulp->stale_words = 0;
+	ulp->read_sub = 0;
+	ulp->next_rate_pos = 0;
+	memset(&ulp->telemetry, 0, sizeof(ulp->telemetry));
+	ulp->telemetry.min_headroom = UINT16_MAX;
+	ulp->dpcm_value = 0x80;
+	ulp->dpcm_base = 0x80;
+	ulp->dpcm_nibbles = 0;
+	ulp->dpcm_word = 0;
+	if (info->dpcm)
+		ulp_sound_dpcm_build_lut();
+	ulp->wake_watermark = config->wake_watermark;
+	if ((ulp->wake_watermark == ULPSOUND_WAKE_HALF) || (ulp->wake_watermark >= ulp->buff_len))
+		ulp->wake_watermark = ulp->buff_len / 2;
+	ulp->amp_shutdown_rtc_io = config->amp_shutdown_rtc_io;
+	ulp->amp = ULPSOUND_AMP_ON;
+	ulp->end = config->end;
+	ulp->wake_at_end = config->wake_at_end;
+	ulp_sound_amp_enable(ulp, false); // the pads go off below
+
+	for (size_t i = ULPSOUND_PROG_START; i <= ULPSOUND_PROG_STOP; i++)
+		RTC_SLOW_MEM[i] = 11 << 28; // STOP ULP
+
+	dac_output_disable(DAC_CHAN_0);
+	if (info->dac2)
+		dac_output_disable(DAC_CHAN_1);
+	uint32_t delay_time = ulp_sound_setup_clock(ulp, ulp->program, config->sampling_rate);
+	// the ramp leaves most of the prefill lap to silence
+	uint32_t ramp_words = ((uint64_t)config->ramp_ms * ulp->sampling_rate / 1000) >> ulp->index_shift;
+	ulp->ramp_words = (ramp_words > ulp->buff_len / 4) ? ulp->buff_len / 4 : ramp_words;
+	ulp->mute_words = 0;
+	if ((config->mute_after_ms > 0) && (ulp->amp_shutdown_rtc_io >= 0) && ulp_sound_get_layout(ulp->program)->tail)
+	{
+		ulp->mute_words = ((uint64_t)config->mute_after_ms * ulp->sampling_rate / 1000) >> ulp->index_shift;
+		if (ulp->mute_words == 0)
+			ulp->mute_words = 1;
+	}
+	ulp->silence_start = ulp->ramp_words;
+	ulp_sound_build_program(RTC_SLOW_MEM, ulp->program, delay_time, ulp->wake_watermark);
+	if (ulp_sound_get_layout(ulp->program)->tail)
+		ulp->watermark_insn = RTC_SLOW_MEM[ulp_sound_get_layout(ulp->program)->wake_addr];
+	ulp_sound_set_delay(ulp, ulp->delay_time, ulp->delay_frac);
+	ulp_sound_load_curve(ulp, ulp->curve_enabled ? ulp->curve : NULL, false);
+	ESP_LOGI(TAG, "Program loaded, %d words", ULPSOUND_PROG_LEN);
+	if (ulp->wake_watermark != 0)
+	{
+		ESP_LOGI(TAG, "Wake at word %u and at wrap", ulp->wake_watermark);
+		if (esp_sleep_enable_ulp_wakeup() != ESP_OK)
+			ESP_LOGW(TAG, "ULP wakeup not available, light sleep falls back to the timer");
+	}
+
+	// initialize audio buffer, the DACs start where the prefill does
+	const bool ramp = (ulp->ramp_words > 0);
+	dac_output_voltage(DAC_CHAN_0, ramp ? 0 : 0x80);
+	if (info->dac2)
+		dac_output_voltage(DAC_CHAN_1, ramp ? 0 : (info->dac2_inverted ? 0x7F : 0x80));
 	RTC_SLOW_MEM[ULPSOUND_READ_ADDR] = 0;
-	for (uint16_t i = ULPSOUND_BUFF_START; i <= ULPSOUND_BUFF_STOP; i++)
-		RTC_SLOW_MEM[i] = 0x8080;
+	RTC_SLOW_MEM[ULPSOUND_WRAP_ADDR] = 0;
+	ulp_sound_prefill(ulp);
+	// a ramp or the amp has to start from enabled pads, else the caller enables them
+	if (ramp || (ulp->amp_shutdown_rtc_io >= 0))
+	{
+		dac_output_enable(DAC_CHAN_0);
+		if (info->dac2)
+			dac_output_enable(DAC_CHAN_1);
+	}
+	ulp_sound_amp_enable(ulp, true);
 
 	ulp_run(0);
 	while (RTC_SLOW_MEM[ULPSOUND_READ_ADDR] == 0)
 		ulp_sound_lightsleep_delay(1000);
 
 	ESP_LOGI(TAG, "ULP started");
+}
 
-	esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+bool ulp_sound_chime_load(ulp_sound_t *ulp, const ulp_sound_chime_config_t *chime)
+{
+	if ((chime->len == 0) || (chime->len > ULPSOUND_NIBBLE_BUFF_LEN * 2))
+	{
+		ESP_LOGE(TAG, "Chime of %u samples does not fit, %d max", chime->len, ULPSOUND_NIBBLE_BUFF_LEN * 2);
+		return false;
+	}
+
+	ulp_sound_recal_stop(ulp);
+
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[ULPSOUND_PROGRAM_CHIME];
+	ulp->program = ULPSOUND_PROGRAM_CHIME;
+	ulp->buff_len = info->buff_len;
+	ulp->index_shift = info->index_shift;
+	ulp->last_filled_word = 0;
+	ulp->wake_watermark = 0;
+
+	for (size_t i = ULPSOUND_PROG_START; i <= ULPSOUND_PROG_STOP; i++)
+		RTC_SLOW_MEM[i] = 11 << 28; // STOP ULP
+
+	uint32_t delay_time = ulp_sound_setup_clock(ulp, ULPSOUND_PROGRAM_CHIME, chime->sampling_rate);
+	ulp_sound_build_chime(RTC_SLOW_MEM, delay_time, chime->len, chime->amp_shutdown_rtc_io);
+
+	// odd clips end on a midscale sample
+	for (size_t i = 0; i < chime->len; i += 2)
+		RTC_SLOW_MEM[ULPSOUND_BUFF_START + i / 2] = chime->samples[i] | (((i + 1 < chime->len) ? chime->samples[i + 1] : 0x80) << 8);
+	RTC_SLOW_MEM[ULPSOUND_CHIME_MAGIC_ADDR] = ULPSOUND_CHIME_MAGIC;
+	ESP_LOGI(TAG, "Chime loaded, %u samples", chime->len);
+	return true;
+}
+
+// RTC_SLOW_MEM survives deep sleep, a loaded chime can be played again after every wakeup
+bool ulp_sound_chime_is_loaded(void)
+{
+	return RTC_SLOW_MEM[ULPSOUND_CHIME_MAGIC_ADDR] == ULPSOUND_CHIME_MAGIC;
+}
+
+// starts the clip and returns at once, the ULP halts by itself, the CPU may enter deep sleep
+void ulp_sound_chime_play(void)
+{
+	RTC_SLOW_MEM[ULPSOUND_READ_ADDR] = 0;
+	dac_output_voltage(DAC_CHAN_0, 0x80);
+	ulp_run(0);
+}
+
+// the segments use the measured rate, so the pitch holds as far as the RTC clock calibration does
+bool ulp_sound_tone_load(ulp_sound_t *ulp, const ulp_sound_tone_config_t *tone)
+{
+	ulp_sound_recal_stop(ulp);
+
+	ulp->program = ULPSOUND_PROGRAM_TONE;
+	ulp->buff_len = 0;
+	ulp->index_shift = 0;
+	ulp->last_filled_word = 0;
+	ulp->wake_watermark = 0;
+
+	for (size_t i = ULPSOUND_PROG_START; i <= ULPSOUND_PROG_STOP; i++)
+		RTC_SLOW_MEM[i] = 11 << 28; // STOP ULP
+
+	uint32_t delay_time = ulp_sound_setup_clock(ulp, ULPSOUND_PROGRAM_TONE, tone->sampling_rate);
+	ulp_sound_build_tone(RTC_SLOW_MEM, delay_time, tone->wave, tone->amp_shutdown_rtc_io);
+	size_t segments = ulp_sound_tone_segments(RTC_SLOW_MEM, tone->tones, tone->count, ulp->sampling_rate);
+	if (segments == 0)
+	{
+		ESP_LOGE(TAG, "Tones do not fit %d segments", ULPSOUND_TONE_SEGMENTS);
+		RTC_SLOW_MEM[ULPSOUND_TONE_SEGMENT_START + 2] = 0;
+		return false;
+	}
+	RTC_SLOW_MEM[ULPSOUND_CHIME_MAGIC_ADDR] = ULPSOUND_TONE_MAGIC;
+	ESP_LOGI(TAG, "Tones loaded, %u segments", segments);
+	return true;
+}
+
+bool ulp_sound_tone_is_loaded(void)
+{
+	return RTC_SLOW_MEM[ULPSOUND_CHIME_MAGIC_ADDR] == ULPSOUND_TONE_MAGIC;
+}
+
+// the program resets phase and segment itself, the CPU may enter deep sleep
+void ulp_sound_tone_play(void)
+{
+	dac_output_voltage(DAC_CHAN_0, 0x80);
+	ulp_run(0);
+}
+
+// words the ULP moved past since init. The index is read before the wrap counter, the ULP bumps the
+// counter before it stores index 0, so a poll in between (where the wrap WAKE lands) sees the new count
+// with the last word of the old lap, taken as the earliest position that is not behind the last poll
+static uint64_t ulp_sound_read_position(ulp_sound_t *ulp)
+{
+	uint16_t index = RTC_SLOW_MEM[ULPSOUND_READ_ADDR] & 0xFFFF;
+	uint16_t word = index >> ulp->index_shift;
+	uint16_t wraps = RTC_SLOW_MEM[ULPSOUND_WRAP_ADDR] & 0xFFFF;
+	uint32_t laps = ulp->read_laps + (uint16_t)(wraps - ulp->read_wraps);
+	uint64_t pos = (uint64_t)laps * ulp->buff_len + word;
+	if ((word == ulp->buff_len - 1) && (laps > 0) && (pos - ulp->buff_len >= ulp->read_pos))
+		pos -= ulp->buff_len;
+	ulp->read_wraps = wraps;
+	ulp->read_laps = laps;
+	if ((pos > ulp->read_pos) || ((pos == ulp->read_pos) && (index & ((1 << ulp->index_shift) - 1)) > ulp->read_sub))
+	{
+		ulp->read_pos = pos;
+		ulp->read_sub = index & ((1 << ulp->index_shift) - 1);
+	}
+	return ulp->read_pos;
+}
+
+// free words ahead of the writer, an underrun is counted once and the writer moves up to the ULP
+static uint16_t ulp_sound_free_words(ulp_sound_t *ulp)
+{
+	uint64_t read_pos = ulp_sound_read_position(ulp);
+	if (read_pos > ulp->write_pos)
+	{
+		ulp->telemetry.underruns++;
+		ulp->telemetry.underrun_words += read_pos - ulp->write_pos;
+		ulp->stale_words += read_pos - ulp->write_pos;
+		ulp->write_pos = read_pos;
+		ulp->last_filled_word = read_pos % ulp->buff_len;
+	}
+	uint16_t headroom = ulp->write_pos - read_pos;
+	if (headroom < ulp->telemetry.min_headroom)
+		ulp->telemetry.min_headroom = headroom;
+	ulp->telemetry.laps = ulp->read_laps;
+	return ulp->buff_len - headroom;
+}
+
+// once the silent run is mute_words long, the ULP shuts the amp down where it is, or the CPU does if the
+// ULP is there already. A pending mute the ULP passed gets the WAKE back
+static void ulp_sound_update_amp(ulp_sound_t *ulp)
+{
+	if ((ulp->amp == ULPSOUND_AMP_MUTING) && (ulp->read_pos >= ulp->amp_event_pos))
+	{
+		ulp_sound_restore_watermark(ulp);
+		ulp->amp = ULPSOUND_AMP_MUTED;
+	}
+	if ((ulp->amp != ULPSOUND_AMP_ON) || (ulp->mute_words == 0) || (ulp->write_pos < ulp->silence_start + ulp->mute_words))
+		return;
+
+	uint64_t pos = ulp->silence_start + ulp->mute_words;
+	// the tail takes the wrap path at the first word of a lap
+	if (pos % ulp->buff_len == 0)
+		pos++;
+	if (pos <= ulp->read_pos + 1)
+	{
+		ulp_sound_amp_enable(ulp, false);
+		ulp->amp = ULPSOUND_AMP_MUTED;
+	}
+	else if (pos - ulp->read_pos + 2 <= ulp->buff_len)
+	{
+		const uint16_t word = pos % ulp->buff_len;
+		ulp_sound_move_watermark(ulp, word);
+		RTC_SLOW_MEM[ulp_sound_get_layout(ulp->program)->wake_addr] = ulp_sound_amp_shutdown_insn(ulp->amp_shutdown_rtc_io);
+		ulp->amp_event_pos = pos;
+		ulp->amp = ULPSOUND_AMP_MUTING;
+	}
+}
+
+// a sample off midscale in the word at pos ends the silent run there, a pending or done mute is undone
+static void ulp_sound_heard(ulp_sound_t *ulp, uint64_t pos)
+{
+	ulp->silence_start = pos + 1;
+	if (ulp->amp == ULPSOUND_AMP_MUTING)
+		ulp_sound_restore_watermark(ulp);
+	if ((ulp->amp == ULPSOUND_AMP_MUTING) || (ulp->amp == ULPSOUND_AMP_MUTED))
+	{
+		ulp_sound_amp_enable(ulp, true);
+		ulp->amp = ULPSOUND_AMP_ON;
+	}
+}
+
+// samples_per_word of the written samples fill a word, the first one at sample offset of the word at pos
+static void ulp_sound_track_silence(ulp_sound_t *ulp, uint64_t pos, uint8_t offset, uint8_t samples_per_word, const uint8_t *samples, size_t len)
+{
+	if (ulp->mute_words == 0)
+		return;
+	for (size_t i = len; i-- > 0;)
+		if (samples[i] != 0x80)
+		{
+			ulp_sound_heard(ulp, pos + (offset + i) / samples_per_word);
+			return;
+		}
 }
 
+// call once per refill, it feeds the telemetry and applies a rate change the ULP reached
 uint16_t ulp_sound_get_buffer_diff(ulp_sound_t *ulp)
 {
-	uint16_t currentWord = (RTC_SLOW_MEM[ULPSOUND_READ_ADDR] & 0xFFFF) >> 1;
-	if (currentWord < ulp->last_filled_word)
-		currentWord += ULPSOUND_BUFF_LEN;
-	return abs(currentWord - ulp->last_filled_word);
+	uint16_t free_words = ulp_sound_free_words(ulp);
+	ulp_sound_update_amp(ulp);
+	if ((ulp->next_rate_pos != 0) && (ulp->read_pos >= ulp->next_rate_pos))
+	{
+		ulp->next_rate_pos = 0;
+		ulp_sound_set_sampling_rate(ulp, ulp->next_sampling_rate);
+	}
+	if (free_words == 0)
+		ulp->telemetry.overruns++;
+	return free_words;
+}
+
+void ulp_sound_get_position(ulp_sound_t *ulp, ulp_sound_position_t *position)
+{
+	uint64_t read_pos = ulp_sound_read_position(ulp);
+	position->played = (read_pos << ulp->index_shift) | ulp->read_sub;
+	position->written = ulp->write_pos << ulp->index_shift;
+	position->stale = ulp->stale_words << ulp->index_shift;
+	// not yet resynced after an underrun, the next sample written plays at once
+	position->latency_us = 0;
+	if (position->written > position->played)
+		position->latency_us = ulp_sound_samples_to_us(ulp, position->written - position->played);
+}
+
+// at the measured sampling rate
+uint64_t ulp_sound_samples_to_us(ulp_sound_t *ulp, uint64_t samples)
+{
+	if (ulp->sampling_rate == 0)
+		return 0;
+	return samples * 1000000 / ulp->sampling_rate;
+}
+
+void ulp_sound_get_telemetry(ulp_sound_t *ulp, ulp_sound_telemetry_t *telemetry, bool reset)
+{
+	*telemetry = ulp->telemetry;
+	if (reset)
+	{
+		memset(&ulp->telemetry, 0, sizeof(ulp->telemetry));
+		ulp->telemetry.laps = telemetry->laps;
+		ulp->telemetry.min_headroom = UINT16_MAX;
+	}
+}
+
+// moves the write position past words just written to the ring
+static void ulp_sound_advance(ulp_sound_t *ulp, size_t words)
+{
+	ulp->write_pos += words;
+	ulp->last_filled_word += words;
+	if (ulp->last_filled_word >= ulp->buff_len)
+		ulp->last_filled_word -= ulp->buff_len;
+}
+
+// closed loop, each nibble is picked against the value the ULP holds after the previous one. Up to
+// three nibbles wait in dpcm_word, a word only reaches the ring once it is complete
+static size_t ulp_sound_write_dpcm(ulp_sound_t *ulp, const uint8_t *samples, size_t len)
+{
+	uint16_t free_words = ulp_sound_free_words(ulp);
+	size_t room = (free_words == 0) ? 0 : (size_t)free_words * 4 - ulp->dpcm_nibbles;
+	if (len > room)
+		len = room;
+	len &= ~(size_t)1;
+
+	ulp_sound_track_silence(ulp, ulp->write_pos, ulp->dpcm_nibbles, 4, samples, len);
+	uint8_t value = ulp->dpcm_value;
+	uint16_t word = ulp->dpcm_word;
+	uint8_t nibbles = ulp->dpcm_nibbles;
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t nibble = ulp_sound_dpcm_nibble(value, samples[i]);
+		value += ulp_sound_dpcm_steps[nibble];
+		word |= nibble << (nibbles * 4);
+		if (++nibbles < 4)
+			continue;
+		// the ULP loads the sync value when it wraps into the lap this word starts
+		if (ulp->last_filled_word == 0)
+			RTC_SLOW_MEM[ULPSOUND_DPCM_SYNC_ADDR] = ulp->dpcm_base * 2;
+		RTC_SLOW_MEM[ULPSOUND_BUFF_START + ulp->last_filled_word] = word;
+		ulp_sound_advance(ulp, 1);
+		ulp->dpcm_base = value;
+		word = 0;
+		nibbles = 0;
+	}
+	ulp->dpcm_value = value;
+	ulp->dpcm_word = word;
+	ulp->dpcm_nibbles = nibbles;
+	return len;
 }
 
 void ulp_sound_refill(ulp_sound_t *ulp, uint16_t packed_dual_sample)
 {
+	if (ulp_sound_programs[ulp->program].dpcm)
+	{
+		const uint8_t samples[2] = {packed_dual_sample & 0xFF, packed_dual_sample >> 8};
+		ulp_sound_write_dpcm(ulp, samples, 2);
+		return;
+	}
+	const uint8_t samples[2] = {packed_dual_sample & 0xFF, packed_dual_sample >> 8};
+	ulp_sound_track_silence(ulp, ulp->write_pos, 0, 2, samples, 2);
+	if (ulp->cpu_curve)
+		packed_dual_sample = ulp->curve[packed_dual_sample & 0xFF] | ulp->curve[packed_dual_sample >> 8] << 8;
 	RTC_SLOW_MEM[ULPSOUND_BUFF_START + ulp->last_filled_word++] = packed_dual_sample;
-	if (ulp->last_filled_word == ULPSOUND_BUFF_LEN)
+	ulp->write_pos++;
+	if (ulp->last_filled_word == ulp->buff_len)
 		ulp->last_filled_word = 0;
 }
 
+// one 32 bit load carries two packed words on the little endian core, the low byte is the earlier sample
+static void ulp_sound_write_run(uint32_t *dst, const uint8_t *samples, size_t words)
+{
+	size_t i = 0;
+	for (; i + 2 <= words; i += 2)
+	{
+		uint32_t quad;
+		memcpy(&quad, samples + i * 2, sizeof(quad));
+		dst[i] = quad & 0xFFFF;
+		dst[i + 1] = quad >> 16;
+	}
+	if (i < words)
+		dst[i] = samples[i * 2] | samples[i * 2 + 1] << 8;
+}
+
+// the table lookup the nibble programs cannot do
+static void ulp_sound_write_run_curve(uint32_t *dst, const uint8_t *samples, size_t words, const uint8_t *curve)
+{
+	for (size_t i = 0; i < words; i++)
+		dst[i] = curve[samples[i * 2]] | curve[samples[i * 2 + 1]] << 8;
+}
+
+size_t ulp_sound_write(ulp_sound_t *ulp, const uint8_t *samples, size_t len)
+{
+	if (ulp_sound_programs[ulp->program].dpcm)
+		return ulp_sound_write_dpcm(ulp, samples, len);
+
+	size_t words = len / 2;
+	uint16_t free_words = ulp_sound_free_words(ulp);
+	if (words > free_words)
+		words = free_words;
+
+	// split once where the ring wraps
+	size_t first = ulp->buff_len - ulp->last_filled_word;
+	if (first > words)
+		first = words;
+	if (ulp->cpu_curve)
+	{
+		ulp_sound_write_run_curve(RTC_SLOW_MEM + ULPSOUND_BUFF_START + ulp->last_filled_word, samples, first, ulp->curve);
+		ulp_sound_write_run_curve(RTC_SLOW_MEM + ULPSOUND_BUFF_START, samples + first * 2, words - first, ulp->curve);
+	}
+	else
+	{
+		ulp_sound_write_run(RTC_SLOW_MEM + ULPSOUND_BUFF_START + ulp->last_filled_word, samples, first);
+		ulp_sound_write_run(RTC_SLOW_MEM + ULPSOUND_BUFF_START, samples + first * 2, words - first);
+	}
+	ulp_sound_track_silence(ulp, ulp->write_pos, 0, 2, samples, words * 2);
+	ulp_sound_advance(ulp, words);
+	return words * 2;
+}
+
+size_t ulp_sound_write_words(ulp_sound_t *ulp, const uint16_t *words, size_t len)
+{
+	uint16_t free_words = ulp_sound_free_words(ulp);
+	if (len > free_words)
+		len = free_words;
+
+	size_t first = ulp->buff_len - ulp->last_filled_word;
+	if (first > len)
+		first = len;
+	uint32_t *dst = RTC_SLOW_MEM + ULPSOUND_BUFF_START + ulp->last_filled_word;
+	for (size_t i = 0; i < first; i++)
+		dst[i] = words[i];
+	dst = RTC_SLOW_MEM + ULPSOUND_BUFF_START;
+	for (size_t i = first; i < len; i++)
+		dst[i - first] = words[i];
+	if (ulp->mute_words > 0)
+		for (size_t i = len; i-- > 0;)
+			if (words[i] != 0x0080)
+			{
+				ulp_sound_heard(ulp, ulp->write_pos + i);
+				break;
+			}
+	ulp_sound_advance(ulp, len);
+	return len;
+}
+
+// one word at the write position
+static void ulp_sound_put(ulp_sound_t *ulp, uint16_t word)
+{
+	RTC_SLOW_MEM[ULPSOUND_BUFF_START + ulp->last_filled_word] = word;
+	ulp_sound_advance(ulp, 1);
+}
+
+// the ramp from the value the ULP holds to value over ramp_words, completing the pending word
+static void ulp_sound_ramp_dpcm(ulp_sound_t *ulp, uint8_t value, uint16_t ramp_words)
+{
+	const uint8_t from = ulp->dpcm_value;
+	const uint32_t len = (uint32_t)ramp_words * 4 + ((4 - ulp->dpcm_nibbles) & 3);
+	uint8_t samples[32];
+	for (uint32_t i = 0; i < len;)
+	{
+		uint32_t n = (len - i > sizeof(samples)) ? sizeof(samples) : len - i;
+		for (uint32_t j = 0; j < n; j++)
+			samples[j] = ulp_sound_ramp(from, value, i + j, len);
+		ulp_sound_write_dpcm(ulp, samples, n);
+		i += n;
+	}
+}
+
+bool ulp_sound_stop(ulp_sound_t *ulp)
+{
+	const ulp_sound_program_info_t *info = &ulp_sound_programs[ulp->program];
+	const ulp_sound_layout_t *layout = ulp_sound_get_layout(ulp->program);
+	if (ulp->amp == ULPSOUND_AMP_STOPPING)
+		return true;
+	// the ramp, DPCM's pending word, the end word and the ones that move the epilogue off the lap
+	// boundary, the epilogue, and the word that keeps the end ahead of the ULP
+	if (!layout->tail || (ulp_sound_free_words(ulp) < ulp->ramp_words + 2 * ULPSOUND_END_WORDS + 3))
+		return false;
+	// a stalled index would read as a stalled clock once the ULP halted
+	ulp_sound_recal_stop(ulp);
+	if (ulp->wake_at_end && (esp_sleep_enable_ulp_wakeup() != ESP_OK))
+		ESP_LOGW(TAG, "ULP wakeup not available, the end is only flagged");
+
+	const uint16_t ramp_words = (ulp->end == ULPSOUND_END_HOLD) ? 0 : ulp->ramp_words;
+	uint16_t end = 0;
+	if (info->dpcm)
+	{
+		const uint8_t value = (ulp->end == ULPSOUND_END_FLOOR) ? 0 : (ulp->end == ULPSOUND_END_MIDSCALE) ? 0x80 : ulp->dpcm_value;
+		ulp_sound_ramp_dpcm(ulp, value, ramp_words);
+	}
+	else
+	{
+		uint16_t from = RTC_SLOW_MEM[ULPSOUND_BUFF_START + (ulp->last_filled_word + ulp->buff_len - 1) % ulp->buff_len] & 0xFFFF;
+		// mono, both bytes ramp from the later sample
+		if (info->index_shift == 1)
+			from = (from >> 8) * 0x0101;
+		end = (ulp->end == ULPSOUND_END_FLOOR) ? ulp_sound_floor_word(info) : (ulp->end == ULPSOUND_END_MIDSCALE) ? ulp_sound_silence_word(info) : from;
+		for (uint32_t i = 0; i < ramp_words; i++)
+			ulp_sound_put(ulp, ulp_sound_ramp_word(from, end, i, ramp_words));
+	}
+	// PAIR and COMPACT cut the last word after its low byte, so it holds the end on both. The ULP halts
+	// when it reaches the word after it, which must not be the first of a lap, the wrap path skips the
+	// compare, and the epilogue that follows must not wrap
+	do
+	{
+		if (info->dpcm)
+		{
+			const uint8_t samples[4] = {ulp->dpcm_value, ulp->dpcm_value, ulp->dpcm_value, ulp->dpcm_value};
+			ulp_sound_write_dpcm(ulp, samples, 4);
+		}
+		else
+			ulp_sound_put(ulp, end);
+	} while ((ulp->last_filled_word == 0) || (ulp->last_filled_word + ULPSOUND_END_WORDS > ulp->buff_len));
+
+	uint32_t epilogue[ULPSOUND_END_WORDS - 1];
+	uint16_t len = 0;
+	const uint16_t addr = ULPSOUND_BUFF_START + ulp->last_filled_word;
+	if (ulp->amp_shutdown_rtc_io >= 0)
+		epilogue[len++] = ulp_sound_amp_shutdown_insn(ulp->amp_shutdown_rtc_io);
+	if (ulp->wake_at_end)
+		epilogue[len++] = ((ulp_insn_t)I_WAKE()).instruction;
+	ulp->end_flag_addr = addr + len + 4;
+	epilogue[len++] = ((ulp_insn_t)I_MOVI(R2, ulp->end_flag_addr)).instruction;
+	epilogue[len++] = ((ulp_insn_t)I_ST(R2, R2, 0)).instruction;
+	epilogue[len++] = ((ulp_insn_t)I_END()).instruction;
+	epilogue[len++] = ((ulp_insn_t)I_HALT()).instruction;
+	for (uint16_t i = 0; i < len; i++)
+		RTC_SLOW_MEM[addr + i] = epilogue[i];
+	RTC_SLOW_MEM[ulp->end_flag_addr] = 0;
+
+	ulp_sound_move_watermark(ulp, ulp->last_filled_word);
+	RTC_SLOW_MEM[layout->wake_addr] = ((ulp_insn_t)I_BXI(addr)).instruction;
+	ulp->amp_event_pos = ulp->write_pos;
+	ulp->amp = ULPSOUND_AMP_STOPPING;
+	return true;
+}
+
+bool ulp_sound_is_done(ulp_sound_t *ulp)
+{
+	return (ulp->amp == ULPSOUND_AMP_STOPPING) && ((RTC_SLOW_MEM[ulp->end_flag_addr] & 0xFFFF) == ulp->end_flag_addr);
+}
+
+uint64_t ulp_sound_us_to_end(ulp_sound_t *ulp)
+{
+	if ((ulp->amp != ULPSOUND_AMP_STOPPING) || ulp_sound_is_done(ulp))
+		return 0;
+	uint64_t read_pos = ulp_sound_read_position(ulp);
+	uint64_t words = (ulp->amp_event_pos > read_pos) ? ulp->amp_event_pos - read_pos : 0;
+	return ulp_sound_samples_to_us(ulp, words << ulp->index_shift);
+}
+
+static void ulp_sound_sink_start(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	ulp_sound_sink_t *ulp_sink = ctx;
+	ulp_sink->config.sampling_rate = sampling_rate;
+	ulp_sound_init_with_config(ulp_sink->ulp, &ulp_sink->config);
+	ulp_sound_recal_start(ulp_sink->ulp);
+	layout->channels = ulp_sound_program_channels(ulp_sink->config.program);
+	layout->dual = ulp_sound_program_uses_dac2(ulp_sink->config.program);
+	layout->fraction_bits = ulp_sound_program_fraction_bits(ulp_sink->config.program);
+}
+
+static uint16_t ulp_sound_sink_get_buffer_diff(void *ctx)
+{
+	return ulp_sound_get_buffer_diff(((ulp_sound_sink_t *)ctx)->ulp);
+}
+
+static size_t ulp_sound_sink_write(void *ctx, const uint8_t *samples, size_t len)
+{
+	return ulp_sound_write(((ulp_sound_sink_t *)ctx)->ulp, samples, len);
+}
+
+static size_t ulp_sound_sink_write_words(void *ctx, const uint16_t *words, size_t len)
+{
+	return ulp_sound_write_words(((ulp_sound_sink_t *)ctx)->ulp, words, len);
+}
+
+static void ulp_sound_sink_get_position(void *ctx, sound_sink_position_t *position)
+{
+	ulp_sound_get_position(((ulp_sound_sink_t *)ctx)->ulp, position);
+}
+
+static uint64_t ulp_sound_sink_samples_to_us(void *ctx, uint64_t samples)
+{
+	return ulp_sound_samples_to_us(((ulp_sound_sink_t *)ctx)->ulp, samples);
+}
+
+static void ulp_sound_sink_log_telemetry(void *ctx, bool dump)
+{
+	ulp_sound_telemetry_t telemetry;
+	ulp_sound_get_telemetry(((ulp_sound_sink_t *)ctx)->ulp, &telemetry, false);
+	ESP_LOGI(TAG, "%lu laps, %lu underruns (%lu words), %lu overruns, min headroom %u words", telemetry.laps, telemetry.underruns, telemetry.underrun_words, telemetry.overruns, telemetry.min_headroom);
+	if (dump)
+		ulp_print_status();
+}
+
+static bool ulp_sound_sink_follow(void *ctx, uint32_t sampling_rate, uint64_t position)
+{
+	ulp_sound_sink_t *ulp_sink = ctx;
+	if (!ulp_sound_follow(ulp_sink->ulp, sampling_rate, position))
+		return false;
+	ulp_sink->config.sampling_rate = sampling_rate;
+	return true;
+}
+
+static bool ulp_sound_sink_end(void *ctx)
+{
+	return ulp_sound_stop(((ulp_sound_sink_t *)ctx)->ulp);
+}
+
+static bool ulp_sound_sink_is_done(void *ctx)
+{
+	return ulp_sound_is_done(((ulp_sound_sink_t *)ctx)->ulp);
+}
+
+static const sound_sink_ops_t ulp_sound_sink_ops = {
+	.start = ulp_sound_sink_start,
+	.get_buffer_diff = ulp_sound_sink_get_buffer_diff,
+	.write = ulp_sound_sink_write,
+	.write_words = ulp_sound_sink_write_words,
+	.get_position = ulp_sound_sink_get_position,
+	.samples_to_us = ulp_sound_sink_samples_to_us,
+	.log_telemetry = ulp_sound_sink_log_telemetry,
+	.follow = ulp_sound_sink_follow,
+	.end = ulp_sound_sink_end,
+	.is_done = ulp_sound_sink_is_done,
+};
+
+void ulp_sound_sink_init(ulp_sound_sink_t *ulp_sink, ulp_sound_t *ulp, ulp_sound_program_t program)
+{
+	ulp_sink->sink.ops = &ulp_sound_sink_ops;
+	ulp_sink->sink.ctx = ulp_sink;
+	ulp_sink->ulp = ulp;
+	ulp_sink->config = (ulp_sound_config_t)ULPSOUND_DEFAULT_CONFIG(0);
+	ulp_sink->config.program = program;
+}
+
+bool ulp_sound_follow(ulp_sound_t *ulp, uint32_t target_sampling_rate, uint64_t position)
+{
+	if ((ulp->amp == ULPSOUND_AMP_STOPPING) || (ulp->next_rate_pos != 0))
+		return false;
+	if (target_sampling_rate == ulp->target_sampling_rate)
+		return true;
+	// the word holding the first sample, the rest of it plays at the new rate too
+	uint64_t word = position >> ulp->index_shift;
+	if (word <= ulp_sound_read_position(ulp))
+		ulp_sound_set_sampling_rate(ulp, target_sampling_rate);
+	else
+	{
+		ulp->next_sampling_rate = target_sampling_rate;
+		ulp->next_rate_pos = word;
+	}
+	return true;
+}
+
+void ulp_sound_set_sampling_rate(ulp_sound_t *ulp, uint32_t target_sampling_rate)
+{
+	// the recal tick must not patch the delay of the old rate in between, the stop waits out a running one
+	bool recal = ulp->recal_running;
+	ulp_sound_recal_stop(ulp);
+	ulp_sound_derive_delay(ulp, ulp->program, ulp->rtc_fast_freq_hz, target_sampling_rate);
+	ulp_sound_set_delay(ulp, ulp->delay_time, ulp->delay_frac);
+	if (recal)
+		ulp_sound_recal_start(ulp);
+}
+
+void ulp_sound_set_delay(ulp_sound_t *ulp, uint32_t delay_time, uint16_t delay_frac)
+{
+	ulp->dither_count = ulp_sound_write_delay_diffused(RTC_SLOW_MEM, ulp->program, delay_time, delay_frac, &ulp->dither_error);
+	ulp->delay_time = delay_time;
+	ulp->delay_frac = delay_frac;
+}
+
+// the pattern count only takes 1/32 cycle steps per word, moving it between the two next to delay_frac
+// from tick to tick gets the average rate to the ppm
+static void ulp_sound_dither_tick(ulp_sound_t *ulp)
+{
+	const ulp_sound_layout_t *layout = ulp_sound_get_layout(ulp->program);
+	if (!layout->dither)
+		return;
+	uint32_t dither_time;
+	uint16_t count = ulp_sound_dither_count(ulp_sound_dither_split(layout, ulp->program, ulp->delay_time, ulp->delay_frac, &dither_time), &ulp->dither_error);
+	if (count != ulp->dither_count)
+		ulp_asm_write_dither(RTC_SLOW_MEM, ULPSOUND_DITHER_START, ULPSOUND_DITHER_LEN, layout->dither_short_addr, layout->dither_long_addr, count);
+	ulp->dither_count = count;
+}
+
+// returns true when the delay has been moved, the caller holds recal_lock
+static bool ulp_sound_recal_update(ulp_sound_t *ulp)
+{
+	int64_t now_us = esp_timer_get_time();
+	uint16_t index = RTC_SLOW_MEM[ULPSOUND_READ_ADDR] & 0xFFFF;
+	uint32_t elapsed_us = now_us - ulp->recal_last_us;
+	uint32_t index_len = (uint32_t)ulp->buff_len << ulp->index_shift;
+	uint32_t samples = (index + index_len - ulp->recal_last_index) % index_len;
+	ulp->recal_last_us = now_us;
+	ulp->recal_last_index = index;
+	ulp_sound_dither_tick(ulp);
+
+	// the index alone cannot tell ring laps apart, drop the window if this tick may have missed one
+	if ((uint64_t)elapsed_us * ulp->sampling_rate >= (uint64_t)index_len * 750000)
+	{
+		ulp_clock_discard_window(&ulp->clock);
+		return false;
+	}
+
+	const uint8_t oversampling = ulp_sound_oversampling(ulp->program);
+	bool changed = ulp_clock_feed(&ulp->clock, samples * oversampling, elapsed_us);
+	ulp->rtc_fast_freq_hz = ulp->clock.rtc_freq_hz;
+	if (changed)
+		ulp_sound_set_delay(ulp, ulp->clock.delay, ulp->clock.delay_frac);
+	ulp->sampling_rate = ulp_clock_get_rate(&ulp->clock) / oversampling;
+	return changed;
+}
+
+// runs on the esp_timer task, esp_timer_stop() does not wait for a tick already running,
+// so the tick only touches the program and the clock state under recal_lock and while recal_running
+static void ulp_sound_recal_tick(void *arg)
+{
+	ulp_sound_t *ulp = arg;
+	bool changed = false;
+	uint32_t rtc_fast_freq_hz, delay_time;
+	uint16_t delay_frac;
+	portENTER_CRITICAL(&ulp->recal_lock);
+	if (ulp->recal_running)
+		changed = ulp_sound_recal_update(ulp);
+	rtc_fast_freq_hz = ulp->rtc_fast_freq_hz;
+	delay_time = ulp->delay_time;
+	delay_frac = ulp->delay_frac;
+	portEXIT_CRITICAL(&ulp->recal_lock);
+	if (changed)
+		ESP_LOGD(TAG, "RTC freq %luHz, delay time %lu + %u/65536", rtc_fast_freq_hz, delay_time, delay_frac);
+}
+
+void ulp_sound_recal_start(ulp_sound_t *ulp)
+{
+	if (ulp->recal_timer == NULL)
+	{
+		const esp_timer_create_args_t args = {
+			.callback = ulp_sound_recal_tick,
+			.arg = ulp,
+			.dispatch_method = ESP_TIMER_TASK,
+			.name = "ulp_recal",
+			.skip_unhandled_events = true,
+		};
+		ESP_ERROR_CHECK(esp_timer_create(&args, &ulp->recal_timer));
+		portMUX_INITIALIZE(&ulp->recal_lock);
+	}
+	ulp_sound_recal_stop(ulp);
+	portENTER_CRITICAL(&ulp->recal_lock);
+	ulp_clock_discard_window(&ulp->clock);
+	ulp->recal_last_us = esp_timer_get_time();
+	ulp->recal_last_index = RTC_SLOW_MEM[ULPSOUND_READ_ADDR] & 0xFFFF;
+	ulp->recal_running = true;
+	portEXIT_CRITICAL(&ulp->recal_lock);
+	ESP_ERROR_CHECK(esp_timer_start_periodic(ulp->recal_timer, ULPSOUND_RECAL_TICK_MS * 1000));
+}
+
+// once it returns no tick touches the program or the delay until the next start
+void ulp_sound_recal_stop(ulp_sound_t *ulp)
+{
+	if (ulp->recal_timer == NULL)
+	{
+		ulp->recal_running = false; // the lock comes with the timer, no tick has ever run
+		return;
+	}
+	esp_timer_stop(ulp->recal_timer); // not running is fine
+	// a tick that has already started either finished its update or sees recal_running cleared
+	portENTER_CRITICAL(&ulp->recal_lock);
+	ulp->recal_running = false;
+	portEXIT_CRITICAL(&ulp->recal_lock);
+}
+
+// the timer wakeup only lasts for this sleep, a later light sleep must not end on it
 void ulp_sound_lightsleep_delay(uint64_t time_in_us)
 {
 	esp_sleep_enable_timer_wakeup(time_in_us);
 	esp_light_sleep_start();
+	esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_TIMER);
+}
+
+// light sleep until the ULP reaches the watermark or wraps, the timer only covers a missed WAKE
+void ulp_sound_lightsleep_until_wake(ulp_sound_t *ulp)
+{
+	uint32_t words = ulp->buff_len / 2;
+	if (ulp->wake_watermark != 0)
+	{
+		uint32_t longer = ulp->wake_watermark;
+		uint32_t shorter = ulp->buff_len - ulp->wake_watermark;
+		if (shorter > longer)
+		{
+			shorter = ulp->wake_watermark;
+			longer = ulp->buff_len - ulp->wake_watermark;
+		}
+		words = longer + shorter / 2;
+	}
+	uint64_t time_in_us = ((uint64_t)words << ulp->index_shift) * 1000000 / ulp->sampling_rate;
+	ulp_sound_lightsleep_delay(time_in_us);
 }
 
 void ulp_print_rtc_slow_memory_as_uint16(size_t addr)
@@ -164,7 +1933,8 @@ void ulp_print_audio_samples(size_t start_pos, size_t len)
 {
 	const size_t rtc_buffer_per_row = 8;
 	const size_t samples_per_row = rtc_buffer_per_row * 2;
-	uint8_t buffer[samples_per_row] = {};
+	uint8_t buffer[samples_per_row]; // variable length, cannot take an initializer before C23
+	memset(buffer, 0, sizeof(buffer));
 	size_t read_pos = 0;
 	size_t buffer_read = 0;
 
@@ -207,6 +1977,9 @@ void ulp_print_status()
 	printf("--- ULP FIFO HEAD POS \r\n");
 	ulp_print_rtc_slow_memory_as_uint16(ULPSOUND_READ_ADDR);
 
+	printf("--- ULP FIFO WRAPS \r\n");
+	ulp_print_rtc_slow_memory_as_uint16(ULPSOUND_WRAP_ADDR);
+
 	printf("--- ULP AUDIO SAMPLES \r\n");
 	ulp_print_audio_samples(ULPSOUND_BUFF_START, ULPSOUND_BUFF_LEN);
 
@@ -1,22 +1,56 @@
 #pragma once
 
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "ulpClock.h"
+#include "soundSink.h"
 
 /* - RTC_SLOW_MEM structure(32bit wide) -                   *\
  * INDEX     USAGE                                          *
- * 0:16      ULP program                                    *
- * 17        index tracker (16bits, goes up to 1514)        *
- * 18:1531   Audio buffer  (16bits, store two 8 bit samples)*
- * 1532:2043 DAC opcode tables                              *
+ * 0:47      ULP program                                    *
+ * 48        wrap counter  (16bits, ULP laps of the buffer) *
+ * 49        index tracker (16bits, goes up to 3796)        *
+ * 50:81     dither pattern (16bits, delay slot addresses)  *
+ * 82:1531   Audio buffer  (16bits, store two 8 bit samples)*
+ * 1532:2043 DAC1 opcode tables                             *
+ *  or, with the DAC1 nibble tables (COMPACT, CHIME):       *
+ * 82:1979   Audio buffer  (16bits, store two 8 bit samples)*
+ * 1980:2043 DAC1 nibble opcode tables                      *
+ *  or, with DPCM:                                          *
+ * 82:1513   Audio buffer  (16bits, store four 4 bit deltas)*
+ * 1514:1529 DPCM step table (16bits, 2 x delta)            *
+ * 1530      DPCM value    (16bits, 2 x the last sample)    *
+ * 1531      DPCM sync     (16bits, value at the next wrap) *
+ * 1532:2043 DAC1 opcode tables                             *
+ *  or, with TONE:                                          *
+ * 82:593    wavetable     (16bits, 16 levels x 32 entries) *
+ * 594:1364  tone segments (16bits, step, wave, samples)    *
+ * 1365:1368 tone state    (phase, step, wave, next segment)*
+ * 1532:2043 DAC1 opcode tables                             *
+ *  or, with a program driving DAC2:                        *
+ * 82:1019   Audio buffer  (16bits, L low byte, R high byte)*
+ * 1020:1531 DAC2 opcode tables                             *
+ * 1532:2043 DAC1 opcode tables                             *
+ *                                                          *
 \* 2044:2047 Reserved for ESP-IDF, DO NOT USE               */
 
 #define ULPSOUND_PROG_START 0
-#define ULPSOUND_PROG_STOP 16
+#define ULPSOUND_PROG_STOP 47
 #define ULPSOUND_PROG_LEN (ULPSOUND_PROG_STOP - ULPSOUND_PROG_START + 1)
 
-#define ULPSOUND_READ_ADDR 17
+#define ULPSOUND_WRAP_ADDR 48
+#define ULPSOUND_READ_ADDR 49
 
-#define ULPSOUND_BUFF_START 18
+#define ULPSOUND_DITHER_START 50
+#define ULPSOUND_DITHER_LEN 32 // power of two, indexed by the low bits of the word index
+
+// FIFO of the default program, PAIR, and of SINGLE and OVERSAMPLED
+#define ULPSOUND_BUFF_START 82
 #define ULPSOUND_BUFF_STOP 1531
 #define ULPSOUND_BUFF_LEN (ULPSOUND_BUFF_STOP - ULPSOUND_BUFF_START + 1)
 
@@ -24,19 +58,387 @@
 #define ULPSOUND_DAC_MAP_STOP 2043
 #define ULPSOUND_DAC_MAP_LEN (ULPSOUND_DAC_MAP_STOP - ULPSOUND_DAC_MAP_START + 1)
 
-#define ULPSOUND_PROGRAM_CLOCKCYCLE 86
+// FIFO of COMPACT and CHIME, which drive DAC1 through the nibble tables
+#define ULPSOUND_NIBBLE_BUFF_STOP 1979
+#define ULPSOUND_NIBBLE_BUFF_LEN (ULPSOUND_NIBBLE_BUFF_STOP - ULPSOUND_BUFF_START + 1)
+
+// high nibble entries return into the low nibble table, 16 x [REG_WR, JUMP] each
+#define ULPSOUND_NIBBLE_HIGH_MAP_START 1980
+#define ULPSOUND_NIBBLE_LOW_MAP_START 2012
+#define ULPSOUND_NIBBLE_MAP_STOP 2043
+
+#define ULPSOUND_STEREO_BUFF_STOP 1019
+#define ULPSOUND_STEREO_BUFF_LEN (ULPSOUND_STEREO_BUFF_STOP - ULPSOUND_BUFF_START + 1)
+
+#define ULPSOUND_DPCM_BUFF_STOP 1513
+#define ULPSOUND_DPCM_BUFF_LEN (ULPSOUND_DPCM_BUFF_STOP - ULPSOUND_BUFF_START + 1)
+#define ULPSOUND_DPCM_STEP_START 1514
+#define ULPSOUND_DPCM_STEP_LEN 16
+#define ULPSOUND_DPCM_VALUE_ADDR 1530
+#define ULPSOUND_DPCM_SYNC_ADDR 1531
+
+#define ULPSOUND_TONE_WAVE_START ULPSOUND_BUFF_START
+#define ULPSOUND_TONE_WAVE_LEN 32 // entries per period, the top 5 bits of the phase
+#define ULPSOUND_TONE_LEVELS 16	  // 3 dB apart, 0 is silence
+#define ULPSOUND_TONE_SEGMENT_START (ULPSOUND_TONE_WAVE_START + ULPSOUND_TONE_WAVE_LEN * ULPSOUND_TONE_LEVELS)
+#define ULPSOUND_TONE_SEGMENT_WORDS 3
+#define ULPSOUND_TONE_SEGMENTS 256 // plus the terminating segment of 0 samples
+#define ULPSOUND_TONE_PHASE_ADDR (ULPSOUND_TONE_SEGMENT_START + (ULPSOUND_TONE_SEGMENTS + 1) * ULPSOUND_TONE_SEGMENT_WORDS)
+#define ULPSOUND_TONE_STEP_ADDR (ULPSOUND_TONE_PHASE_ADDR + 1)
+#define ULPSOUND_TONE_WAVE_ADDR (ULPSOUND_TONE_PHASE_ADDR + 2)
+#define ULPSOUND_TONE_NEXT_ADDR (ULPSOUND_TONE_PHASE_ADDR + 3)
+
+#define ULPSOUND_DAC2_MAP_START 1020
+#define ULPSOUND_DAC2_MAP_STOP 1531
+
+/* - ULP programs -                                             *\
+ * Assembled with ulpAsm, ulp_sound_program_cycles() returns the *
+ * cycles per sample excluding delay_time, summed by the builder *
+ * from the TRM cycle counts over every path between two DAC     *
+ * writes (SINGLE 132, PAIR 102, STEREO 158 per frame, COMPACT   *
+ * 156, CHIME 118, DPCM 178, TONE 164) and checked with the      *
+ * host emulator, test/ulpEmu.                                   *
+ * SINGLE:  one sample per loop, picks the byte by index parity  *
+ * PAIR:    loads each word once, plays the low then the high    *
+ *          byte with balanced delays, 23% fewer cycles          *
+ * STEREO:  one frame per word, low byte to DAC1, high byte to   *
+ *          DAC2, 44 cycles apart                                *
+ * BRIDGED: STEREO with an inverted DAC2 table, both bytes carry *
+ *          the same sample for 6 dB more swing into the amp     *
+ * COMPACT: PAIR over two 16 entry nibble tables instead of the  *
+ *          256 entry table, 448 more FIFO words (30% longer)    *
+ *          for 54 more cycles per sample. The high nibble is    *
+ *          written first, the DAC is at most 15 LSB off for the *
+ *          16 cycles until the low nibble lands, a glitch at    *
+ *          the sample rate, and the curve falls back to the     *
+ *          CPU. Opt in where the FIFO length matters more than  *
+ *          that, e.g. for longer light sleeps, PAIR is the      *
+ *          default                                              *
+ * CHIME:   COMPACT played once from the start of the buffer,    *
+ *          then parks the DAC at midscale and halts, so a clip  *
+ *          can play while the CPU is in deep sleep              *
+ * OVERSAMPLED: PAIR over one 9 bit sample per word, writes the  *
+ *          code, then the code + bit 8, the average carries the *
+ *          ninth bit. Two DAC writes per sample, up to ~41 kHz  *
+ *          at 8.5 MHz, see ulp_sound_write_words()              *
+ * DPCM:    four 4 bit deltas per word, twice the FIFO of PAIR   *
+ *          for 76 more cycles per sample, up to ~47 kHz at      *
+ *          8.5 MHz, see the DPCM section below                  *
+ * TONE:    no FIFO, steps a phase through a wavetable per       *
+ *          segment and halts after the last one, like CHIME,    *
+\*          see the tone synthesizer section below               */
+
+/* - fractional delay -                                         *\
+ * I_DELAY only takes whole cycles, at 8.5 MHz and 44.1 kHz the  *
+ * truncation alone is up to 0.5% of pitch. PAIR and COMPACT     *
+ * spend idle cycles after the high byte on a jump through the   *
+ * dither pattern into a delay one cycle longer or not, which    *
+ * spreads a fraction of a cycle over every word. The pattern    *
+ * holds 1/32 cycle steps per word, the recalibration tick error *
+ * diffuses between neighbouring steps for the rest. The other   *
+\* programs have no cycles to spare and round the delay.         */
+
+typedef enum
+{
+	ULPSOUND_PROGRAM_SINGLE = 0,
+	ULPSOUND_PROGRAM_PAIR,
+	ULPSOUND_PROGRAM_STEREO,
+	ULPSOUND_PROGRAM_BRIDGED,
+	ULPSOUND_PROGRAM_COMPACT,
+	ULPSOUND_PROGRAM_CHIME,
+	ULPSOUND_PROGRAM_OVERSAMPLED,
+	ULPSOUND_PROGRAM_DPCM,
+	ULPSOUND_PROGRAM_TONE,
+} ulp_sound_program_t;
+
+/* - DPCM -                                                     *\
+ * The ULP keeps twice the last sample at VALUE_ADDR, adds the   *
+ * step table entry of the next nibble (lowest first) and plays  *
+ * the sum, masked to the 256 entry DAC table, which the curve   *
+ * applies to.                                                   *
+ * ulp_sound_write() encodes closed loop: each nibble is chosen  *
+ * against the value the ULP will hold, not the source, so the   *
+ * quantization error never builds up and the value never has to *
+ * be clamped. The steps are companded, 1 to 36 up and 1 to 64   *
+ * down, fine for voice, slew limited on loud highs. The writer  *
+ * stores its value at ULPSOUND_DPCM_SYNC_ADDR with the first    *
+ * word of each lap and the ULP loads it when it wraps, so after *
+ * an underrun a drifted value lasts until the next wrap at      *
+\* most.                                                         */
+
+/* - transfer curve -                                           *\
+ * The 256 entry tables turn a sample into the DAC code it jumps *
+ * to, loading any 8 to 8 bit curve there (gain, normalization,  *
+ * soft clipping, companding, speaker linearization) costs the   *
+ * ULP nothing. ulp_sound_set_curve() parks the ULP at the top   *
+ * of its loop for the rewrite, so no word or frame plays        *
+ * through both curves, the DAC holds its code for two word      *
+ * times and the 512 word writes. The nibble programs split the  *
+ * byte over two tables and fall back to a lookup in             *
+ * ulp_sound_write(), which only reaches the samples written     *
+\* after the change.                                             */
+
+/* - CPU wakeup -                                               *\
+ * The ULP issues WAKE when it starts reading the watermark word *
+ * and when it wraps, so the CPU can light sleep between refills *
+ * and gets min(watermark, buff_len - watermark) words of slack. *
+\* ULPSOUND_WAKE_HALF wakes twice per lap, 0 never wakes.        */
+#define ULPSOUND_WAKE_HALF UINT16_MAX
+
+/* - amp control -                                              *\
+ * With amp_shutdown_rtc_io set, init starts the DACs at code 0, *
+ * enables the amp and the prefill ramps to midscale over        *
+ * ramp_ms, so neither the pads nor the amp switch on a step.    *
+ * ulp_sound_stop() ends the stream at the watermark compare of  *
+ * the tail, see end of stream, where the ULP shuts the amp down *
+ * and halts: the CPU can deep sleep right after the call, the   *
+ * ramps cost no cycles while playing. The writer watches for a  *
+ * run of silence (midscale) and moves the watermark to the word *
+ * where it reaches mute_after_ms, the ULP shuts the amp down    *
+ * there, one sample runs 6 cycles long. Writing sound again     *
+ * enables the amp at once, it still has the rest of the silence *
+ * to settle. The watermark WAKE is lost while the mute is       *
+\* pending, the light sleep timer covers it.                     */
+
+/* - end of stream -                                            *\
+ * ulp_sound_stop() writes the end (the ramp to 0 or midscale,   *
+ * or a word holding the last sample) and behind it a short      *
+ * epilogue into free FIFO words, then points the watermark slot *
+ * at it with a single JUMP. The ULP plays up to the last word   *
+ * written, no stale lap, shuts the amp down, optionally WAKEs   *
+ * the CPU, stores the epilogue flag and halts.                  *
+ * ulp_sound_is_done() reads the flag, ulp_sound_us_to_end()     *
+\* tells when it will be set.                                    */
+#define ULPSOUND_END_WORDS 7 // epilogue and its flag
+
+typedef enum
+{
+	ULPSOUND_END_FLOOR = 0, // ramp to code 0 over ramp_ms, where the amp is shut down without a step
+	ULPSOUND_END_MIDSCALE,	// ramp to midscale over ramp_ms, like the silence the FIFO starts with
+	ULPSOUND_END_HOLD,		// the DAC keeps the last sample
+} ulp_sound_end_t;
+
+#define ULPSOUND_RECAL_TICK_MS 20
+
+// never executed, follows the chime program so a wakeup can tell if the clip is still loaded
+#define ULPSOUND_CHIME_MAGIC_ADDR ULPSOUND_PROG_STOP
+#define ULPSOUND_CHIME_MAGIC 0x43484D45 // "CHME"
+
+/* - tone synthesizer -                                         *\
+ * Beeps, sweeps and alerts without a clip, the CPU only loads   *
+ * them. The ULP adds the segment step to a 16 bit phase per     *
+ * sample and plays the wavetable entry of its top 5 bits, from  *
+ * the copy of the wave at the segment level. The phase runs on  *
+ * across segments, so a level or pitch change does not click.   *
+ * ulp_sound_tone_segments() turns tones into segments: attack   *
+ * and release are level steps, a sweep is split into pieces of  *
+ * ULPSOUND_TONE_SWEEP_MS. The step is rounded to 1/65536 of     *
+ * the measured rate, ulp_sound_tone_frequency() gives the       *
+\* pitch that plays.                                             */
+#define ULPSOUND_TONE_SWEEP_MS 4
+#define ULPSOUND_TONE_MAGIC 0x544F4E45 // "TONE", at ULPSOUND_CHIME_MAGIC_ADDR
+
+typedef struct
+{
+	float freq_start_hz; // 0 for a pause
+	float freq_end_hz;	 // linear sweep, freq_start_hz for a steady tone
+	uint16_t duration_ms;
+	uint8_t level;		 // up to ULPSOUND_TONE_LEVELS - 1, 3 dB steps
+	uint8_t attack_ms;	 // ramp from silence, within the duration
+	uint8_t release_ms;	 // ramp back to silence, within the duration
+} ulp_sound_tone_t;
+
+typedef struct
+{
+	const ulp_sound_tone_t *tones;
+	size_t count;
+	const int8_t *wave; // one period of ULPSOUND_TONE_WAVE_LEN samples around 0, NULL for a sine
+	uint32_t sampling_rate;
+	int8_t amp_shutdown_rtc_io; // RTC IO driven high once the tones ended, -1 for none
+} ulp_sound_tone_config_t;
 
 typedef struct
 {
+	const uint8_t *samples; // 8 bit unsigned
+	size_t len;				// up to ULPSOUND_NIBBLE_BUFF_LEN * 2
+	uint32_t sampling_rate;
+	int8_t amp_shutdown_rtc_io; // RTC IO driven high once the clip ended, -1 for none
+} ulp_sound_chime_config_t;
+
+/* - FIFO telemetry -                                           *\
+ * The ULP counts its laps of the buffer at ULPSOUND_WRAP_ADDR,  *
+ * with the index this gives the absolute read position, so an   *
+ * underrun (the ULP passing the writer and replaying an older   *
+ * lap) is told apart from a nearly full FIFO. Updated by        *
+\* ulp_sound_get_buffer_diff(), once per refill.                  */
+typedef struct
+{
+	uint32_t laps;			 // ULP laps of the buffer
+	uint32_t underruns;		 // refills that found the ULP past the last written word
+	uint32_t underrun_words; // words the ULP played before they were written
+	uint32_t overruns;		 // refills that found the FIFO full, the producer was ahead
+	uint16_t min_headroom;	 // fewest written words ahead of the ULP, UINT16_MAX before the first refill
+} ulp_sound_telemetry_t;
+
+/* - playback position -                                        *\
+ * In index units: samples, or frames for STEREO and BRIDGED,    *
+ * counted since init with the prefilled lap of silence. PAIR    *
+ * and COMPACT publish the next word as soon as they loaded the  *
+\* current one, played runs up to one sample ahead of the DAC.   */
+typedef sound_sink_position_t ulp_sound_position_t;
+
+typedef struct
+{
+	uint32_t sampling_rate;
+	ulp_sound_program_t program;
+	uint16_t wake_watermark;	// FIFO word, see ULPSOUND_WAKE_HALF
+	int8_t amp_shutdown_rtc_io; // RTC IO driven low while playing and high to shut the amp down, -1 leaves it to the caller
+	uint16_t ramp_ms;			// DAC ramp from 0 to midscale at init and to the end of ulp_sound_stop(), 0 for none
+	uint16_t mute_after_ms;		// silence after which the amp is shut down, 0 never, needs amp_shutdown_rtc_io
+	ulp_sound_end_t end;		// where ulp_sound_stop() leaves the DAC
+	bool wake_at_end;			// the ULP WAKEs the CPU once it played the last word
+} ulp_sound_config_t;
+
+#define ULPSOUND_DEFAULT_CONFIG(rate)         \
+	{                                         \
+		.sampling_rate = (rate),              \
+		.program = ULPSOUND_PROGRAM_PAIR,     \
+		.wake_watermark = ULPSOUND_WAKE_HALF, \
+		.amp_shutdown_rtc_io = -1,            \
+		.ramp_ms = 0,                         \
+		.mute_after_ms = 0,                   \
+		.end = ULPSOUND_END_FLOOR,            \
+		.wake_at_end = false,                 \
+	}
+
+typedef enum
+{
+	ULPSOUND_AMP_ON = 0,
+	ULPSOUND_AMP_MUTING,   // the watermark slot shuts the amp down at amp_event_pos
+	ULPSOUND_AMP_MUTED,	   // shut down during silence, the next sound enables it
+	ULPSOUND_AMP_STOPPING, // ulp_sound_stop() armed, the ULP halts at amp_event_pos
+} ulp_sound_amp_t;
+
+typedef struct
+{
+	ulp_sound_program_t program;
+	uint16_t buff_len;	 // words of audio buffer used by the program
+	uint8_t index_shift; // index tracker counts samples, log2 of the samples per word, or words (0)
+	uint16_t wake_watermark;
 	uint16_t last_filled_word;
+	uint16_t read_wraps;  // wrap counter at the last poll
+	uint32_t read_laps;	  // wrap counter extended past 16 bits
+	uint64_t read_pos;	  // words the ULP moved past, across laps
+	uint64_t write_pos;	  // words written, the prefill counts as the first lap
+	uint64_t stale_words; // words played before they were written, never reset
+	uint8_t read_sub;	  // index bits below the word of the last poll, SINGLE and DPCM only
+	ulp_sound_telemetry_t telemetry;
+	uint8_t dpcm_value;	  // the sample the ULP holds once it played every nibble written
+	uint8_t dpcm_base;	  // dpcm_value before the pending word
+	uint8_t dpcm_nibbles; // encoded into dpcm_word and not yet in the FIFO
+	uint16_t dpcm_word;
+	int8_t amp_shutdown_rtc_io;
+	ulp_sound_amp_t amp;
+	uint16_t ramp_words;
+	uint32_t mute_words;	   // 0 never mutes
+	uint64_t silence_start;	   // first word of the silent run the writer ends with
+	uint64_t amp_event_pos;	   // word the watermark slot acts at, MUTING and STOPPING only
+	uint32_t watermark_insn;   // what the watermark slot runs while playing, WAKE or its stand in
+	ulp_sound_end_t end;
+	bool wake_at_end;
+	uint16_t end_flag_addr;	   // RTC_SLOW_MEM word the epilogue stores its own address to, STOPPING only
+
+	bool curve_enabled; // curve replaces the identity, kept across init
+	bool cpu_curve;		// the program cannot apply it, ulp_sound_write() maps the samples
+	uint8_t curve[256];
 	uint32_t sampling_rate;
+	uint32_t target_sampling_rate;
+	uint32_t rtc_fast_freq_hz;
+	uint32_t delay_time;
+	uint16_t delay_frac;	// 1/65536 cycles on top of delay_time
+	uint16_t dither_count;	// long entries in the dither pattern
+	uint16_t dither_error;	// 1/65536 entries carried to the next recal tick
+	uint32_t next_sampling_rate;
+	uint64_t next_rate_pos; // word the rate changes at, see ulp_sound_follow(), 0 for none
+
+	ulp_clock_t clock;
+	esp_timer_handle_t recal_timer;
+	portMUX_TYPE recal_lock; // the recal tick against the player task, set up with the timer
+	bool recal_running;		 // ticks update only while set, changed under recal_lock
+	int64_t recal_last_us;
+	uint16_t recal_last_index;
 } ulp_sound_t;
 
+// the ULP as a sound sink, each start inits it with config at the source rate and starts the recal timer
+typedef struct
+{
+	sound_sink_t sink;
+	ulp_sound_t *ulp;
+	ulp_sound_config_t config;
+} ulp_sound_sink_t;
+
+uint16_t ulp_sound_program_cycles(ulp_sound_program_t program);
+uint8_t ulp_sound_program_channels(ulp_sound_program_t program);
+bool ulp_sound_program_uses_dac2(ulp_sound_program_t program);
+// bits below the DAC LSB a FIFO word carries, 0 for the byte programs fed by ulp_sound_write()
+uint8_t ulp_sound_program_fraction_bits(ulp_sound_program_t program);
+void ulp_sound_build_program(uint32_t *mem, ulp_sound_program_t program, uint32_t delay_time, uint16_t wake_watermark);
+void ulp_sound_build_chime(uint32_t *mem, uint32_t delay_time, uint16_t len, int8_t amp_shutdown_rtc_io);
+// program, DAC table and the wave at every level, with an empty segment list
+void ulp_sound_build_tone(uint32_t *mem, uint32_t delay_time, const int8_t *wave, int8_t amp_shutdown_rtc_io);
+// phase step of freq_hz at sampling_rate, rounded, 0 at or above half the rate
+uint16_t ulp_sound_tone_step(float freq_hz, uint32_t sampling_rate);
+float ulp_sound_tone_frequency(uint16_t step, uint32_t sampling_rate);
+// writes the segment list of the tones at sampling_rate into mem, returns the segments, 0 if they do not fit
+size_t ulp_sound_tone_segments(uint32_t *mem, const ulp_sound_tone_t *tones, size_t count, uint32_t sampling_rate);
+// delay_frac: 1/65536 cycles on top of delay_time, rounded by programs that cannot dither
+void ulp_sound_write_delay(uint32_t *mem, ulp_sound_program_t program, uint32_t delay_time, uint16_t delay_frac);
+bool ulp_sound_write_curve(uint32_t *mem, ulp_sound_program_t program, const uint8_t *curve);
 void ulp_sound_init(ulp_sound_t *ulp, uint32_t target_sampling_rate);
+void ulp_sound_init_with_config(ulp_sound_t *ulp, const ulp_sound_config_t *config);
+void ulp_sound_sink_init(ulp_sound_sink_t *ulp_sink, ulp_sound_t *ulp, ulp_sound_program_t program);
+bool ulp_sound_chime_load(ulp_sound_t *ulp, const ulp_sound_chime_config_t *chime);
+bool ulp_sound_chime_is_loaded(void);
+void ulp_sound_chime_play(void);
+bool ulp_sound_tone_load(ulp_sound_t *ulp, const ulp_sound_tone_config_t *tone);
+bool ulp_sound_tone_is_loaded(void);
+void ulp_sound_tone_play(void);
 uint16_t ulp_sound_get_buffer_diff(ulp_sound_t *ulp);
+void ulp_sound_get_position(ulp_sound_t *ulp, ulp_sound_position_t *position);
+uint64_t ulp_sound_samples_to_us(ulp_sound_t *ulp, uint64_t samples);
+void ulp_sound_get_telemetry(ulp_sound_t *ulp, ulp_sound_telemetry_t *telemetry, bool reset);
 void ulp_sound_refill(ulp_sound_t *ulp, uint16_t packed_dual_sample);
+// packs samples two per word, low byte first, up to the free FIFO space, or encodes them four per word for
+// DPCM, up to three of them wait for the rest of their word. Returns the samples written, always even,
+// the rest has to be offered again
+size_t ulp_sound_write(ulp_sound_t *ulp, const uint8_t *samples, size_t len);
+// one sample per word for OVERSAMPLED: code | fraction << 8, the code must stay below 255 while the fraction is set
+// returns the words written, up to the free FIFO space
+size_t ulp_sound_write_words(ulp_sound_t *ulp, const uint16_t *words, size_t len);
+// ends the stream after the last word written as config end says, then the ULP shuts the amp down and
+// halts on its own. Returns false while the FIFO has no room for the end, call again after the next wake.
+// Nothing may be written after it
+bool ulp_sound_stop(ulp_sound_t *ulp);
+// the ULP played the end ulp_sound_stop() wrote and halted
+bool ulp_sound_is_done(ulp_sound_t *ulp);
+// from the read position to the halt, 0 once done or before ulp_sound_stop()
+uint64_t ulp_sound_us_to_end(ulp_sound_t *ulp);
+
+// another stream continues at position, as ulp_sound_get_position() counts, at target_sampling_rate. The rate
+// changes at the first refill after the ULP reached that word, by patching the delay words only. False while
+// another change waits or after ulp_sound_stop()
+bool ulp_sound_follow(ulp_sound_t *ulp, uint32_t target_sampling_rate, uint64_t position);
+// at once, from the last measured RTC clock, the program and the FIFO stay
+void ulp_sound_set_sampling_rate(ulp_sound_t *ulp, uint32_t target_sampling_rate);
+void ulp_sound_set_delay(ulp_sound_t *ulp, uint32_t delay_time, uint16_t delay_frac);
+// between two words or frames, blocks for about two word times, NULL for identity
+void ulp_sound_set_curve(ulp_sound_t *ulp, const uint8_t *curve);
+void ulp_sound_curve_gain(uint8_t *curve, float gain);
+void ulp_sound_recal_start(ulp_sound_t *ulp);
+void ulp_sound_recal_stop(ulp_sound_t *ulp);
 
 void ulp_sound_lightsleep_delay(uint64_t time_in_us);
+void ulp_sound_lightsleep_until_wake(ulp_sound_t *ulp);
 
 void ulp_print_status();
 void ulp_print_mem(const void *ptr, size_t len);
\ No newline at end of file
@@ -0,0 +1,117 @@
+#include <string.h>
+
+#include "wavSink.h"
+
+static void wav_sink_put_u16(uint8_t *p, uint16_t v)
+{
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void wav_sink_put_u32(uint8_t *p, uint32_t v)
+{
+	wav_sink_put_u16(p, v & 0xFFFF);
+	wav_sink_put_u16(p + 2, v >> 16);
+}
+
+// RIFF header of a PCM file with data_len bytes of 8 bit samples
+static void wav_sink_write_header(wav_sink_t *wav, uint32_t data_len)
+{
+	uint8_t header[WAV_SINK_HEADER_LEN];
+	memcpy(header, "RIFF", 4);
+	wav_sink_put_u32(header + 4, WAV_SINK_HEADER_LEN - 8 + data_len);
+	memcpy(header + 8, "WAVEfmt ", 8);
+	wav_sink_put_u32(header + 16, 16);
+	wav_sink_put_u16(header + 20, 1); // PCM
+	wav_sink_put_u16(header + 22, wav->channels);
+	wav_sink_put_u32(header + 24, wav->sampling_rate);
+	wav_sink_put_u32(header + 28, wav->sampling_rate * wav->channels);
+	wav_sink_put_u16(header + 32, wav->channels);
+	wav_sink_put_u16(header + 34, 8);
+	memcpy(header + 36, "data", 4);
+	wav_sink_put_u32(header + 40, data_len);
+	fseek(wav->file, 0, SEEK_SET);
+	fwrite(header, 1, sizeof(header), wav->file);
+}
+
+static void wav_sink_start(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	wav_sink_t *wav = ctx;
+	wav->sampling_rate = sampling_rate;
+	wav->samples = 0;
+	// reopened empty, a longer stream of an earlier start would be left behind the new one
+	if (wav->file != NULL)
+		wav->file = freopen(wav->path, "wb", wav->file);
+	if (wav->file != NULL)
+		wav_sink_write_header(wav, 0);
+	layout->channels = wav->channels;
+	layout->dual = wav->channels == 2;
+	layout->fraction_bits = 0;
+}
+
+static uint16_t wav_sink_get_buffer_diff(void *ctx)
+{
+	return WAV_SINK_WORDS;
+}
+
+static size_t wav_sink_write(void *ctx, const uint8_t *samples, size_t len)
+{
+	wav_sink_t *wav = ctx;
+	if (wav->file == NULL)
+		return 0;
+	len = fwrite(samples, 1, len & ~(size_t)1, wav->file) & ~(size_t)1;
+	wav->samples += len;
+	return len;
+}
+
+static void wav_sink_get_position(void *ctx, sound_sink_position_t *position)
+{
+	wav_sink_t *wav = ctx;
+	position->played = wav->samples / wav->channels;
+	position->written = position->played;
+	position->stale = 0;
+	position->latency_us = 0;
+}
+
+static uint64_t wav_sink_samples_to_us(void *ctx, uint64_t samples)
+{
+	wav_sink_t *wav = ctx;
+	if (wav->sampling_rate == 0)
+		return 0;
+	return samples * 1000000 / wav->sampling_rate;
+}
+
+static bool wav_sink_follow(void *ctx, uint32_t sampling_rate, uint64_t position)
+{
+	return sampling_rate == ((wav_sink_t *)ctx)->sampling_rate; // the header holds one rate
+}
+
+static const sound_sink_ops_t wav_sink_ops = {
+	.start = wav_sink_start,
+	.get_buffer_diff = wav_sink_get_buffer_diff,
+	.write = wav_sink_write,
+	.get_position = wav_sink_get_position,
+	.samples_to_us = wav_sink_samples_to_us,
+	.follow = wav_sink_follow,
+};
+
+bool wav_sink_open(wav_sink_t *wav, const char *path, uint8_t channels)
+{
+	wav->sink.ops = &wav_sink_ops;
+	wav->sink.ctx = wav;
+	wav->channels = channels == 2 ? 2 : 1;
+	wav->sampling_rate = 0;
+	wav->samples = 0;
+	wav->path = path;
+	wav->file = fopen(path, "wb");
+	return wav->file != NULL;
+}
+
+void wav_sink_close(wav_sink_t *wav)
+{
+	if (wav->file == NULL)
+		return;
+	wav_sink_write_header(wav, wav->samples);
+	fclose(wav->file);
+	wav->file = NULL;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "soundSink.h"
+
+/* - WAV file sink -                                            *\
+ * Writes the samples as 8 bit unsigned PCM, the format the DAC  *
+ * plays, so two renders can be compared byte for byte. Takes    *
+ * WAV_SINK_WORDS words per refill, each start rewrites the file *
+ * from the header, a stream following at the same rate appends, *
+\* wav_sink_close() fills in the sizes.                          */
+#define WAV_SINK_WORDS 1024
+#define WAV_SINK_HEADER_LEN 44
+
+typedef struct
+{
+	sound_sink_t sink;
+	FILE *file; // NULL once a start could not reopen it, writes take nothing then
+	const char *path;
+	uint8_t channels;
+	uint32_t sampling_rate;
+	uint64_t samples;
+} wav_sink_t;
+
+// path is kept until wav_sink_close(), each start reopens the file
+bool wav_sink_open(wav_sink_t *wav, const char *path, uint8_t channels);
+void wav_sink_close(wav_sink_t *wav);
@@ -0,0 +1,201 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "flacEncode.h"
+
+typedef struct
+{
+	uint8_t *out;
+	size_t len;
+	size_t bits;
+	bool overflow;
+} bit_writer_t;
+
+static void bit_writer_put(bit_writer_t *w, uint64_t value, uint8_t bits)
+{
+	while (bits-- > 0)
+	{
+		size_t byte = w->bits >> 3;
+		if (byte >= w->len)
+		{
+			w->overflow = true;
+			return;
+		}
+		if ((w->bits & 7) == 0)
+			w->out[byte] = 0;
+		if ((value >> bits) & 1)
+			w->out[byte] |= 0x80 >> (w->bits & 7);
+		w->bits++;
+	}
+}
+
+static void bit_writer_align(bit_writer_t *w)
+{
+	while (w->bits & 7)
+		bit_writer_put(w, 0, 1);
+}
+
+static uint8_t flac_encode_crc8(const uint8_t *data, size_t len)
+{
+	uint8_t crc = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		crc ^= data[i];
+		for (uint8_t b = 0; b < 8; b++)
+			crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+	}
+	return crc;
+}
+
+static uint16_t flac_encode_crc16(const uint8_t *data, size_t len)
+{
+	uint16_t crc = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+		for (uint8_t b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+	}
+	return crc;
+}
+
+// frame number in the UTF-8 like code of the frame header
+static void flac_encode_utf8(bit_writer_t *w, uint32_t value)
+{
+	if (value < 0x80)
+	{
+		bit_writer_put(w, value, 8);
+		return;
+	}
+	uint8_t extra = (value < 0x800) ? 1 : (value < 0x10000) ? 2 : (value < 0x200000) ? 3 : (value < 0x4000000) ? 4 : 5;
+	uint8_t lead = (uint8_t)(0xFF00 >> (extra + 1));
+	bit_writer_put(w, lead | (value >> (6 * extra)), 8);
+	while (extra-- > 0)
+		bit_writer_put(w, 0x80 | ((value >> (6 * extra)) & 0x3F), 8);
+}
+
+// fixed order 2 prediction, residuals in one Rice partition
+static void flac_encode_subframe(bit_writer_t *w, const int32_t *x, uint32_t len, uint8_t bps)
+{
+	bit_writer_put(w, 0, 1);
+	bit_writer_put(w, 0x08 | 2, 6); // SUBFRAME_FIXED, order 2
+	bit_writer_put(w, 0, 1);		// no wasted bits
+	bit_writer_put(w, (uint32_t)x[0] & ((1UL << bps) - 1), bps);
+	bit_writer_put(w, (uint32_t)x[1] & ((1UL << bps) - 1), bps);
+	uint64_t sum = 0;
+	for (uint32_t i = 2; i < len; i++)
+	{
+		int32_t r = x[i] - 2 * x[i - 1] + x[i - 2];
+		sum += (r >= 0) ? (uint32_t)r << 1 : (((uint32_t)-r) << 1) - 1;
+	}
+	uint32_t mean = (len > 2) ? sum / (len - 2) : 0;
+	uint8_t k = 0;
+	while ((k < 14) && ((2UL << k) <= mean + 1))
+		k++;
+	bit_writer_put(w, 0, 2); // RICE
+	bit_writer_put(w, 0, 4); // partition order 0
+	bit_writer_put(w, k, 4);
+	for (uint32_t i = 2; i < len; i++)
+	{
+		int32_t r = x[i] - 2 * x[i - 1] + x[i - 2];
+		uint32_t u = (r >= 0) ? (uint32_t)r << 1 : (((uint32_t)-r) << 1) - 1;
+		for (uint32_t q = u >> k; q > 0; q--)
+			bit_writer_put(w, 0, 1);
+		bit_writer_put(w, 1, 1);
+		bit_writer_put(w, u & ((1UL << k) - 1), k);
+	}
+}
+
+size_t flac_encode(uint8_t *out, size_t out_len, const int16_t *samples, uint32_t frames, uint8_t channels, uint32_t sampling_rate)
+{
+	bit_writer_t w = {.out = out, .len = out_len};
+	bit_writer_put(&w, 0x664C6143, 32); // "fLaC"
+	bit_writer_put(&w, 0x80, 8);		// last metadata block, STREAMINFO
+	bit_writer_put(&w, 34, 24);
+	bit_writer_put(&w, FLAC_ENCODE_BLOCK_LEN, 16);
+	bit_writer_put(&w, FLAC_ENCODE_BLOCK_LEN, 16);
+	bit_writer_put(&w, 0, 24); // frame sizes unknown
+	bit_writer_put(&w, 0, 24);
+	bit_writer_put(&w, sampling_rate, 20);
+	bit_writer_put(&w, channels - 1, 3);
+	bit_writer_put(&w, 15, 5);
+	bit_writer_put(&w, frames, 36);
+	bit_writer_put(&w, 0, 64); // no MD5
+	bit_writer_put(&w, 0, 64);
+
+	static const uint8_t assignments[] = {1, 8, 9, 10};
+	int32_t *a = malloc(FLAC_ENCODE_BLOCK_LEN * sizeof(int32_t));
+	int32_t *b = malloc(FLAC_ENCODE_BLOCK_LEN * sizeof(int32_t));
+	uint32_t frame = 0;
+	for (uint32_t pos = 0; pos < frames; pos += FLAC_ENCODE_BLOCK_LEN, frame++)
+	{
+		uint32_t len = (frames - pos < FLAC_ENCODE_BLOCK_LEN) ? frames - pos : FLAC_ENCODE_BLOCK_LEN;
+		uint8_t assignment = (channels == 1) ? 0 : assignments[frame % 4];
+		size_t header = w.bits >> 3;
+		bit_writer_put(&w, 0x3FFE, 14);
+		bit_writer_put(&w, 0, 2); // fixed block size
+		bit_writer_put(&w, 7, 4); // 16 bit block size - 1 after the header
+		bit_writer_put(&w, 0, 4); // sampling rate of the STREAMINFO
+		bit_writer_put(&w, assignment, 4);
+		bit_writer_put(&w, 4, 3); // 16 bit
+		bit_writer_put(&w, 0, 1);
+		flac_encode_utf8(&w, frame);
+		bit_writer_put(&w, len - 1, 16);
+		if (w.overflow)
+			break;
+		bit_writer_put(&w, flac_encode_crc8(out + header, (w.bits >> 3) - header), 8);
+
+		if (channels == 1)
+		{
+			for (uint32_t i = 0; i < len; i++)
+				a[i] = samples[pos + i];
+			flac_encode_subframe(&w, a, len, 16);
+		}
+		else
+		{
+			const int16_t *s = samples + (size_t)pos * 2;
+			for (uint32_t i = 0; i < len; i++)
+			{
+				int32_t l = s[i * 2], r = s[i * 2 + 1];
+				switch (assignment)
+				{
+				case 1:
+					a[i] = l, b[i] = r;
+					break;
+				case 8:
+					a[i] = l, b[i] = l - r;
+					break;
+				case 9:
+					a[i] = l - r, b[i] = r;
+					break;
+				default:
+					a[i] = (l + r) >> 1, b[i] = l - r;
+					break;
+				}
+			}
+			flac_encode_subframe(&w, a, len, (assignment == 9) ? 17 : 16);
+			flac_encode_subframe(&w, b, len, ((assignment == 8) || (assignment == 10)) ? 17 : 16);
+		}
+		bit_writer_align(&w);
+		if (w.overflow)
+			break;
+		size_t end = w.bits >> 3;
+		bit_writer_put(&w, flac_encode_crc16(out + header, end - header), 16);
+	}
+	free(a);
+	free(b);
+	return w.overflow ? 0 : w.bits >> 3;
+}
+
+void flac_encode_test_signal(int16_t *samples, uint32_t frames, uint8_t channels)
+{
+	uint32_t noise = 1;
+	for (uint32_t i = 0; i < frames; i++)
+		for (uint8_t c = 0; c < channels; c++)
+		{
+			noise = noise * 1103515245 + 12345;
+			samples[(size_t)i * channels + c] = (int16_t)((c ? 9000 : 12000) * sin(i * (c ? 0.047 : 0.031) + c) + (int32_t)((noise >> 16) % 601) - 300);
+		}
+}
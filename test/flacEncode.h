@@ -0,0 +1,18 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* - test FLAC encoder -                                        *\
+ * Writes a valid FLAC stream for the host tests: STREAMINFO,    *
+ * then frames of fixed order 2 subframes with one Rice          *
+ * partition. Stereo frames cycle through the independent, left- *
+ * side, right-side and mid-side assignments so every decoder    *
+\* path runs. 16 bit samples, frames of FLAC_ENCODE_BLOCK_LEN.  */
+
+#define FLAC_ENCODE_BLOCK_LEN 1152
+
+// samples interleaved by channel, at least two frames in the last block, returns the stream length, 0 if out_len is too small
+size_t flac_encode(uint8_t *out, size_t out_len, const int16_t *samples, uint32_t frames, uint8_t channels, uint32_t sampling_rate);
+// the 16 bit test signal flac_encode() gets in the tests, a sine per channel with a little noise
+void flac_encode_test_signal(int16_t *samples, uint32_t frames, uint8_t channels);
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdbool.h>
+
+/* - host test checks -                                         *\
+ * A failed check prints where and why and the test goes on, the *
+\* exit code of host_test_result() tells CTest.                  */
+
+static unsigned host_test_checks;
+static unsigned host_test_failures;
+
+#define HOST_TEST_CHECK(cond, ...)                                   \
+	do                                                               \
+	{                                                                \
+		host_test_checks++;                                          \
+		if (!(cond))                                                 \
+		{                                                            \
+			host_test_failures++;                                    \
+			fprintf(stderr, "%s:%d: FAIL %s: ", __FILE__, __LINE__, #cond); \
+			fprintf(stderr, __VA_ARGS__);                            \
+			fprintf(stderr, "\n");                                   \
+		}                                                            \
+	} while (0)
+
+static inline int host_test_result(void)
+{
+	printf("%u checks, %u failed\n", host_test_checks, host_test_failures);
+	return host_test_failures ? 1 : 0;
+}
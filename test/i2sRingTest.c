@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostTest.h"
+#include "i2sRing.h"
+
+#define TEST_BUFFERS 8
+#define TEST_FRAMES 64 // per buffer
+#define TEST_STEPS 20000
+#define TEST_EVENT_QUEUE_LEN (TEST_BUFFERS * 2) // I2SSOUND_EVENT_QUEUE_LEN
+
+/* - mocked DMA and driver -                                        *\
+ * The legacy I2S driver as i2sRing models it, from the other side: *
+ * buffers hold frame numbers, the DMA plays one buffer per step,   *
+ * queues it as free and posts a TX done event, both queues drop    *
+ * their oldest entry when full. The writer fills one buffer from   *
+ * the free queue before it takes the next. Played frames are       *
+ * judged by content: a number below the next expected one is a     *
+ * replay from an older lap. The first lap holds the numbers the    *
+\* ring counts as written at init.                                  */
+typedef struct
+{
+	uint32_t frames[TEST_BUFFERS][TEST_FRAMES];
+	uint8_t dma;
+	uint8_t queue[TEST_BUFFERS];
+	uint8_t queue_head;
+	uint8_t queued;
+	int held; // buffer the writer fills, -1 for none
+	uint16_t fill;
+	uint32_t events; // TX done events waiting
+	uint32_t lost_events;
+	uint32_t next_frame; // next frame number the writer puts in
+	uint32_t expected;	 // next fresh frame number the DMA can play
+	uint64_t played;
+	uint64_t stale;
+	uint32_t underruns; // buffers that played stale frames
+} mock_t;
+
+static mock_t mock;
+static i2s_ring_t ring;
+
+static void mock_init(void)
+{
+	memset(&mock, 0, sizeof(mock));
+	for (uint32_t b = 0; b < TEST_BUFFERS; b++)
+		for (uint32_t f = 0; f < TEST_FRAMES; f++)
+			mock.frames[b][f] = b * TEST_FRAMES + f;
+	mock.held = -1;
+	mock.next_frame = TEST_BUFFERS * TEST_FRAMES;
+	// the DMA is into buffer 0 already
+	mock.expected = TEST_FRAMES;
+	mock.played = 0;
+}
+
+// the DMA finishes its buffer and starts the next
+static void mock_step(void)
+{
+	uint8_t finished = mock.dma;
+	mock.played += TEST_FRAMES;
+	if (mock.queued == TEST_BUFFERS - 1)
+	{
+		mock.queue_head = (mock.queue_head + 1) % TEST_BUFFERS;
+		mock.queued--;
+	}
+	mock.queue[(mock.queue_head + mock.queued) % TEST_BUFFERS] = finished;
+	mock.queued++;
+	if (mock.events == TEST_EVENT_QUEUE_LEN)
+		mock.lost_events++;
+	else
+		mock.events++;
+
+	mock.dma = (mock.dma + 1) % TEST_BUFFERS;
+	uint32_t stale = 0;
+	for (uint32_t f = 0; f < TEST_FRAMES; f++)
+	{
+		uint32_t frame = mock.frames[mock.dma][f];
+		if (frame < mock.expected)
+			stale++;
+		else
+			mock.expected = frame + 1;
+	}
+	mock.stale += stale;
+	mock.underruns += stale > 0;
+}
+
+// i2s_write() with no wait, returns the frames taken
+static uint32_t mock_write(uint32_t frames)
+{
+	uint32_t taken = 0;
+	while (taken < frames)
+	{
+		if ((mock.held < 0) || (mock.fill == TEST_FRAMES))
+		{
+			if (mock.queued == 0)
+				break;
+			mock.held = mock.queue[mock.queue_head];
+			mock.queue_head = (mock.queue_head + 1) % TEST_BUFFERS;
+			mock.queued--;
+			mock.fill = 0;
+		}
+		mock.frames[mock.held][mock.fill++] = mock.next_frame++;
+		taken++;
+	}
+	return taken;
+}
+
+static void drain_events(void)
+{
+	while (mock.events > 0)
+	{
+		mock.events--;
+		i2s_ring_done(&ring);
+	}
+}
+
+// one refill as i2sSound does it, up to want frames, returns true if the ring had to resync
+static bool refill(uint32_t want)
+{
+	drain_events();
+	uint32_t free_frames = i2s_ring_poll(&ring);
+	uint32_t frames = (want < free_frames) ? want : free_frames;
+	uint32_t taken = mock_write(frames);
+	i2s_ring_commit(&ring, taken);
+	if (taken < frames)
+	{
+		i2s_ring_resync(&ring);
+		return true;
+	}
+	return false;
+}
+
+static void check_match(const char *name)
+{
+	drain_events();
+	i2s_ring_telemetry_t telemetry;
+	i2s_ring_get_telemetry(&ring, &telemetry, false);
+	HOST_TEST_CHECK(i2s_ring_played(&ring) == mock.played, "%s: ring played %llu, DMA %llu", name, (unsigned long long)i2s_ring_played(&ring), (unsigned long long)mock.played);
+	HOST_TEST_CHECK(ring.write_pos == mock.next_frame, "%s: ring wrote %llu, driver took %u", name, (unsigned long long)ring.write_pos, mock.next_frame);
+	HOST_TEST_CHECK(ring.stale_frames == mock.stale, "%s: ring counts %llu stale frames, DMA played %llu", name, (unsigned long long)ring.stale_frames, (unsigned long long)mock.stale);
+	HOST_TEST_CHECK(telemetry.underruns == mock.underruns, "%s: ring counts %u underruns, DMA %u", name, telemetry.underruns, mock.underruns);
+	HOST_TEST_CHECK(telemetry.underrun_frames == mock.stale, "%s: telemetry counts %u stale frames, DMA played %llu", name, telemetry.underrun_frames, (unsigned long long)mock.stale);
+	HOST_TEST_CHECK(telemetry.laps == mock.played / TEST_FRAMES / TEST_BUFFERS, "%s: %u laps, DMA %llu", name, telemetry.laps, (unsigned long long)(mock.played / TEST_FRAMES / TEST_BUFFERS));
+}
+
+// a writer that keeps up: no underrun, the headroom stays above a lap less the buffer just finished
+static void test_steady(void)
+{
+	mock_init();
+	i2s_ring_init(&ring, TEST_BUFFERS, TEST_FRAMES);
+	uint32_t resyncs = 0;
+	for (uint32_t step = 0; step < TEST_STEPS; step++)
+	{
+		mock_step();
+		resyncs += refill(UINT32_MAX);
+	}
+	check_match("steady");
+	i2s_ring_telemetry_t telemetry;
+	i2s_ring_get_telemetry(&ring, &telemetry, true);
+	HOST_TEST_CHECK(mock.underruns == 0 && resyncs == 0 && telemetry.overruns == 0, "steady: %u underruns, %u resyncs, %u overruns", mock.underruns, resyncs, telemetry.overruns);
+	HOST_TEST_CHECK(telemetry.min_headroom == (TEST_BUFFERS - 2) * TEST_FRAMES, "steady: headroom down to %u frames", telemetry.min_headroom);
+	// a reset keeps the laps
+	i2s_ring_get_telemetry(&ring, &telemetry, false);
+	HOST_TEST_CHECK(telemetry.laps == TEST_STEPS / TEST_BUFFERS && telemetry.min_headroom == UINT32_MAX, "steady: after the reset %u laps, headroom %u", telemetry.laps, telemetry.min_headroom);
+}
+
+// refills of any size at random gaps, some longer than a lap: the ring counts what the DMA replays, partly
+// filled buffers included, while every event arrives
+static void test_jitter(void)
+{
+	mock_init();
+	i2s_ring_init(&ring, TEST_BUFFERS, TEST_FRAMES);
+	uint32_t resyncs = 0;
+	for (uint32_t step = 0; step < TEST_STEPS; step++)
+	{
+		mock_step();
+		if (rand() % 3 == 0)
+			continue;
+		uint32_t refills = 1 + rand() % 3;
+		for (uint32_t i = 0; i < refills; i++)
+			resyncs += refill(rand() % (TEST_FRAMES * 3));
+		// longer than a lap, within what the event queue holds
+		if (rand() % 200 == 0)
+			for (uint32_t i = 0; i < TEST_BUFFERS + 2; i++)
+				mock_step();
+	}
+	check_match("jitter");
+	HOST_TEST_CHECK(mock.underruns > 0 && mock.lost_events == 0 && resyncs == 0, "jitter: %u underruns, %u lost events, %u resyncs", mock.underruns, mock.lost_events, resyncs);
+}
+
+// a writer asleep longer than the event queue lasts: the ring missed buffers the driver freed, it resyncs
+// when the driver takes fewer frames than counted, and from there nothing the writer puts in is lost
+static void test_lost_events(void)
+{
+	mock_init();
+	i2s_ring_init(&ring, TEST_BUFFERS, TEST_FRAMES);
+	uint32_t resyncs = 0;
+	for (uint32_t step = 0; step < TEST_STEPS / 2; step++)
+	{
+		mock_step();
+		if (step % 50 == 0)
+			for (uint32_t i = 0; i < TEST_EVENT_QUEUE_LEN * 2; i++)
+				mock_step();
+		resyncs += refill(UINT32_MAX);
+	}
+	HOST_TEST_CHECK(mock.lost_events > 0, "lost events: none lost");
+	HOST_TEST_CHECK(i2s_ring_played(&ring) + (uint64_t)mock.lost_events * TEST_FRAMES == mock.played, "lost events: ring played %llu, DMA %llu, %u events lost", (unsigned long long)i2s_ring_played(&ring), (unsigned long long)mock.played, mock.lost_events);
+	HOST_TEST_CHECK(ring.write_pos == mock.next_frame, "lost events: ring wrote %llu, driver took %u", (unsigned long long)ring.write_pos, mock.next_frame);
+
+	// steady again, once resynced the ring never asks for more than the driver has
+	uint64_t stale = mock.stale;
+	uint32_t late_resyncs = 0;
+	for (uint32_t step = 0; step < TEST_STEPS / 2; step++)
+	{
+		mock_step();
+		late_resyncs += (step > TEST_BUFFERS) && refill(UINT32_MAX);
+	}
+	HOST_TEST_CHECK(late_resyncs == 0, "lost events: %u resyncs after the writer caught up", late_resyncs);
+	HOST_TEST_CHECK(mock.stale - stale <= TEST_BUFFERS * TEST_FRAMES, "lost events: %llu stale frames after the writer caught up", (unsigned long long)(mock.stale - stale));
+	HOST_TEST_CHECK(mock.expected + (TEST_BUFFERS - 1) * TEST_FRAMES >= mock.next_frame, "lost events: frame %u plays, %u written", mock.expected, mock.next_frame);
+}
+
+int main(void)
+{
+	srand(1);
+	test_steady();
+	test_jitter();
+	test_lost_events();
+	return host_test_result();
+}
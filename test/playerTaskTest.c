@@ -0,0 +1,327 @@
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "flacEncode.h"
+#include "hostTest.h"
+#include "playerTask.h"
+
+#define TEST_RATE 44100
+#define TEST_FRAMES 22050	   // half a second
+#define TEST_FIFO_WORDS 1024   // about 46 ms
+#define TEST_COMMANDS 20000	   // in the stress run
+#define TEST_TIMEOUT_US 20000000 // for the task to go idle, generous under the sanitizer
+#define TEST_TAIL_US 20000		 // the sink plays out this long after its end, a ramp
+
+/* - clocked sink -                                              *\
+ * A mono FIFO of TEST_FIFO_WORDS that plays at its rate on the  *
+ * monotonic clock from its start, so the player task sleeps and *
+ * refills as on the chip. Run dry it waits for the next write,  *
+ * counting what it missed. Its end needs the FIFO played out,   *
+ * then it is done TEST_TAIL_US later. Only the player task      *
+\* calls it, the test reads it once the task is idle.            */
+typedef struct
+{
+	sound_sink_t sink;
+	uint32_t rate;
+	int64_t start_us; // when sample 0 played, moved on by an underrun
+	uint64_t written;
+	uint64_t played;
+	uint64_t underrun_samples;
+	uint64_t cut_samples; // written but not played when a start dropped them
+	uint32_t starts;
+	uint32_t ends;
+	int64_t end_us; // when it took its end
+} clocked_sink_t;
+
+static void clocked_sink_update(clocked_sink_t *sink)
+{
+	int64_t now = esp_timer_get_time();
+	sink->played = (uint64_t)(now - sink->start_us) * sink->rate / 1000000;
+	if (sink->played > sink->written)
+	{
+		sink->underrun_samples += sink->played - sink->written;
+		sink->start_us = now - (int64_t)(sink->written * 1000000 / sink->rate);
+		sink->played = sink->written;
+	}
+}
+
+static void clocked_sink_start(void *ctx, uint32_t sampling_rate, sound_sink_layout_t *layout)
+{
+	clocked_sink_t *sink = ctx;
+	if (sink->starts > 0)
+	{
+		clocked_sink_update(sink);
+		sink->cut_samples += sink->written - sink->played;
+	}
+	sink->rate = sampling_rate;
+	sink->start_us = esp_timer_get_time();
+	sink->written = 0;
+	sink->played = 0;
+	sink->starts++;
+	layout->channels = 1;
+	layout->dual = false;
+	layout->fraction_bits = 0;
+}
+
+static uint16_t clocked_sink_get_buffer_diff(void *ctx)
+{
+	clocked_sink_t *sink = ctx;
+	clocked_sink_update(sink);
+	return TEST_FIFO_WORDS - (sink->written - sink->played + 1) / 2;
+}
+
+static size_t clocked_sink_write(void *ctx, const uint8_t *samples, size_t len)
+{
+	clocked_sink_t *sink = ctx;
+	size_t words = clocked_sink_get_buffer_diff(sink);
+	if (words > len / 2)
+		words = len / 2;
+	sink->written += words * 2;
+	return words * 2;
+}
+
+static void clocked_sink_get_position(void *ctx, sound_sink_position_t *position)
+{
+	clocked_sink_t *sink = ctx;
+	clocked_sink_update(sink);
+	position->played = sink->played;
+	position->written = sink->written;
+	position->stale = 0;
+	position->latency_us = (sink->written - sink->played) * 1000000 / sink->rate;
+}
+
+static uint64_t clocked_sink_samples_to_us(void *ctx, uint64_t samples)
+{
+	return samples * 1000000 / ((clocked_sink_t *)ctx)->rate;
+}
+
+static bool clocked_sink_follow(void *ctx, uint32_t sampling_rate, uint64_t position)
+{
+	((clocked_sink_t *)ctx)->rate = sampling_rate;
+	return true;
+}
+
+static bool clocked_sink_end(void *ctx)
+{
+	clocked_sink_t *sink = ctx;
+	clocked_sink_update(sink);
+	if (sink->played < sink->written)
+		return false;
+	sink->ends++;
+	sink->end_us = esp_timer_get_time();
+	return true;
+}
+
+static bool clocked_sink_is_done(void *ctx)
+{
+	return esp_timer_get_time() >= ((clocked_sink_t *)ctx)->end_us + TEST_TAIL_US;
+}
+
+static const sound_sink_ops_t clocked_sink_ops = {
+	.start = clocked_sink_start,
+	.get_buffer_diff = clocked_sink_get_buffer_diff,
+	.write = clocked_sink_write,
+	.get_position = clocked_sink_get_position,
+	.samples_to_us = clocked_sink_samples_to_us,
+	.follow = clocked_sink_follow,
+	.end = clocked_sink_end,
+	.is_done = clocked_sink_is_done,
+};
+
+// a sink that starts over for every file and is done with its end
+static const sound_sink_ops_t clocked_sink_restart_ops = {
+	.start = clocked_sink_start,
+	.get_buffer_diff = clocked_sink_get_buffer_diff,
+	.write = clocked_sink_write,
+	.get_position = clocked_sink_get_position,
+	.samples_to_us = clocked_sink_samples_to_us,
+	.end = clocked_sink_end,
+};
+
+static int16_t pcm[TEST_FRAMES];
+static uint8_t flac_file[TEST_FRAMES * 4];
+static size_t flac_file_len;
+static clocked_sink_t sink;
+static flac_player_t player;
+static player_task_t player_task;
+static atomic_bool observing;
+
+static bool wait_idle(void)
+{
+	int64_t until = esp_timer_get_time() + TEST_TIMEOUT_US;
+	while (!player_task_is_idle(&player_task))
+	{
+		if (esp_timer_get_time() > until)
+			return false;
+		usleep(1000);
+	}
+	return true;
+}
+
+static void reset_counts(void)
+{
+	sink.starts = 0;
+	sink.ends = 0;
+	sink.underrun_samples = 0;
+	sink.cut_samples = 0;
+}
+
+// a plain play runs to the end, the sink ends once after the last sample played
+static void test_play(void)
+{
+	reset_counts();
+	player_task_play(&player_task, flac_file, flac_file_len);
+	HOST_TEST_CHECK(wait_idle(), "play: not idle after %d s", TEST_TIMEOUT_US / 1000000);
+	HOST_TEST_CHECK(sink.written == TEST_FRAMES && sink.played == sink.written, "play: %llu written, %llu played of %d", (unsigned long long)sink.written, (unsigned long long)sink.played, TEST_FRAMES);
+	HOST_TEST_CHECK(sink.starts == 1 && sink.ends == 1, "play: %u starts, %u ends", sink.starts, sink.ends);
+	// idle once the sink is done, at the end of the file
+	int64_t idle_us = esp_timer_get_time();
+	HOST_TEST_CHECK(idle_us >= sink.end_us + TEST_TAIL_US, "play: idle %lld us after the end", (long long)(idle_us - sink.end_us));
+	uint32_t position_ms = player_task_get_position_ms(&player_task);
+	HOST_TEST_CHECK(position_ms + 1 >= TEST_FRAMES * 1000 / TEST_RATE, "play: ends at %u ms of %d", position_ms, TEST_FRAMES * 1000 / TEST_RATE);
+}
+
+// enqueued while idle, the files follow each other on one start of the sink
+static void test_enqueue(void)
+{
+	reset_counts();
+	for (int i = 0; i < 3; i++)
+		player_task_enqueue(&player_task, flac_file, flac_file_len);
+	HOST_TEST_CHECK(wait_idle(), "enqueue: not idle after %d s", TEST_TIMEOUT_US / 1000000);
+	HOST_TEST_CHECK(sink.written == 3 * TEST_FRAMES, "enqueue: %llu written of %d", (unsigned long long)sink.written, 3 * TEST_FRAMES);
+	HOST_TEST_CHECK(sink.starts == 1 && sink.ends == 1, "enqueue: %u starts, %u ends", sink.starts, sink.ends);
+}
+
+// a sink that cannot follow plays each file out before the next one starts it over
+static void test_drain(void)
+{
+	reset_counts();
+	sink.sink.ops = &clocked_sink_restart_ops;
+	for (int i = 0; i < 3; i++)
+		player_task_enqueue(&player_task, flac_file, flac_file_len);
+	HOST_TEST_CHECK(wait_idle(), "drain: not idle after %d s", TEST_TIMEOUT_US / 1000000);
+	HOST_TEST_CHECK(sink.starts == 3 && sink.ends == 1, "drain: %u starts, %u ends", sink.starts, sink.ends);
+	HOST_TEST_CHECK(sink.cut_samples == 0, "drain: the starts cut %llu samples", (unsigned long long)sink.cut_samples);
+	HOST_TEST_CHECK(sink.written == TEST_FRAMES && sink.played == sink.written, "drain: %llu written, %llu played of the last file", (unsigned long long)sink.written, (unsigned long long)sink.played);
+	sink.sink.ops = &clocked_sink_ops;
+}
+
+// another thread reads what the player task publishes all along
+static void *observer(void *arg)
+{
+	uint32_t *reads = arg;
+	while (atomic_load(&observing))
+	{
+		player_task_state_t state = player_task_get_state(&player_task);
+		uint32_t position_ms = player_task_get_position_ms(&player_task);
+		if ((state <= PLAYER_TASK_DRAINING) && (position_ms <= TEST_FRAMES * 1000 / TEST_RATE + 1))
+			(*reads)++;
+		sched_yield();
+	}
+	return NULL;
+}
+
+// random commands as fast as the queue takes them, each is done once and the task ends up idle
+static void test_stress(void)
+{
+	reset_counts();
+	uint32_t sent_before = player_task.commands_sent;
+	uint32_t reads = 0, sent = 0, dropped = 0;
+	pthread_t observer_thread;
+	atomic_store(&observing, true);
+	pthread_create(&observer_thread, NULL, observer, &reads);
+	esp_log_level_set("*", ESP_LOG_ERROR); // the full queue and playlist warn on every drop
+	for (uint32_t i = 0; i < TEST_COMMANDS; i++)
+	{
+		bool sent_one;
+		switch (rand() % 6)
+		{
+		case 0:
+			sent_one = player_task_play(&player_task, flac_file, flac_file_len);
+			break;
+		case 1:
+			sent_one = player_task_enqueue(&player_task, flac_file, flac_file_len);
+			break;
+		case 2:
+			sent_one = player_task_stop(&player_task);
+			break;
+		case 3:
+			sent_one = player_task_pause(&player_task);
+			break;
+		case 4:
+			sent_one = player_task_resume(&player_task);
+			break;
+		default:
+			sent_one = player_task_seek(&player_task, rand() % (TEST_FRAMES * 1000 / TEST_RATE));
+			break;
+		}
+		if (sent_one)
+			sent++;
+		else
+		{
+			dropped++;
+			sched_yield();
+		}
+	}
+	while (!player_task_stop(&player_task))
+		sched_yield();
+	sent++;
+	HOST_TEST_CHECK(wait_idle(), "stress: not idle after %d s", TEST_TIMEOUT_US / 1000000);
+	esp_log_level_set("*", ESP_LOG_WARN);
+	atomic_store(&observing, false);
+	pthread_join(observer_thread, NULL);
+
+	uint32_t done = atomic_load(&player_task.commands_done);
+	HOST_TEST_CHECK(done == player_task.commands_sent && player_task.commands_sent - sent_before == sent, "stress: %u sent, %u counted, %u done", sent, player_task.commands_sent, done);
+	HOST_TEST_CHECK(player_task_get_state(&player_task) == PLAYER_TASK_IDLE, "stress: state %d", player_task_get_state(&player_task));
+	HOST_TEST_CHECK(sink.ends >= 1 && sink.played == sink.written, "stress: %u ends, %llu of %llu played", sink.ends, (unsigned long long)sink.played, (unsigned long long)sink.written);
+	HOST_TEST_CHECK(reads > 0, "stress: the observer read nothing sane");
+	printf("stress: %u commands sent, %u dropped as full, %u starts, %u observer reads\n", sent, dropped, sink.starts, reads);
+}
+
+// paused, the position holds while a seek waits, resumed it plays from there to the end
+static void test_pause_seek(void)
+{
+	reset_counts();
+	player_task_play(&player_task, flac_file, flac_file_len);
+	int64_t until = esp_timer_get_time() + TEST_TIMEOUT_US;
+	while ((player_task_get_position_ms(&player_task) < 100) && (esp_timer_get_time() < until))
+		usleep(1000);
+	player_task_pause(&player_task);
+	player_task_seek(&player_task, 300);
+	usleep(100000);
+	uint32_t paused_ms = player_task_get_position_ms(&player_task);
+	usleep(50000);
+	uint32_t still_ms = player_task_get_position_ms(&player_task);
+	HOST_TEST_CHECK(player_task_get_state(&player_task) == PLAYER_TASK_PAUSED && paused_ms == still_ms, "pause: state %d, at %u then %u ms", player_task_get_state(&player_task), paused_ms, still_ms);
+	player_task_resume(&player_task);
+	HOST_TEST_CHECK(wait_idle(), "pause: not idle after %d s", TEST_TIMEOUT_US / 1000000);
+	HOST_TEST_CHECK(sink.starts == 1 && sink.ends == 1, "pause: %u starts, %u ends", sink.starts, sink.ends);
+}
+
+int main(void)
+{
+	srand(1);
+	flac_encode_test_signal(pcm, TEST_FRAMES, 1);
+	flac_file_len = flac_encode(flac_file, sizeof(flac_file), pcm, TEST_FRAMES, 1, TEST_RATE);
+	HOST_TEST_CHECK(flac_file_len > 0, "the test file does not fit");
+
+	sink.sink.ops = &clocked_sink_ops;
+	sink.sink.ctx = &sink;
+	sink.rate = TEST_RATE;
+	flac_player_init(&player);
+	flac_player_link(&player, &sink.sink);
+	player_task_config_t config = PLAYER_TASK_DEFAULT_CONFIG();
+	HOST_TEST_CHECK(player_task_start(&player_task, &player, &config), "the task did not start");
+
+	test_play();
+	test_enqueue();
+	test_drain();
+	test_stress();
+	test_pause_seek();
+	return host_test_result();
+}
@@ -0,0 +1,102 @@
+#include <stdlib.h>
+
+#include "flacPlayer.h"
+#include "hostTest.h"
+#include "refillScheduler.h"
+
+#define TEST_SECONDS 60
+#define TEST_BLOCK FLAC_PLAYER_DECODE_BLOCK_LEN
+#define TEST_FLAC_FRAME 4096	 // samples between the costlier frame starts
+#define TEST_WAKE_MAX_US 2000	 // light sleep exit and timer jitter, within the guard
+#define TEST_FRAME_SPIKE_US 2000 // a frame start on top of its block
+
+/* - simulated sink and decoder -                                   *\
+ * A FIFO of fifo samples plays at rate from the start. Each refill  *
+ * wakes late by up to TEST_WAKE_MAX_US, then decodes blocks into    *
+ * the FIFO until it is full, the FIFO plays on meanwhile. A block   *
+ * costs cost(t) of its play time, +-10%, plus a spike at each FLAC  *
+\* frame start. Nothing but the scheduler picks the sleeps.          */
+typedef struct
+{
+	const char *name;
+	uint32_t rate;
+	uint32_t fifo;
+	double costs[3]; // fraction of real time in each third of the run
+	uint32_t max_sleep_us;
+} scenario_t;
+
+static double urand(void)
+{
+	return rand() / (double)RAND_MAX;
+}
+
+static void run(const scenario_t *scenario)
+{
+	const double sample_us = 1e6 / scenario->rate;
+	const double end_us = TEST_SECONDS * 1e6;
+	refill_scheduler_t scheduler;
+	refill_scheduler_init(&scheduler, FLAC_PLAYER_REFILL_GUARD_US, FLAC_PLAYER_MIN_SLEEP_US, scenario->max_sleep_us);
+
+	double now = 0, written = scenario->fifo, decoded = 0, least_headroom_us = 1e18, underrun_us = 0;
+	uint32_t sleep_us = 0, bad_sleeps = 0, max_sleeps = 0;
+	while (now < end_us)
+	{
+		now += sleep_us + TEST_WAKE_MAX_US * urand();
+		double cost = scenario->costs[(int)(now * 3 / end_us) % 3];
+		double headroom = written - now / sample_us;
+		if (headroom * sample_us < least_headroom_us)
+			least_headroom_us = headroom * sample_us;
+		refill_scheduler_begin(&scheduler, headroom > 0 ? headroom * sample_us : 0);
+
+		double start = now, before = written;
+		while (written - now / sample_us <= scenario->fifo - TEST_BLOCK)
+		{
+			now += TEST_BLOCK * sample_us * cost * (0.9 + 0.2 * urand());
+			if ((uint64_t)(decoded + TEST_BLOCK) / TEST_FLAC_FRAME != (uint64_t)decoded / TEST_FLAC_FRAME)
+				now += TEST_FRAME_SPIKE_US;
+			decoded += TEST_BLOCK;
+			// the block lands once decoded, a FIFO that ran dry plays the old lap meanwhile
+			double played = now / sample_us;
+			if (written < played)
+			{
+				underrun_us += (played - written) * sample_us;
+				written = played;
+			}
+			written += TEST_BLOCK;
+		}
+		double headroom_us = (written - now / sample_us) * sample_us;
+		sleep_us = refill_scheduler_end(&scheduler, now - start, (written - before) * sample_us, headroom_us);
+		if ((sleep_us != 0) && ((sleep_us < FLAC_PLAYER_MIN_SLEEP_US) || (sleep_us > scenario->max_sleep_us)))
+			bad_sleeps++;
+		max_sleeps += sleep_us == scenario->max_sleep_us;
+	}
+
+	refill_scheduler_telemetry_t telemetry;
+	refill_scheduler_get_telemetry(&scheduler, &telemetry, false);
+	HOST_TEST_CHECK(underrun_us == 0 && least_headroom_us > 0, "%s: %.1f ms of underrun, least headroom %.2f ms", scenario->name, underrun_us / 1000, least_headroom_us / 1000);
+	HOST_TEST_CHECK(bad_sleeps == 0, "%s: %u sleeps outside %u..%u us", scenario->name, bad_sleeps, FLAC_PLAYER_MIN_SLEEP_US, scenario->max_sleep_us);
+	// the sleep leaves the guard plus the refill cost of what it lets play, the wakeup is late by less
+	HOST_TEST_CHECK(least_headroom_us > FLAC_PLAYER_REFILL_GUARD_US - TEST_WAKE_MAX_US, "%s: headroom down to %.2f ms", scenario->name, least_headroom_us / 1000);
+	HOST_TEST_CHECK(telemetry.min_margin_us == (uint32_t)least_headroom_us, "%s: telemetry margin %u us, simulated %.0f us", scenario->name, telemetry.min_margin_us, least_headroom_us);
+	// sleeping is the point, most refills should end in one
+	HOST_TEST_CHECK(telemetry.sleeps * 10 >= telemetry.refills * 9, "%s: %u of %u refills slept", scenario->name, telemetry.sleeps, telemetry.refills);
+	if (scenario->max_sleep_us < FLAC_PLAYER_MAX_SLEEP_US)
+		HOST_TEST_CHECK(max_sleeps > 0, "%s: never slept the %u us maximum", scenario->name, scenario->max_sleep_us);
+}
+
+int main(void)
+{
+	srand(1);
+	// FIFO lengths of PAIR, COMPACT, DPCM and STEREO, the costs step up and back down
+	const scenario_t scenarios[] = {
+		{"PAIR 8 kHz", 8000, 2900, {0.05, 0.05, 0.05}, FLAC_PLAYER_MAX_SLEEP_US},
+		{"PAIR 44.1 kHz", 44100, 2900, {0.1, 0.5, 0.1}, FLAC_PLAYER_MAX_SLEEP_US},
+		{"COMPACT 22.05 kHz", 22050, 3796, {0.05, 0.3, 0.7}, FLAC_PLAYER_MAX_SLEEP_US},
+		{"DPCM 44.1 kHz", 44100, 5728, {0.2, 0.05, 0.6}, FLAC_PLAYER_MAX_SLEEP_US},
+		{"STEREO 44.1 kHz", 44100, 938, {0.1, 0.3, 0.1}, FLAC_PLAYER_MAX_SLEEP_US},
+		{"PAIR 8 kHz capped", 8000, 2900, {0.05, 0.2, 0.05}, 50000},
+	};
+	for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+		run(&scenarios[i]);
+	return host_test_result();
+}
@@ -0,0 +1,93 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "flacPlayer.h"
+#include "requantizer.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_UNIT "TSC cycles"
+static uint64_t bench_now(void)
+{
+	return __rdtsc();
+}
+#else
+#define BENCH_UNIT "ns"
+static uint64_t bench_now(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+#endif
+
+#define BENCH_BLOCK FLAC_PLAYER_DECODE_BLOCK_LEN // one decoded block, as flac_player_decode_block() hands it over
+#define BENCH_BLOCKS 2000						 // per timed run
+#define BENCH_RUNS 50							 // the fastest run counts, the others met interrupts or cold caches
+
+/* - requantizer cost -                                          *\
+ * Times the block kernels per output sample on blocks of the    *
+ * player's size, at -Os as the firmware builds. Noise, silence  *
+ * and a clipping square wave have to cost the same, the loop    *
+ * has no branches on the signal. Not a CTest, the figures are   *
+\* the ones requantizer.h quotes: ./requantizerBench             */
+
+typedef enum
+{
+	BENCH_STRIDE,
+	BENCH_STRIDE_PAIR, // both channels of an interleaved block, one call each
+	BENCH_FINE,
+} bench_kernel_t;
+
+static int32_t in[BENCH_BLOCK];
+static uint8_t out[BENCH_BLOCK];
+static uint16_t out_words[BENCH_BLOCK];
+
+static double bench(bench_kernel_t kernel)
+{
+	requantizer_t requantizer[2];
+	requantizer_init(&requantizer[0], 16);
+	requantizer_init(&requantizer[1], 16);
+	uint64_t best = UINT64_MAX;
+	for (int run = 0; run < BENCH_RUNS; run++)
+	{
+		uint64_t start = bench_now();
+		for (int block = 0; block < BENCH_BLOCKS; block++)
+		{
+			switch (kernel)
+			{
+			case BENCH_STRIDE:
+				requantizer_process_stride(&requantizer[0], in, out, BENCH_BLOCK, 1);
+				break;
+			case BENCH_STRIDE_PAIR:
+				requantizer_process_stride(&requantizer[0], in, out, BENCH_BLOCK, 2);
+				requantizer_process_stride(&requantizer[1], in + 1, out + 1, BENCH_BLOCK - 1, 2);
+				break;
+			case BENCH_FINE:
+				requantizer_process_fine(&requantizer[0], in, out_words, BENCH_BLOCK);
+				break;
+			}
+		}
+		uint64_t elapsed = bench_now() - start;
+		if (elapsed < best)
+			best = elapsed;
+	}
+	return (double)best / ((double)BENCH_BLOCKS * BENCH_BLOCK);
+}
+
+int main(void)
+{
+	const char *signals[] = {"noise", "silence", "clipping"};
+	const char *kernels[] = {"process_stride, stride 1", "process_stride, stride 2 pair", "process_fine"};
+	srand(1);
+	for (int signal = 0; signal < 3; signal++)
+	{
+		// decoded samples are left aligned in 32 bits, 16 significant
+		for (int i = 0; i < BENCH_BLOCK; i++)
+			in[i] = (signal == 0) ? (int32_t)((uint32_t)rand() << 16) : (signal == 1) ? 0 : ((i & 8) ? INT32_MAX : INT32_MIN);
+		for (int kernel = 0; kernel < 3; kernel++)
+			printf("%-8s %-30s %6.2f %s/sample\n", signals[signal], kernels[kernel], bench(kernel), BENCH_UNIT);
+	}
+	return 0;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+/* host stand-in for ESP-IDF driver/dac.h */
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+	DAC_CHAN_0 = 0,
+	DAC_CHAN_1 = 1,
+	DAC_CHANNEL_1 = DAC_CHAN_0,
+	DAC_CHANNEL_2 = DAC_CHAN_1,
+} dac_channel_t;
+
+esp_err_t dac_output_enable(dac_channel_t channel);
+esp_err_t dac_output_disable(dac_channel_t channel);
+esp_err_t dac_output_voltage(dac_channel_t channel, uint8_t dac_value);
@@ -0,0 +1,153 @@
+#include <stddef.h>
+#include <stdlib.h>
+
+#include "driver/dac.h"
+#include "esp_rom_sys.h"
+#include "esp_sleep.h"
+#include "soc/rtc.h"
+#include "ulp.h"
+
+#include "hostShim.h"
+
+#define HOST_SHIM_REGS 16
+
+uint32_t RTC_SLOW_MEM[RTC_SLOW_MEM_WORDS];
+
+static struct
+{
+	uint32_t addr;
+	uint32_t value;
+} host_regs[HOST_SHIM_REGS];
+static uint32_t host_ulp_runs;
+static uint16_t host_ulp_entry_point;
+static uint64_t host_timer_wakeup_us; // 0 while the timer wakeup is disabled
+static uint8_t host_dac[2];
+static void (*host_sleep)(void *arg, uint64_t time_us);
+static void *host_sleep_arg;
+
+uint32_t rtc_clk_cal(rtc_cal_sel_t cal_clk, uint32_t slow_clk_cycles)
+{
+	// period of the 8MD256 clock in us, RTC_CLK_CAL_FRACT fraction bits
+	return (uint64_t)1000000 * 256 * (1 << RTC_CLK_CAL_FRACT) / HOST_SHIM_RTC_FAST_HZ;
+}
+
+void rtc_clk_8m_enable(bool clk_8m_en, bool d256_en)
+{
+}
+
+bool rtc_clk_8m_enabled(void)
+{
+	return true;
+}
+
+bool rtc_clk_8md256_enabled(void)
+{
+	return true;
+}
+
+esp_err_t dac_output_enable(dac_channel_t channel)
+{
+	return ESP_OK;
+}
+
+esp_err_t dac_output_disable(dac_channel_t channel)
+{
+	return ESP_OK;
+}
+
+esp_err_t dac_output_voltage(dac_channel_t channel, uint8_t dac_value)
+{
+	host_dac[channel] = dac_value;
+	return ESP_OK;
+}
+
+uint8_t host_shim_dac_voltage(uint8_t channel)
+{
+	return host_dac[channel];
+}
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us)
+{
+	host_timer_wakeup_us = time_in_us;
+	return ESP_OK;
+}
+
+esp_err_t esp_sleep_enable_ulp_wakeup(void)
+{
+	return ESP_OK;
+}
+
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source)
+{
+	if ((source == ESP_SLEEP_WAKEUP_TIMER) || (source == ESP_SLEEP_WAKEUP_ALL))
+		host_timer_wakeup_us = 0;
+	return ESP_OK;
+}
+
+esp_err_t esp_light_sleep_start(void)
+{
+	if (host_sleep != NULL)
+		host_sleep(host_sleep_arg, host_timer_wakeup_us);
+	else
+		host_shim_advance_time_us(host_timer_wakeup_us);
+	return ESP_OK;
+}
+
+void esp_rom_delay_us(uint32_t us)
+{
+	if (host_sleep != NULL)
+		host_sleep(host_sleep_arg, us);
+	else
+		host_shim_advance_time_us(us);
+}
+
+void host_shim_on_light_sleep(void (*sleep)(void *arg, uint64_t time_us), void *arg)
+{
+	host_sleep = sleep;
+	host_sleep_arg = arg;
+}
+
+uint64_t host_shim_timer_wakeup_us(void)
+{
+	return host_timer_wakeup_us;
+}
+
+esp_err_t ulp_run(uint32_t entry_point)
+{
+	host_ulp_runs++;
+	host_ulp_entry_point = entry_point;
+	return ESP_OK;
+}
+
+uint32_t host_shim_ulp_runs(uint16_t *entry_point)
+{
+	*entry_point = host_ulp_entry_point;
+	return host_ulp_runs;
+}
+
+uint32_t host_shim_reg_read(uint32_t addr)
+{
+	for (size_t i = 0; i < HOST_SHIM_REGS; i++)
+		if (host_regs[i].addr == addr)
+			return host_regs[i].value;
+	return 0;
+}
+
+void host_shim_reg_write(uint32_t addr, uint32_t value)
+{
+	size_t free = HOST_SHIM_REGS;
+	for (size_t i = 0; i < HOST_SHIM_REGS; i++)
+	{
+		if (host_regs[i].addr == addr)
+		{
+			host_regs[i].value = value;
+			return;
+		}
+		if ((host_regs[i].addr == 0) && (free == HOST_SHIM_REGS))
+			free = i;
+	}
+	if (free == HOST_SHIM_REGS)
+		abort(); // more registers than the shim keeps
+	host_regs[free].addr = addr;
+	host_regs[free].value = value;
+}
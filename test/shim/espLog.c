@@ -0,0 +1,23 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "esp_log.h"
+
+static esp_log_level_t host_log_level = ESP_LOG_WARN;
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+	(void)tag;
+	host_log_level = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+	(void)tag;
+	if (level > host_log_level)
+		return;
+	va_list args;
+	va_start(args, format);
+	vfprintf(stderr, format, args);
+	va_end(args);
+}
@@ -0,0 +1,77 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "hostShim.h"
+
+struct esp_timer
+{
+	esp_timer_cb_t callback;
+	void *arg;
+	uint64_t period;
+	bool running;
+};
+
+static bool host_fake_time;
+static int64_t host_time_us;
+
+int64_t esp_timer_get_time(void)
+{
+	if (host_fake_time)
+		return host_time_us;
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+void host_shim_set_time_us(int64_t time_us)
+{
+	host_fake_time = true;
+	host_time_us = time_us;
+}
+
+void host_shim_advance_time_us(int64_t time_us)
+{
+	host_shim_set_time_us(esp_timer_get_time() + time_us);
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+	esp_timer_handle_t timer = calloc(1, sizeof(struct esp_timer));
+	if (timer == NULL)
+		return ESP_ERR_NO_MEM;
+	timer->callback = create_args->callback;
+	timer->arg = create_args->arg;
+	*out_handle = timer;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+	if (timer->running)
+		return ESP_ERR_INVALID_STATE;
+	timer->period = period;
+	timer->running = true;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+	if (!timer->running)
+		return ESP_ERR_INVALID_STATE;
+	timer->running = false;
+	return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+	free(timer);
+	return ESP_OK;
+}
+
+bool host_shim_timer_fire(esp_timer_handle_t timer)
+{
+	if ((timer == NULL) || !timer->running)
+		return false;
+	timer->callback(timer->arg);
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+/* host stand-in for ESP-IDF esp_err.h */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_NO_MEM 0x101
+#define ESP_ERR_INVALID_ARG 0x102
+#define ESP_ERR_INVALID_STATE 0x103
+
+#define ESP_ERROR_CHECK(x)                                                          \
+	do                                                                              \
+	{                                                                               \
+		esp_err_t err_rc_ = (x);                                                    \
+		if (err_rc_ != ESP_OK)                                                      \
+		{                                                                           \
+			fprintf(stderr, "%s:%d: %s failed: %d\n", __FILE__, __LINE__, #x, err_rc_); \
+			abort();                                                                \
+		}                                                                           \
+	} while (0)
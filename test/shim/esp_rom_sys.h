@@ -0,0 +1,7 @@
+#pragma once
+
+/* host stand-in for ESP-IDF esp_rom_sys.h, a busy wait runs the ULP like a light sleep */
+
+#include <stdint.h>
+
+void esp_rom_delay_us(uint32_t us);
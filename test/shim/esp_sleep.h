@@ -0,0 +1,25 @@
+#pragma once
+
+/* host stand-in for ESP-IDF esp_sleep.h, a light sleep moves the fake clock by the timer wakeup */
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum
+{
+	ESP_SLEEP_WAKEUP_UNDEFINED,
+	ESP_SLEEP_WAKEUP_ALL,
+	ESP_SLEEP_WAKEUP_EXT0,
+	ESP_SLEEP_WAKEUP_EXT1,
+	ESP_SLEEP_WAKEUP_TIMER,
+	ESP_SLEEP_WAKEUP_TOUCHPAD,
+	ESP_SLEEP_WAKEUP_ULP,
+} esp_sleep_wakeup_cause_t;
+
+typedef esp_sleep_wakeup_cause_t esp_sleep_source_t;
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t time_in_us);
+esp_err_t esp_sleep_enable_ulp_wakeup(void);
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source);
+esp_err_t esp_light_sleep_start(void);
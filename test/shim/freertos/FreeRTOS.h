@@ -0,0 +1,33 @@
+#pragma once
+
+/* host stand-in for the ESP-IDF FreeRTOS types and critical sections, a spinlock across host threads */
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL 0
+#define pdPASS 1
+#define portMAX_DELAY UINT32_MAX
+#define portNUM_PROCESSORS 2
+#define configTICK_RATE_HZ 1000
+#define pdMS_TO_TICKS(ms) ((TickType_t)((uint64_t)(ms) * configTICK_RATE_HZ / 1000))
+#define tskNO_AFFINITY 0x7FFFFFFF
+
+typedef struct
+{
+	atomic_flag locked;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {.locked = ATOMIC_FLAG_INIT}
+#define portMUX_INITIALIZE(mux) atomic_flag_clear(&(mux)->locked)
+#define portENTER_CRITICAL(mux)                    \
+	do                                             \
+	{                                              \
+	} while (atomic_flag_test_and_set(&(mux)->locked))
+#define portEXIT_CRITICAL(mux) atomic_flag_clear(&(mux)->locked)
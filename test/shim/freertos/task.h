@@ -0,0 +1,15 @@
+#pragma once
+
+/* host stand-in for FreeRTOS tasks, each one a host thread, priority, core *
+ * and stack size are ignored. The notification is a counter under a mutex, *
+ * ulTaskNotifyTake() waits on the monotonic clock at configTICK_RATE_HZ    */
+
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_task *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *arg);
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core);
+// of the calling task, which has to be one xTaskCreatePinnedToCore() started
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
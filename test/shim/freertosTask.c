@@ -0,0 +1,85 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "freertos/task.h"
+
+struct host_task
+{
+	TaskFunction_t function;
+	void *arg;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t notified;
+	uint32_t notifications;
+};
+
+static _Thread_local struct host_task *host_task_current;
+
+static void *host_task_main(void *arg)
+{
+	host_task_current = arg;
+	host_task_current->function(host_task_current->arg);
+	return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char *name, uint32_t stack_depth, void *arg, UBaseType_t priority, TaskHandle_t *created_task, BaseType_t core)
+{
+	(void)name;
+	(void)stack_depth;
+	(void)priority;
+	(void)core;
+	struct host_task *task = calloc(1, sizeof(struct host_task));
+	if (task == NULL)
+		return pdFAIL;
+	task->function = function;
+	task->arg = arg;
+	pthread_mutex_init(&task->lock, NULL);
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&task->notified, &attr);
+	pthread_condattr_destroy(&attr);
+	// the handle is out before the task can run
+	*created_task = task;
+	if (pthread_create(&task->thread, NULL, host_task_main, task) != 0)
+	{
+		free(task);
+		return pdFAIL;
+	}
+	pthread_detach(task->thread);
+	return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks_to_wait)
+{
+	struct host_task *task = host_task_current;
+	struct timespec until;
+	clock_gettime(CLOCK_MONOTONIC, &until);
+	uint64_t ns = until.tv_nsec + (uint64_t)ticks_to_wait * (1000000000 / configTICK_RATE_HZ);
+	until.tv_sec += ns / 1000000000;
+	until.tv_nsec = ns % 1000000000;
+
+	pthread_mutex_lock(&task->lock);
+	while (task->notifications == 0)
+	{
+		if (ticks_to_wait == portMAX_DELAY)
+			pthread_cond_wait(&task->notified, &task->lock);
+		else if ((ticks_to_wait == 0) || (pthread_cond_timedwait(&task->notified, &task->lock, &until) != 0))
+			break;
+	}
+	uint32_t notifications = task->notifications;
+	if (notifications > 0)
+		task->notifications = clear_on_exit ? 0 : notifications - 1;
+	pthread_mutex_unlock(&task->lock);
+	return notifications;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+	pthread_mutex_lock(&task->lock);
+	task->notifications++;
+	pthread_cond_signal(&task->notified);
+	pthread_mutex_unlock(&task->lock);
+	return pdPASS;
+}
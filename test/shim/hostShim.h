@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_timer.h"
+
+/* - host shim controls -                                       *\
+ * The ESP-IDF stand-ins under shim/ keep just enough state for  *
+ * the host tests to drive them. esp_timer_get_time() follows    *
+ * the monotonic clock until a test sets a fake time, then only  *
+ * moves when the test moves it. Periodic timers never run on    *
+ * their own, a test fires them as the esp_timer task would.     *
+ * The chip stand-ins keep RTC_SLOW_MEM, the register writes of  *
+ * the CPU and the ulp_run() calls for the ULP emulator harness, *
+\* a light sleep moves the fake clock by the timer wakeup.       */
+
+void host_shim_set_time_us(int64_t time_us);
+void host_shim_advance_time_us(int64_t time_us);
+// runs the callback once if the timer is started, false otherwise
+bool host_shim_timer_fire(esp_timer_handle_t timer);
+
+#define HOST_SHIM_RTC_FAST_HZ 8500000 // RTC fast clock rtc_clk_cal() measures
+
+// ulp_run() calls so far, entry_point of the last one
+uint32_t host_shim_ulp_runs(uint16_t *entry_point);
+// last value the CPU wrote with REG_WRITE(), 0 if never written
+uint32_t host_shim_reg_read(uint32_t addr);
+// last dac_output_voltage() of the channel
+uint8_t host_shim_dac_voltage(uint8_t channel);
+// armed timer wakeup, 0 while disabled
+uint64_t host_shim_timer_wakeup_us(void);
+// a light sleep calls sleep with the timer wakeup, a busy wait with its time, instead of moving the clock,
+// NULL restores that
+void host_shim_on_light_sleep(void (*sleep)(void *arg, uint64_t time_us), void *arg);
@@ -0,0 +1,20 @@
+#pragma once
+
+/* host stand-in for ESP-IDF soc/rtc.h, the calibration measures HOST_SHIM_RTC_FAST_HZ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RTC_CLK_CAL_FRACT 19
+
+typedef enum
+{
+	RTC_CAL_RTC_MUX = 0,
+	RTC_CAL_8MD256 = 1,
+	RTC_CAL_32K_XTAL = 2,
+} rtc_cal_sel_t;
+
+uint32_t rtc_clk_cal(rtc_cal_sel_t cal_clk, uint32_t slow_clk_cycles);
+void rtc_clk_8m_enable(bool clk_8m_en, bool d256_en);
+bool rtc_clk_8m_enabled(void);
+bool rtc_clk_8md256_enabled(void);
@@ -0,0 +1,8 @@
+#pragma once
+
+/* host stand-in for ESP-IDF soc/rtc_cntl_reg.h */
+
+#include "soc/soc.h"
+
+#define RTC_CNTL_STATE0_REG (DR_REG_RTCCNTL_BASE + 0x18)
+#define RTC_CNTL_ULP_CP_SLP_TIMER_EN_S 24
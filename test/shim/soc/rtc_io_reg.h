@@ -0,0 +1,10 @@
+#pragma once
+
+/* host stand-in for ESP-IDF soc/rtc_io_reg.h */
+
+#include "soc/soc.h"
+
+#define RTC_GPIO_OUT_W1TS_REG (DR_REG_RTCIO_BASE + 0x4)
+#define RTC_GPIO_OUT_DATA_W1TS_S 14
+#define RTC_GPIO_OUT_W1TC_REG (DR_REG_RTCIO_BASE + 0x8)
+#define RTC_GPIO_OUT_DATA_W1TC_S 14
@@ -0,0 +1,14 @@
+#pragma once
+
+/* host stand-in for ESP-IDF soc/soc.h, peripheral registers go through hostShim */
+
+#include <stdint.h>
+
+uint32_t host_shim_reg_read(uint32_t addr);
+void host_shim_reg_write(uint32_t addr, uint32_t value);
+
+#define REG_WRITE(addr, value) host_shim_reg_write((addr), (value))
+#define REG_READ(addr) host_shim_reg_read(addr)
+
+#define DR_REG_RTCCNTL_BASE 0x3ff48000
+#define DR_REG_RTCIO_BASE 0x3ff48400
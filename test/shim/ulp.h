@@ -0,0 +1,106 @@
+#pragma once
+
+/* host stand-in for ESP-IDF esp32/ulp.h, encodings as in the IDF header, *
+ * RTC_SLOW_MEM is an array the host ULP emulator runs on                  */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "soc/rtc_cntl_reg.h"
+
+#define RTC_SLOW_MEM_WORDS 2048
+extern uint32_t RTC_SLOW_MEM[RTC_SLOW_MEM_WORDS];
+
+#define R0 0
+#define R1 1
+#define R2 2
+#define R3 3
+
+#define OPCODE_WR_REG 1
+#define OPCODE_DELAY 4
+#define OPCODE_ST 6
+#define SUB_OPCODE_ST 4
+#define OPCODE_ALU 7
+#define SUB_OPCODE_ALU_IMM 1
+#define ALU_SEL_MOV 4
+#define OPCODE_BRANCH 8
+#define SUB_OPCODE_BX 0
+#define BX_JUMP_TYPE_DIRECT 0
+#define OPCODE_END 9
+#define SUB_OPCODE_END 0
+#define OPCODE_HALT 11
+
+typedef union
+{
+	struct
+	{
+		uint32_t cycles : 16;
+		uint32_t unused : 12;
+		uint32_t opcode : 4;
+	} delay;
+	struct
+	{
+		uint32_t dreg : 2;
+		uint32_t sreg : 2;
+		uint32_t unused1 : 6;
+		uint32_t offset : 11;
+		uint32_t unused2 : 4;
+		uint32_t sub_opcode : 3;
+		uint32_t opcode : 4;
+	} st;
+	struct
+	{
+		uint32_t unused : 28;
+		uint32_t opcode : 4;
+	} halt;
+	struct
+	{
+		uint32_t dreg : 2;
+		uint32_t addr : 11;
+		uint32_t unused : 8;
+		uint32_t reg : 1;
+		uint32_t type : 3;
+		uint32_t sub_opcode : 3;
+		uint32_t opcode : 4;
+	} bx;
+	struct
+	{
+		uint32_t dreg : 2;
+		uint32_t sreg : 2;
+		uint32_t imm : 16;
+		uint32_t unused : 1;
+		uint32_t sel : 4;
+		uint32_t sub_opcode : 3;
+		uint32_t opcode : 4;
+	} alu_imm;
+	struct
+	{
+		uint32_t addr : 8;
+		uint32_t periph_sel : 2;
+		uint32_t data : 8;
+		uint32_t low : 5;
+		uint32_t high : 5;
+		uint32_t opcode : 4;
+	} wr_reg;
+	struct
+	{
+		uint32_t wakeup : 1;
+		uint32_t unused : 24;
+		uint32_t sub_opcode : 3;
+		uint32_t opcode : 4;
+	} end;
+	uint32_t instruction;
+} ulp_insn_t;
+
+#define I_DELAY(cycles_) {.delay = {.cycles = cycles_, .unused = 0, .opcode = OPCODE_DELAY}}
+#define I_HALT() {.halt = {.unused = 0, .opcode = OPCODE_HALT}}
+#define I_WAKE() {.end = {.wakeup = 1, .unused = 0, .sub_opcode = SUB_OPCODE_END, .opcode = OPCODE_END}}
+#define I_ST(reg_val, reg_addr, offset_) {.st = {.dreg = reg_val, .sreg = reg_addr, .unused1 = 0, .offset = offset_, .unused2 = 0, .sub_opcode = SUB_OPCODE_ST, .opcode = OPCODE_ST}}
+#define I_BXI(imm_pc) {.bx = {.dreg = 0, .addr = imm_pc, .unused = 0, .reg = 0, .type = BX_JUMP_TYPE_DIRECT, .sub_opcode = SUB_OPCODE_BX, .opcode = OPCODE_BRANCH}}
+#define I_MOVI(reg_dest, imm_) {.alu_imm = {.dreg = reg_dest, .sreg = 0, .imm = imm_, .unused = 0, .sel = ALU_SEL_MOV, .sub_opcode = SUB_OPCODE_ALU_IMM, .opcode = OPCODE_ALU}}
+#define I_WR_REG(reg, low_bit, high_bit, val) {.wr_reg = {.addr = ((reg) & 0xff) / sizeof(uint32_t), .periph_sel = ((reg) >> 10) & 3, .data = val, .low = low_bit, .high = high_bit, .opcode = OPCODE_WR_REG}}
+#define I_WR_REG_BIT(reg, shift, val) I_WR_REG(reg, shift, shift, val)
+#define I_END() I_WR_REG_BIT(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN_S, 0)
+
+esp_err_t ulp_run(uint32_t entry_point);
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flacEncode.h"
+#include "flacPlayer.h"
+#include "hostTest.h"
+#include "soundSink.h"
+#include "wavSink.h"
+
+#define TEST_FRAMES 20001 // odd, the last mono word is completed
+#define TEST_SHORT_FRAMES 3000
+#define TEST_WAV_PATH "soundSinkTest.wav"
+
+static int16_t pcm[TEST_FRAMES * 2];
+static uint8_t flac_mono[TEST_FRAMES * 4], flac_stereo[TEST_FRAMES * 8];
+static size_t flac_mono_len, flac_stereo_len;
+static uint8_t wav_data[WAV_SINK_HEADER_LEN + TEST_FRAMES * 4];
+static flac_player_t player;
+
+static void render(sound_sink_t *sink, const uint8_t *flac, size_t len)
+{
+	flac_player_link(&player, sink);
+	flac_player_play(&player, flac, len);
+	while (flac_player_is_playing(&player))
+		flac_player_refill(&player);
+}
+
+static uint32_t checksum(const uint8_t *samples, size_t len)
+{
+	uint32_t sum = 0;
+	for (size_t i = 0; i < len; i++)
+		sum = sum * 31 + samples[i];
+	return sum;
+}
+
+static size_t read_wav(uint8_t *data, size_t len)
+{
+	FILE *file = fopen(TEST_WAV_PATH, "rb");
+	if (file == NULL)
+		return 0;
+	size_t read = fread(data, 1, len, file);
+	fclose(file);
+	return read;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// average distance of the 8 bit output to the 16 bit source, the requantizer dithers around it
+static double mean_error(const uint8_t *out, size_t len, uint8_t source_channels, uint8_t out_channels)
+{
+	double sum = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		size_t frame = i / out_channels;
+		double expected = (source_channels == out_channels) ? pcm[frame * source_channels + i % out_channels] : (pcm[frame * 2] + pcm[frame * 2 + 1]) / 2.0;
+		double diff = out[i] - (expected / 256.0 + 128.0);
+		sum += (diff < 0) ? -diff : diff;
+	}
+	return sum / len;
+}
+
+static void test_null_sink(void)
+{
+	null_sink_t null_sink;
+	null_sink_init(&null_sink, 1);
+	render(&null_sink.sink, flac_mono, flac_mono_len);
+	HOST_TEST_CHECK(null_sink.samples == TEST_FRAMES + 1, "mono %llu samples", (unsigned long long)null_sink.samples);
+	uint32_t first = null_sink.checksum;
+	render(&null_sink.sink, flac_mono, flac_mono_len);
+	HOST_TEST_CHECK(null_sink.checksum == first, "renders differ, %08x %08x", first, null_sink.checksum);
+
+	// a mono source goes to both samples of a stereo word
+	null_sink_init(&null_sink, 2);
+	render(&null_sink.sink, flac_mono, flac_mono_len);
+	HOST_TEST_CHECK(null_sink.samples == TEST_FRAMES * 2, "duplicated %llu samples", (unsigned long long)null_sink.samples);
+	render(&null_sink.sink, flac_stereo, flac_stereo_len);
+	HOST_TEST_CHECK(null_sink.samples == TEST_FRAMES * 2, "stereo %llu samples", (unsigned long long)null_sink.samples);
+}
+
+static void test_wav_sink(uint8_t source_channels, uint8_t out_channels)
+{
+	const uint8_t *flac = (source_channels == 2) ? flac_stereo : flac_mono;
+	size_t flac_len = (source_channels == 2) ? flac_stereo_len : flac_mono_len;
+	null_sink_t null_sink;
+	null_sink_init(&null_sink, out_channels);
+	render(&null_sink.sink, flac, flac_len);
+
+	wav_sink_t wav;
+	HOST_TEST_CHECK(wav_sink_open(&wav, TEST_WAV_PATH, out_channels), "cannot open " TEST_WAV_PATH);
+	render(&wav.sink, flac, flac_len);
+	wav_sink_close(&wav);
+	size_t len = read_wav(wav_data, sizeof(wav_data));
+	size_t data_len = len - WAV_SINK_HEADER_LEN;
+	HOST_TEST_CHECK(data_len == null_sink.samples, "%u to %u channels: %zu bytes of data, the null sink counted %llu", source_channels, out_channels, data_len, (unsigned long long)null_sink.samples);
+	HOST_TEST_CHECK(get_u32(wav_data + 40) == data_len, "data chunk of %u bytes", get_u32(wav_data + 40));
+	HOST_TEST_CHECK(get_u32(wav_data + 24) == 44100, "rate %u", get_u32(wav_data + 24));
+	HOST_TEST_CHECK(checksum(wav_data + WAV_SINK_HEADER_LEN, data_len) == null_sink.checksum, "%u to %u channels: WAV data differs from the null sink", source_channels, out_channels);
+	double error = mean_error(wav_data + WAV_SINK_HEADER_LEN, TEST_FRAMES * out_channels, source_channels, out_channels);
+	HOST_TEST_CHECK(error < 1.0, "%u to %u channels: mean error %.3f LSB", source_channels, out_channels, error);
+}
+
+// a second start rewrites the file, nothing of the longer first stream is left behind
+static void test_wav_restart(void)
+{
+	static uint8_t flac_short[TEST_SHORT_FRAMES * 4];
+	size_t flac_short_len = flac_encode(flac_short, sizeof(flac_short), pcm, TEST_SHORT_FRAMES, 1, 44100);
+	wav_sink_t wav;
+	HOST_TEST_CHECK(wav_sink_open(&wav, TEST_WAV_PATH, 1), "cannot open " TEST_WAV_PATH);
+	render(&wav.sink, flac_mono, flac_mono_len);
+	render(&wav.sink, flac_short, flac_short_len);
+	wav_sink_close(&wav);
+	size_t len = read_wav(wav_data, sizeof(wav_data));
+	HOST_TEST_CHECK(len == WAV_SINK_HEADER_LEN + TEST_SHORT_FRAMES, "%zu bytes after the restart", len);
+}
+
+int main(void)
+{
+	flac_encode_test_signal(pcm, TEST_FRAMES, 1);
+	flac_mono_len = flac_encode(flac_mono, sizeof(flac_mono), pcm, TEST_FRAMES, 1, 44100);
+	flac_encode_test_signal(pcm, TEST_FRAMES, 2);
+	flac_stereo_len = flac_encode(flac_stereo, sizeof(flac_stereo), pcm, TEST_FRAMES, 2, 44100);
+	HOST_TEST_CHECK((flac_mono_len > 0) && (flac_stereo_len > 0), "encoder buffers too small");
+	flac_player_init(&player);
+
+	test_null_sink();
+	test_wav_sink(2, 2);
+	test_wav_sink(2, 1);
+	flac_encode_test_signal(pcm, TEST_FRAMES, 1);
+	test_wav_sink(1, 1);
+	test_wav_restart();
+	remove(TEST_WAV_PATH);
+	return host_test_result();
+}
@@ -0,0 +1,105 @@
+#include <pthread.h>
+#include <sched.h>
+
+#include "hostTest.h"
+#include "spscQueue.h"
+
+#define TEST_ITEMS 200000
+#define TEST_LEN 8
+#define TEST_START 0xFFFFFF00u // head and tail wrap at 2^32 early in the run
+
+/* - threaded run -                                             *\
+ * One thread pushes numbered items as fast as the queue takes  *
+ * them, another pops and checks every field, both yield on a   *
+ * full or empty queue. Run under ThreadSanitizer, a torn slot  *
+\* or a missing barrier shows as a race or a bad item.          */
+typedef struct
+{
+	uint32_t seq;
+	uint32_t a;
+	uint32_t b;
+	uint32_t c;
+} item_t;
+
+static spsc_queue_t queue;
+static item_t slots[TEST_LEN];
+static unsigned long full_pushes, empty_pops, bad_items, bad_counts;
+static uint32_t first_bad = UINT32_MAX;
+
+static item_t make_item(uint32_t i)
+{
+	return (item_t){i, i * 3, ~i, i ^ 0x5a5a5a5a};
+}
+
+static void *producer(void *arg)
+{
+	for (uint32_t i = 0; i < TEST_ITEMS;)
+	{
+		item_t item = make_item(i);
+		if (spsc_queue_push(&queue, &item))
+			i++;
+		else
+		{
+			full_pushes++;
+			sched_yield();
+		}
+		if (spsc_queue_count(&queue) > TEST_LEN)
+			bad_counts++;
+	}
+	return NULL;
+}
+
+static void *consumer(void *arg)
+{
+	for (uint32_t i = 0; i < TEST_ITEMS;)
+	{
+		item_t item;
+		if (spsc_queue_pop(&queue, &item))
+		{
+			item_t expected = make_item(i);
+			if ((item.seq != expected.seq) || (item.a != expected.a) || (item.b != expected.b) || (item.c != expected.c))
+			{
+				if (bad_items++ == 0)
+					first_bad = i;
+			}
+			i++;
+		}
+		else
+		{
+			empty_pops++;
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+int main(void)
+{
+	HOST_TEST_CHECK(!spsc_queue_init(&queue, slots, sizeof(item_t), 6), "a length of 6 is taken");
+	HOST_TEST_CHECK(!spsc_queue_init(&queue, slots, sizeof(item_t), 0), "a length of 0 is taken");
+	HOST_TEST_CHECK(spsc_queue_init(&queue, slots, sizeof(item_t), TEST_LEN), "a length of %d is refused", TEST_LEN);
+
+	// full and empty on one thread
+	item_t item = make_item(0);
+	uint32_t pushed = 0;
+	while (spsc_queue_push(&queue, &item))
+		pushed++;
+	HOST_TEST_CHECK(pushed == TEST_LEN && spsc_queue_count(&queue) == TEST_LEN, "%u pushed until full, count %u", pushed, spsc_queue_count(&queue));
+	while (spsc_queue_pop(&queue, &item))
+		pushed--;
+	HOST_TEST_CHECK(pushed == 0 && spsc_queue_count(&queue) == 0, "%u left after popping until empty", pushed);
+
+	spsc_queue_init(&queue, slots, sizeof(item_t), TEST_LEN);
+	atomic_store(&queue.head, TEST_START);
+	atomic_store(&queue.tail, TEST_START);
+	pthread_t producer_thread, consumer_thread;
+	pthread_create(&consumer_thread, NULL, consumer, NULL);
+	pthread_create(&producer_thread, NULL, producer, NULL);
+	pthread_join(producer_thread, NULL);
+	pthread_join(consumer_thread, NULL);
+	HOST_TEST_CHECK(bad_items == 0, "%lu of %d items wrong, the first at %u", bad_items, TEST_ITEMS, first_bad);
+	HOST_TEST_CHECK(bad_counts == 0, "count over %d %lu times", TEST_LEN, bad_counts);
+	HOST_TEST_CHECK(spsc_queue_count(&queue) == 0 && atomic_load(&queue.head) == TEST_START + TEST_ITEMS, "count %u, head %u after the run", spsc_queue_count(&queue), atomic_load(&queue.head));
+	printf("%d items, %lu pushes to a full queue, %lu pops from an empty one\n", TEST_ITEMS, full_pushes, empty_pops);
+	return host_test_result();
+}
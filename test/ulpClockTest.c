@@ -0,0 +1,125 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "hostTest.h"
+#include "ulpClock.h"
+
+#define TICK_US 20000 // ULPSOUND_RECAL_TICK_MS
+#define TICKS_PER_S (1000000 / TICK_US)
+#define TARGET_RATE 44100
+#define NOMINAL_HZ 8500000
+
+/* - simulated ULP -                                                  *\
+ * Runs the program at an RTC fast clock that drifts away from the one *
+ * the loop starts from, takes more cycles per sample than the loop is *
+ * told and realizes the fractional delay exactly on average, as the   *
+\* dither pattern does over a recal tick.                              */
+typedef struct
+{
+	double rtc_hz;
+	double extra_cycles; // program cycles the loop does not know about
+	double phase;		 // samples played, fraction included
+	uint64_t counted;	 // samples the loop has been fed
+} ulp_sim_t;
+
+static double sim_rate(const ulp_sim_t *sim, const ulp_clock_t *clock)
+{
+	return sim->rtc_hz / (clock->program_cycles + sim->extra_cycles + clock->delay + clock->delay_frac / 65536.0);
+}
+
+// one recal tick, returns the rate the ULP played at during it
+static double sim_tick(ulp_sim_t *sim, ulp_clock_t *clock, uint32_t *changes)
+{
+	double rate = sim_rate(sim, clock);
+	sim->phase += rate * TICK_US / 1e6;
+	uint64_t now = (uint64_t)sim->phase;
+	if (ulp_clock_feed(clock, now - sim->counted, TICK_US))
+		(*changes)++;
+	sim->counted = now;
+	return rate;
+}
+
+// worst rate error after settle_s, averaged over average_s as a listener hears pitch
+static double run(ulp_clock_t *clock, ulp_sim_t *sim, double drift_ppm_per_min, uint32_t seconds, uint32_t settle_s, uint32_t average_s, uint32_t *changes)
+{
+	double worst_ppm = 0, sum = 0;
+	uint32_t summed = 0;
+	*changes = 0;
+	for (uint32_t t = 0; t < seconds * TICKS_PER_S; t++)
+	{
+		sim->rtc_hz *= 1 + drift_ppm_per_min / 1e6 / 60 / TICKS_PER_S;
+		sum += sim_tick(sim, clock, changes);
+		if (++summed < average_s * TICKS_PER_S)
+			continue;
+		double ppm = (sum / summed - TARGET_RATE) / TARGET_RATE * 1e6;
+		if ((t >= settle_s * TICKS_PER_S) && (fabs(ppm) > worst_ppm))
+			worst_ppm = fabs(ppm);
+		sum = 0;
+		summed = 0;
+	}
+	return worst_ppm;
+}
+
+static void start(ulp_clock_t *clock, ulp_sim_t *sim, double rtc_error, bool fractional)
+{
+	const uint32_t cycles = 86;
+	uint64_t delay_q16 = ((uint64_t)NOMINAL_HZ << 16) / TARGET_RATE - ((uint64_t)cycles << 16);
+	if (!fractional)
+		delay_q16 = (delay_q16 + 0x8000) & ~0xFFFFULL;
+	ulp_clock_init(clock, NOMINAL_HZ, TARGET_RATE, cycles, delay_q16 >> 16, delay_q16 & 0xFFFF, fractional);
+	*sim = (ulp_sim_t){.rtc_hz = NOMINAL_HZ * (1 + rtc_error), .extra_cycles = 2};
+}
+
+int main(void)
+{
+	ulp_clock_t clock;
+	ulp_sim_t sim;
+	uint32_t changes;
+
+	// 3% off the calibration and 2 unknown cycles: the start is off by ~2%, the loop has to pull it in
+	start(&clock, &sim, 0.03, true);
+	double first_ppm = fabs(sim_rate(&sim, &clock) - TARGET_RATE) / TARGET_RATE * 1e6;
+	double ppm = run(&clock, &sim, 0, 120, 60, 2, &changes);
+	HOST_TEST_CHECK(first_ppm > 15000, "start only %.0f ppm off", first_ppm);
+	HOST_TEST_CHECK(ppm < 30, "fractional, fixed clock: %.1f ppm", ppm);
+	// settled, the hysteresis keeps the program alone
+	run(&clock, &sim, 0, 60, 0, 2, &changes);
+	HOST_TEST_CHECK(changes == 0, "%u delay changes on a fixed clock", changes);
+
+	// warming up: 500 ppm per minute, the loop lags one filter time constant behind
+	start(&clock, &sim, 0.01, true);
+	run(&clock, &sim, 500, 60, 60, 2, &changes);
+	uint32_t settled_hz = clock.rtc_freq_hz;
+	ppm = run(&clock, &sim, 500, 540, 0, 2, &changes);
+	HOST_TEST_CHECK(ppm < 100, "fractional, drifting clock: %.1f ppm", ppm);
+	// the unknown cycles bias the estimate, its change still follows the 4500 ppm of drift
+	double followed_ppm = ((double)clock.rtc_freq_hz - settled_hz) / settled_hz * 1e6;
+	HOST_TEST_CHECK(followed_ppm > 4000 && followed_ppm < 5000, "estimate moved %.0f ppm", followed_ppm);
+
+	// whole cycle delays: within half a cycle plus the 0.625 cycle hysteresis, 1.1 cycles of 192
+	start(&clock, &sim, -0.02, false);
+	ppm = run(&clock, &sim, 200, 600, 60, 2, &changes);
+	HOST_TEST_CHECK(ppm < 6000, "integer, drifting clock: %.1f ppm", ppm);
+	HOST_TEST_CHECK(clock.delay_frac == 0, "integer delay got a fraction %u", clock.delay_frac);
+
+	// no target: the delay stays, only the estimate follows the clock
+	ulp_clock_init(&clock, NOMINAL_HZ, 0, 86, 0, 0, true);
+	sim = (ulp_sim_t){.rtc_hz = NOMINAL_HZ * 1.02};
+	run(&clock, &sim, 0, 60, 0, 2, &changes);
+	HOST_TEST_CHECK(changes == 0 && clock.delay == 0, "%u delay changes without a target", changes);
+	double estimate_ppm = (clock.rtc_freq_hz - sim.rtc_hz) / sim.rtc_hz * 1e6;
+	HOST_TEST_CHECK(fabs(estimate_ppm) < 100, "estimate %.0f ppm off", estimate_ppm);
+
+	// a window of a stalled timer is dropped, the estimate stays
+	start(&clock, &sim, 0, true);
+	uint32_t before_hz = clock.rtc_freq_hz;
+	HOST_TEST_CHECK(!ulp_clock_feed(&clock, TARGET_RATE * 30, 30000000) && clock.rtc_freq_hz == before_hz, "a 30 s window moved the estimate to %u Hz", clock.rtc_freq_hz);
+	// the longest window kept is measured as exactly as a normal one
+	uint32_t samples = (uint64_t)NOMINAL_HZ * (ULP_CLOCK_STALL_US / 1000000) / (clock.program_cycles + clock.delay);
+	double measured_hz = (double)samples * (clock.program_cycles + clock.delay + clock.delay_frac / 65536.0) / (ULP_CLOCK_STALL_US / 1e6);
+	ulp_clock_feed(&clock, samples, ULP_CLOCK_STALL_US);
+	double filtered_hz = before_hz + (measured_hz - before_hz) / (1 << ULP_CLOCK_FILTER_SHIFT);
+	HOST_TEST_CHECK(fabs(clock.rtc_freq_hz - filtered_hz) < 2, "a %d s window estimates %u Hz, expected %.0f", ULP_CLOCK_STALL_US / 1000000, clock.rtc_freq_hz, filtered_hz);
+
+	return host_test_result();
+}
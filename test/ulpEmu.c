@@ -0,0 +1,237 @@
+#include <string.h>
+
+#include "ulpAsm.h"
+#include "ulpEmu.h"
+
+// opcodes and sub-opcodes as laid out in the ESP32 TRM ULP FSM instruction set
+#define OP_WR_REG 1
+#define OP_DELAY 4
+#define OP_ST 6
+#define OP_ALU 7
+#define OP_BRANCH 8
+#define OP_END 9
+#define OP_HALT 11
+#define OP_LD 13
+
+#define SUB_ALU_REG 0
+#define SUB_ALU_IMM 1
+#define SUB_BX 0
+#define SUB_BR 1
+#define SUB_ST 4
+#define SUB_END 0
+
+#define ALU_ADD 0
+#define ALU_SUB 1
+#define ALU_AND 2
+#define ALU_OR 3
+#define ALU_MOV 4
+#define ALU_LSH 5
+#define ALU_RSH 6
+
+#define BX_DIRECT 0
+#define BX_ZERO 1
+#define BX_OVERFLOW 2
+
+#define BITS(insn, low, len) (((insn) >> (low)) & ((1UL << (len)) - 1))
+
+void ulp_emu_init(ulp_emu_t *emu)
+{
+	memset(emu, 0, sizeof(ulp_emu_t));
+	ulp_emu_reset(emu, 0);
+}
+
+// restart the program like ulp_run() would, memory and peripheral registers are kept
+void ulp_emu_reset(ulp_emu_t *emu, uint16_t entry_point)
+{
+	memset(emu->r, 0, sizeof(emu->r));
+	emu->pc = entry_point;
+	emu->zero = false;
+	emu->overflow = false;
+	emu->state = ULP_EMU_RUNNING;
+	emu->cycle = 0;
+	emu->instructions = 0;
+	emu->wakeups = 0;
+	memset(emu->exec_count, 0, sizeof(emu->exec_count));
+	for (uint8_t c = 0; c < 2; c++)
+	{
+		emu->dac_writes[c] = 0;
+		emu->dac_last_cycle[c] = 0;
+		emu->dac_interval_min[c] = UINT64_MAX;
+		emu->dac_interval_max[c] = 0;
+	}
+}
+
+static uint16_t ulp_emu_alu(ulp_emu_t *emu, uint8_t sel, uint16_t a, uint16_t b)
+{
+	uint32_t result;
+	emu->overflow = false;
+	switch (sel)
+	{
+	case ALU_ADD:
+		result = (uint32_t)a + b;
+		emu->overflow = result > UINT16_MAX;
+		break;
+	case ALU_SUB:
+		result = (uint32_t)a - b;
+		emu->overflow = a < b;
+		break;
+	case ALU_AND:
+		result = a & b;
+		break;
+	case ALU_OR:
+		result = a | b;
+		break;
+	case ALU_MOV:
+		result = b;
+		break;
+	case ALU_LSH:
+		result = (b >= 16) ? 0 : (uint32_t)a << b;
+		break;
+	case ALU_RSH:
+		result = (b >= 16) ? 0 : a >> b;
+		break;
+	default:
+		emu->state = ULP_EMU_ERROR;
+		result = 0;
+		break;
+	}
+	emu->zero = (result & UINT16_MAX) == 0;
+	return result;
+}
+
+static void ulp_emu_reg_wr(ulp_emu_t *emu, uint32_t insn)
+{
+	uint16_t addr = BITS(insn, 0, 10);
+	uint32_t data = BITS(insn, 10, 8);
+	uint8_t low = BITS(insn, 18, 5);
+	uint8_t high = BITS(insn, 23, 5);
+	if (high < low)
+		return;
+
+	uint32_t mask = (uint32_t)(((1ULL << (high - low + 1)) - 1) << low);
+	emu->reg[addr] = (emu->reg[addr] & ~mask) | ((data << low) & mask);
+
+	if ((addr != ULP_EMU_REG_DAC1) && (addr != ULP_EMU_REG_DAC2))
+		return;
+
+	uint8_t channel = addr - ULP_EMU_REG_DAC1;
+	uint64_t now = emu->cycle + ulp_asm_insn_cycles(insn);
+	if (emu->dac_writes[channel] > 0)
+	{
+		uint64_t interval = now - emu->dac_last_cycle[channel];
+		if (interval < emu->dac_interval_min[channel])
+			emu->dac_interval_min[channel] = interval;
+		if (interval > emu->dac_interval_max[channel])
+			emu->dac_interval_max[channel] = interval;
+	}
+	emu->dac_writes[channel]++;
+	emu->dac_last_cycle[channel] = now;
+
+	if (emu->on_dac_write != NULL)
+	{
+		const ulp_emu_dac_write_t write = {
+			.cycle = now,
+			.pc = emu->pc,
+			.channel = channel,
+			.value = ulp_emu_get_dac(emu, channel),
+		};
+		emu->on_dac_write(emu->on_dac_write_arg, &write);
+	}
+}
+
+// executes one instruction, returns the cycles it took or 0 once the program stopped
+uint32_t ulp_emu_step(ulp_emu_t *emu)
+{
+	if (emu->state != ULP_EMU_RUNNING)
+		return 0;
+
+	uint32_t insn = emu->mem[emu->pc % ULP_EMU_MEM_WORDS];
+	uint32_t cycles = ulp_asm_insn_cycles(insn);
+	uint16_t next_pc = emu->pc + 1;
+	uint8_t dreg = BITS(insn, 0, 2);
+	uint8_t sreg = BITS(insn, 2, 2);
+
+	switch (BITS(insn, 28, 4))
+	{
+	case OP_ALU:
+		if (BITS(insn, 25, 3) == SUB_ALU_REG)
+			emu->r[dreg] = ulp_emu_alu(emu, BITS(insn, 21, 4), emu->r[sreg], emu->r[BITS(insn, 4, 2)]);
+		else if (BITS(insn, 25, 3) == SUB_ALU_IMM)
+			emu->r[dreg] = ulp_emu_alu(emu, BITS(insn, 21, 4), emu->r[sreg], BITS(insn, 4, 16));
+		else
+			emu->state = ULP_EMU_ERROR; // stage counter ops
+		break;
+	case OP_ST:
+		if (BITS(insn, 25, 3) != SUB_ST)
+		{
+			emu->state = ULP_EMU_ERROR;
+			break;
+		}
+		// upper half word holds the PC of the ST instruction
+		emu->mem[(emu->r[sreg] + BITS(insn, 10, 11)) % ULP_EMU_MEM_WORDS] = ((uint32_t)emu->pc << 21) | emu->r[dreg];
+		break;
+	case OP_LD:
+		emu->r[dreg] = emu->mem[(emu->r[sreg] + BITS(insn, 10, 11)) % ULP_EMU_MEM_WORDS] & UINT16_MAX;
+		break;
+	case OP_BRANCH:
+		if (BITS(insn, 25, 3) == SUB_BX)
+		{
+			uint16_t target = BITS(insn, 21, 1) ? emu->r[dreg] : BITS(insn, 2, 11);
+			uint8_t type = BITS(insn, 22, 3);
+			if ((type == BX_DIRECT) || ((type == BX_ZERO) && emu->zero) || ((type == BX_OVERFLOW) && emu->overflow))
+				next_pc = target;
+		}
+		else if (BITS(insn, 25, 3) == SUB_BR)
+		{
+			// JUMPR compares R0 against the immediate, offset is sign and magnitude
+			bool ge = emu->r[0] >= BITS(insn, 0, 16);
+			if (ge == (BITS(insn, 16, 1) != 0))
+			{
+				int16_t offset = BITS(insn, 17, 7);
+				next_pc = emu->pc + (BITS(insn, 24, 1) ? -offset : offset);
+			}
+		}
+		else
+			emu->state = ULP_EMU_ERROR; // JUMPS
+		break;
+	case OP_DELAY:
+		break;
+	case OP_WR_REG:
+		ulp_emu_reg_wr(emu, insn);
+		break;
+	case OP_END:
+		if (BITS(insn, 25, 3) == SUB_END)
+			emu->wakeups += BITS(insn, 0, 1);
+		break;
+	case OP_HALT:
+		emu->state = ULP_EMU_HALTED;
+		break;
+	default:
+		emu->state = ULP_EMU_ERROR;
+		break;
+	}
+
+	if (emu->state == ULP_EMU_ERROR)
+		return 0;
+
+	emu->exec_count[emu->pc % ULP_EMU_MEM_WORDS]++;
+	emu->instructions++;
+	emu->cycle += cycles;
+	emu->pc = next_pc % ULP_EMU_MEM_WORDS;
+	return cycles;
+}
+
+// runs until the program stops or at least max_cycles have passed, returns the cycles executed
+uint64_t ulp_emu_run(ulp_emu_t *emu, uint64_t max_cycles)
+{
+	uint64_t start = emu->cycle;
+	while ((emu->cycle - start) < max_cycles)
+		if (ulp_emu_step(emu) == 0)
+			break;
+	return emu->cycle - start;
+}
+
+uint8_t ulp_emu_get_dac(const ulp_emu_t *emu, uint8_t channel)
+{
+	return emu->reg[ULP_EMU_REG_DAC1 + channel] >> ULP_EMU_DAC_LOW_BIT;
+}
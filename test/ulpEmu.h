@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/* - ULP FSM emulator -                                                 *\
+ * Runs ESP32 ULP FSM programs over an 8 KB RTC_SLOW_MEM image on host. *
+ * Supported: ALU (reg/imm), ST, LD, JUMP, JUMPR, DELAY, REG_WR, WAKE,  *
+ * HALT. Anything else stops the emulator with an error.                *
+ * Cycle counts are those the firmware times its programs with,         *
+ * ulp_asm_insn_cycles(): ALU 6, ST 8, LD 8, JUMP/JUMPR 4, DELAY 6 + n, *
+ * REG_WR 12, WAKE 6, HALT 2, each including the fetch of the next      *
+ * instruction (ESP32 TRM). A REG_WR is timestamped when it finishes.   *
+\* Host tests only, not part of the firmware.                           */
+
+#define ULP_EMU_MEM_WORDS 2048
+#define ULP_EMU_REG_WORDS 1024 // REG_WR address space, periph_sel:addr
+
+// REG_WR addresses of the DAC pad registers, (0x400 + 0x84) / 4 and (0x400 + 0x88) / 4
+#define ULP_EMU_REG_DAC1 0x121
+#define ULP_EMU_REG_DAC2 0x122
+#define ULP_EMU_DAC_LOW_BIT 19
+
+typedef enum
+{
+	ULP_EMU_RUNNING = 0,
+	ULP_EMU_HALTED,
+	ULP_EMU_ERROR,
+} ulp_emu_state_t;
+
+typedef struct
+{
+	uint64_t cycle;	 // cycle at which the write took effect
+	uint16_t pc;	 // address of the REG_WR instruction
+	uint8_t channel; // 0: DAC1, 1: DAC2
+	uint8_t value;	 // DAC code after the write
+} ulp_emu_dac_write_t;
+
+typedef void (*ulp_emu_dac_cb_t)(void *arg, const ulp_emu_dac_write_t *write);
+
+typedef struct
+{
+	uint32_t mem[ULP_EMU_MEM_WORDS];
+	uint32_t reg[ULP_EMU_REG_WORDS];
+	uint16_t r[4];
+	uint16_t pc;
+	bool zero;
+	bool overflow;
+	ulp_emu_state_t state;
+
+	uint64_t cycle;
+	uint64_t instructions;
+	uint32_t wakeups;
+	uint32_t exec_count[ULP_EMU_MEM_WORDS]; // per address, multiply by ulp_asm_insn_cycles() for a profile
+
+	// interval between consecutive DAC writes on the same channel
+	uint64_t dac_writes[2];
+	uint64_t dac_last_cycle[2];
+	uint64_t dac_interval_min[2];
+	uint64_t dac_interval_max[2];
+
+	ulp_emu_dac_cb_t on_dac_write;
+	void *on_dac_write_arg;
+} ulp_emu_t;
+
+void ulp_emu_init(ulp_emu_t *emu);
+void ulp_emu_reset(ulp_emu_t *emu, uint16_t entry_point);
+uint32_t ulp_emu_step(ulp_emu_t *emu);
+uint64_t ulp_emu_run(ulp_emu_t *emu, uint64_t max_cycles);
+uint8_t ulp_emu_get_dac(const ulp_emu_t *emu, uint8_t channel);
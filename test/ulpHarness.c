@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostShim.h"
+#include "ulp.h"
+#include "ulpHarness.h"
+
+#define ULP_HARNESS_MAX_SLICES 100000 // refills or polls before a stream counts as stuck
+
+static void ulp_harness_on_dac_write(void *arg, const ulp_emu_dac_write_t *write)
+{
+	ulp_harness_t *harness = arg;
+	if (harness->writes_len == harness->writes_cap)
+	{
+		harness->writes_cap = harness->writes_cap ? harness->writes_cap * 2 : 4096;
+		harness->writes = realloc(harness->writes, harness->writes_cap * sizeof(ulp_emu_dac_write_t));
+		if (harness->writes == NULL)
+			abort();
+	}
+	ulp_emu_dac_write_t *kept = &harness->writes[harness->writes_len++];
+	*kept = *write;
+	kept->cycle += harness->base;
+}
+
+// the ULP runs on while the CPU sleeps
+static void ulp_harness_light_sleep(void *arg, uint64_t time_us)
+{
+	ulp_harness_run(arg, time_us * HOST_SHIM_RTC_FAST_HZ / 1000000);
+}
+
+void ulp_harness_init(ulp_harness_t *harness)
+{
+	memset(harness, 0, sizeof(ulp_harness_t));
+	ulp_emu_init(&harness->emu);
+	harness->emu.state = ULP_EMU_HALTED; // until the first ulp_run()
+	harness->emu.on_dac_write = ulp_harness_on_dac_write;
+	harness->emu.on_dac_write_arg = harness;
+	uint16_t entry_point;
+	harness->ulp_runs = host_shim_ulp_runs(&entry_point);
+	host_shim_set_time_us(0);
+	host_shim_on_light_sleep(ulp_harness_light_sleep, harness);
+}
+
+void ulp_harness_free(ulp_harness_t *harness)
+{
+	host_shim_on_light_sleep(NULL, NULL);
+	free(harness->writes);
+	harness->writes = NULL;
+	harness->writes_len = 0;
+	harness->writes_cap = 0;
+}
+
+void ulp_harness_run(ulp_harness_t *harness, uint64_t cycles)
+{
+	uint16_t entry_point;
+	uint32_t runs = host_shim_ulp_runs(&entry_point);
+	if (runs != harness->ulp_runs)
+	{
+		harness->ulp_runs = runs;
+		harness->base = harness->now;
+		ulp_emu_reset(&harness->emu, entry_point);
+	}
+
+	uint64_t target = harness->now + cycles;
+	memcpy(harness->emu.mem, RTC_SLOW_MEM, sizeof(harness->emu.mem));
+	// a slice can end a few cycles into the next instruction, the next slice is shorter by as much
+	uint64_t at = harness->base + harness->emu.cycle;
+	if ((harness->emu.state == ULP_EMU_RUNNING) && (at < target))
+		ulp_emu_run(&harness->emu, target - at);
+	memcpy(RTC_SLOW_MEM, harness->emu.mem, sizeof(harness->emu.mem));
+
+	int64_t from_us = harness->now * 1000000 / HOST_SHIM_RTC_FAST_HZ;
+	harness->now = target;
+	host_shim_advance_time_us(harness->now * 1000000 / HOST_SHIM_RTC_FAST_HZ - from_us);
+}
+
+uint64_t ulp_harness_cycles(ulp_sound_t *ulp, uint64_t samples)
+{
+	return ulp_sound_samples_to_us(ulp, samples) * HOST_SHIM_RTC_FAST_HZ / 1000000;
+}
+
+bool ulp_harness_play(ulp_harness_t *harness, ulp_sound_t *ulp, const uint8_t *samples, const uint16_t *words, size_t len)
+{
+	const uint64_t slice = ulp_harness_cycles(ulp, ((uint64_t)ulp->buff_len << ulp->index_shift) / 3);
+	size_t done = 0;
+	uint32_t slices = 0;
+	while (done < len)
+	{
+		if (++slices > ULP_HARNESS_MAX_SLICES)
+			return false;
+		ulp_harness_run(harness, slice);
+		ulp_sound_get_buffer_diff(ulp);
+		done += (words != NULL) ? ulp_sound_write_words(ulp, words + done, len - done) : ulp_sound_write(ulp, samples + done, len - done);
+	}
+	while (!ulp_sound_stop(ulp))
+	{
+		if (++slices > ULP_HARNESS_MAX_SLICES)
+			return false;
+		ulp_harness_run(harness, slice);
+		ulp_sound_get_buffer_diff(ulp);
+	}
+	while (!ulp_sound_is_done(ulp))
+	{
+		if (++slices > ULP_HARNESS_MAX_SLICES)
+			return false;
+		ulp_harness_run(harness, slice / 8);
+	}
+	return harness->emu.state == ULP_EMU_HALTED;
+}
+
+size_t ulp_harness_dac(const ulp_harness_t *harness, uint8_t channel, uint64_t min_cycles, uint8_t *codes, size_t len)
+{
+	size_t count = 0;
+	const ulp_emu_dac_write_t *held = NULL;
+	for (size_t i = 0; i <= harness->writes_len; i++)
+	{
+		const ulp_emu_dac_write_t *write = (i < harness->writes_len) ? &harness->writes[i] : NULL;
+		if ((write != NULL) && (write->channel != channel))
+			continue;
+		// the last write holds until the end of the run
+		uint64_t until = (write != NULL) ? write->cycle : UINT64_MAX;
+		if ((held != NULL) && (until - held->cycle >= min_cycles))
+		{
+			if (count == len)
+				break;
+			codes[count++] = held->value;
+		}
+		held = write;
+	}
+	return count;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ulpEmu.h"
+#include "ulpSound.h"
+
+/* - ULP harness -                                              *\
+ * Runs ulpSound against the emulator. The CPU side writes       *
+ * RTC_SLOW_MEM as on the chip, ulp_harness_run() hands it to    *
+ * the emulator for a slice of cycles and takes it back, so the  *
+ * two take turns on the same memory. Each ulp_run() restarts    *
+ * the emulator at its entry point. The fake esp_timer clock     *
+ * moves with the cycles at HOST_SHIM_RTC_FAST_HZ, also while    *
+ * the ULP is halted, and a light sleep of the CPU runs the ULP  *
+ * for the sleep time. Every DAC write is kept, timestamped on   *
+\* one timeline across restarts.                                 */
+
+typedef struct
+{
+	ulp_emu_t emu;
+	uint32_t ulp_runs; // ulp_run() calls the emulator has taken over
+	uint64_t now;	   // cycles since ulp_harness_init()
+	uint64_t base;	   // now at the last restart, emu.cycle counts from there
+	ulp_emu_dac_write_t *writes;
+	size_t writes_len;
+	size_t writes_cap;
+} ulp_harness_t;
+
+void ulp_harness_init(ulp_harness_t *harness);
+void ulp_harness_free(ulp_harness_t *harness);
+void ulp_harness_run(ulp_harness_t *harness, uint64_t cycles);
+// cycles the ULP takes for samples at the rate the clock loop believes in
+uint64_t ulp_harness_cycles(ulp_sound_t *ulp, uint64_t samples);
+// feeds samples, or words for OVERSAMPLED, refilling every third of a lap, then stops the stream and runs
+// until the ULP is done. len must be even unless DPCM, false if the stream did not get through
+bool ulp_harness_play(ulp_harness_t *harness, ulp_sound_t *ulp, const uint8_t *samples, const uint16_t *words, size_t len);
+// the codes channel held for min_cycles or longer in order, 0 for every write, returns how many, up to len
+size_t ulp_harness_dac(const ulp_harness_t *harness, uint8_t channel, uint64_t min_cycles, uint8_t *codes, size_t len);
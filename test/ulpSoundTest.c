@@ -0,0 +1,434 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hostShim.h"
+#include "hostTest.h"
+#include "ulpHarness.h"
+
+#define TEST_RATE 16000
+#define TEST_SAMPLES 6000 // a few laps of every FIFO
+#define TEST_MAX_CODES 40000
+#define TEST_NIBBLE_CYCLES 32 // COMPACT holds the high nibble alone for 16 cycles
+
+static ulp_harness_t harness;
+static ulp_sound_t ulp;
+static uint8_t samples[TEST_SAMPLES];
+static uint16_t words[TEST_SAMPLES];
+static uint8_t codes[2][TEST_MAX_CODES];
+
+static const char *const program_names[] = {"SINGLE", "PAIR", "STEREO", "BRIDGED", "COMPACT", "CHIME", "OVERSAMPLED", "DPCM", "TONE"};
+
+static size_t play(ulp_sound_program_t program, uint32_t rate, const uint16_t *stream_words, size_t len, uint64_t min_cycles, size_t *codes2)
+{
+	ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(rate);
+	config.program = program;
+	config.end = ULPSOUND_END_HOLD;
+	ulp_harness_init(&harness);
+	ulp_sound_init_with_config(&ulp, &config);
+	bool done = ulp_harness_play(&harness, &ulp, samples, stream_words, len);
+	HOST_TEST_CHECK(done, "%s: stream did not end", program_names[program]);
+	ulp_sound_telemetry_t telemetry;
+	ulp_sound_get_telemetry(&ulp, &telemetry, false);
+	HOST_TEST_CHECK(telemetry.underruns == 0, "%s: %lu underruns", program_names[program], telemetry.underruns);
+	size_t count = ulp_harness_dac(&harness, 0, min_cycles, codes[0], TEST_MAX_CODES);
+	if (codes2 != NULL)
+		*codes2 = ulp_harness_dac(&harness, 1, min_cycles, codes[1], TEST_MAX_CODES);
+	ulp_harness_free(&harness);
+	return count;
+}
+
+// where expected starts in the codes, after the prefilled silence, len if it never does
+static size_t find(const uint8_t *played, size_t len, const uint8_t *expected, size_t stride)
+{
+	for (size_t start = 0; start + 32 <= len; start++)
+	{
+		size_t i = 0;
+		while ((i < 32) && (played[start + i] == expected[i * stride]))
+			i++;
+		if (i == 32)
+			return start;
+	}
+	return len;
+}
+
+// the codes from start on are expected, then the held last sample until the end
+static void check_played(ulp_sound_program_t program, uint8_t channel, const uint8_t *played, size_t len, const uint8_t *expected, size_t expected_len, size_t stride, bool inverted)
+{
+	uint8_t first[32];
+	for (size_t i = 0; i < 32; i++)
+		first[i] = inverted ? 0xFF - expected[i * stride] : expected[i * stride];
+	size_t start = find(played, len, first, 1);
+	HOST_TEST_CHECK(start < len, "%s DAC%u: stream not found", program_names[program], channel + 1);
+	if (start == len)
+		return;
+	HOST_TEST_CHECK(len - start >= expected_len, "%s DAC%u: %zu of %zu samples played", program_names[program], channel + 1, len - start, expected_len);
+	size_t mismatch = 0, first_mismatch = 0;
+	for (size_t i = 0; (i < expected_len) && (start + i < len); i++)
+	{
+		uint8_t sample = expected[i * stride];
+		if (played[start + i] != (inverted ? 0xFF - sample : sample))
+			if (mismatch++ == 0)
+				first_mismatch = i;
+	}
+	HOST_TEST_CHECK(mismatch == 0, "%s DAC%u: %zu samples differ, first at %zu", program_names[program], channel + 1, mismatch, first_mismatch);
+	uint8_t last = expected[(expected_len - 1) * stride];
+	if (inverted)
+		last = 0xFF - last;
+	size_t tail = 0;
+	for (size_t i = start + expected_len; i < len; i++)
+		tail += played[i] != last;
+	HOST_TEST_CHECK(tail == 0, "%s DAC%u: %zu codes after the end are not the held sample", program_names[program], channel + 1, tail);
+}
+
+static void test_byte_program(ulp_sound_program_t program, uint64_t min_cycles)
+{
+	size_t len2;
+	size_t len = play(program, TEST_RATE, NULL, TEST_SAMPLES, min_cycles, &len2);
+	switch (program)
+	{
+	case ULPSOUND_PROGRAM_STEREO:
+		check_played(program, 0, codes[0], len, samples, TEST_SAMPLES / 2, 2, false);
+		check_played(program, 1, codes[1], len2, samples + 1, TEST_SAMPLES / 2, 2, false);
+		break;
+	case ULPSOUND_PROGRAM_BRIDGED:
+		check_played(program, 0, codes[0], len, samples, TEST_SAMPLES / 2, 2, false);
+		check_played(program, 1, codes[1], len2, samples, TEST_SAMPLES / 2, 2, true);
+		break;
+	default:
+		check_played(program, 0, codes[0], len, samples, TEST_SAMPLES, 1, false);
+		HOST_TEST_CHECK(len2 == 0, "%s: %zu writes to DAC2", program_names[program], len2);
+		break;
+	}
+}
+
+// two writes per sample, the code and the code plus the ninth bit
+static void test_oversampled(void)
+{
+	static uint8_t expected[TEST_SAMPLES * 2];
+	for (size_t i = 0; i < TEST_SAMPLES; i++)
+	{
+		uint16_t code = samples[i] % 255; // below 255 while the fraction is set
+		uint16_t fraction = (i % 3 == 0) && (i != TEST_SAMPLES - 1); // the held end repeats one code
+		words[i] = code | fraction << 8;
+		expected[i * 2] = code;
+		expected[i * 2 + 1] = code + fraction;
+	}
+	size_t len = play(ULPSOUND_PROGRAM_OVERSAMPLED, TEST_RATE, words, TEST_SAMPLES, 0, NULL);
+	check_played(ULPSOUND_PROGRAM_OVERSAMPLED, 0, codes[0], len, expected, TEST_SAMPLES * 2, 1, false);
+}
+
+// DPCM is lossy, a signal that moves by the smallest step plays exactly
+static void test_dpcm(void)
+{
+	const ulp_sound_program_t program = ULPSOUND_PROGRAM_DPCM;
+	for (size_t i = 0; i < TEST_SAMPLES; i++)
+	{
+		int phase = i % 200; // triangle from midscale, 1 LSB per sample
+		samples[i] = 128 + ((phase < 50) ? phase : (phase < 150) ? 100 - phase : phase - 200);
+	}
+	size_t len = play(program, TEST_RATE, NULL, TEST_SAMPLES, 0, NULL);
+	// the stream starts where the codes leave the prefilled midscale
+	size_t start = 0;
+	while ((start < len) && (codes[0][start] == 0x80))
+		start++;
+	HOST_TEST_CHECK(len - start >= TEST_SAMPLES - 1, "%s: %zu of %u samples played", program_names[program], len - start, TEST_SAMPLES);
+	int worst = 0;
+	for (size_t i = 0; (i + 1 < TEST_SAMPLES) && (start + i < len); i++)
+	{
+		int error = abs(codes[0][start + i] - samples[i + 1]); // the first sample equals the midscale start
+		if (error > worst)
+			worst = error;
+	}
+	HOST_TEST_CHECK(worst == 0, "%s: off by up to %d", program_names[program], worst);
+}
+
+// 9 bit levels: the code and the code plus the fraction bit hold for half a sample each, the DAC output
+// averaged over time lands on the half LSB
+static void test_oversampled_level(uint16_t level)
+{
+	const ulp_sound_program_t program = ULPSOUND_PROGRAM_OVERSAMPLED;
+	ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(TEST_RATE);
+	config.program = program;
+	ulp_harness_init(&harness);
+	ulp_sound_init_with_config(&ulp, &config);
+	for (size_t i = 0; i < TEST_SAMPLES; i++)
+		words[i] = (level >> 1) | (level & 1) << 8;
+	bool done = ulp_harness_play(&harness, &ulp, NULL, words, TEST_SAMPLES);
+	HOST_TEST_CHECK(done, "%s: stream did not end", program_names[program]);
+
+	// the middle third of the writes is the stream, the prefill lap and the end are shorter
+	const size_t from = harness.writes_len / 3, to = harness.writes_len * 2 / 3;
+	double sum = 0;
+	for (size_t i = from; i < to; i++)
+		sum += harness.writes[i].value * (double)(harness.writes[i + 1].cycle - harness.writes[i].cycle);
+	double average = sum / (harness.writes[to].cycle - harness.writes[from].cycle);
+	HOST_TEST_CHECK(fabs(average - level / 2.0) < 0.01, "%s: level %u/2 averages to %.3f", program_names[program], level, average);
+	ulp_harness_free(&harness);
+}
+
+// I_DELAY rounds 8.5 MHz / 44.1 kHz by 1300 ppm, the dither pattern gets the average DAC period within one
+// of its 1/32 cycle steps per word, 80 ppm at 44.1 kHz, the recal ticks diffuse the rest. writes: DAC writes
+// per sample
+static void test_dither_rate(ulp_sound_program_t program, uint32_t rate, uint32_t writes)
+{
+	ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(rate);
+	config.program = program;
+	ulp_harness_init(&harness);
+	ulp_sound_init_with_config(&ulp, &config);
+	HOST_TEST_CHECK(ulp.delay_frac != 0, "%s at %luHz: no fraction to dither", program_names[program], rate);
+	for (size_t i = 0; i < TEST_SAMPLES; i++)
+		words[i] = 0x80;
+	bool oversampled = (program == ULPSOUND_PROGRAM_OVERSAMPLED);
+	HOST_TEST_CHECK(ulp_harness_play(&harness, &ulp, samples, oversampled ? words : NULL, TEST_SAMPLES), "%s at %luHz: stream did not end", program_names[program], rate);
+
+	// the prefill lap, the stream and the held end all play at the same rate, the middle of the DAC1
+	// writes spans whole pattern cycles of 32 words
+	uint64_t *cycles = malloc(harness.writes_len * sizeof(uint64_t));
+	size_t count = 0;
+	for (size_t i = 0; i < harness.writes_len; i++)
+		if (harness.writes[i].channel == 0)
+			cycles[count++] = harness.writes[i].cycle;
+	const size_t per_pattern = writes * (1 << ulp.index_shift) * 32;
+	const size_t span = count / 2 / per_pattern * per_pattern;
+	HOST_TEST_CHECK(span > 0, "%s at %luHz: %zu DAC writes", program_names[program], rate, count);
+	if (span > 0)
+	{
+		double period = (double)(cycles[count / 4 + span] - cycles[count / 4]) / span;
+		double ppm = (period * rate * writes / HOST_SHIM_RTC_FAST_HZ - 1) * 1e6;
+		double step_ppm = 1e6 / (period * per_pattern); // 1/32 cycle of a word
+		HOST_TEST_CHECK(fabs(ppm) < step_ppm, "%s at %luHz: average rate %.0f ppm off, a pattern step is %.0f ppm", program_names[program], rate, ppm, step_ppm);
+	}
+	free(cycles);
+	ulp_harness_free(&harness);
+}
+
+// a steady sine plays the rounded step at the rate the ULP runs, timed from its upward crossings of midscale
+static void test_tone_frequency(float freq_hz)
+{
+	const ulp_sound_program_t program = ULPSOUND_PROGRAM_TONE;
+	const ulp_sound_tone_t tone = {.freq_start_hz = freq_hz, .freq_end_hz = freq_hz, .duration_ms = 1000, .level = ULPSOUND_TONE_LEVELS - 1};
+	const ulp_sound_tone_config_t config = {.tones = &tone, .count = 1, .sampling_rate = TEST_RATE, .amp_shutdown_rtc_io = -1};
+	ulp_harness_init(&harness);
+	HOST_TEST_CHECK(ulp_sound_tone_load(&ulp, &config), "%s: %.1fHz does not load", program_names[program], freq_hz);
+	ulp_sound_tone_play();
+	ulp_harness_run(&harness, ulp_harness_cycles(&ulp, ulp.sampling_rate * 1.1));
+	HOST_TEST_CHECK(harness.emu.state == ULP_EMU_HALTED, "%s: %.1fHz still playing", program_names[program], freq_hz);
+
+	// the last write parks the DAC at midscale
+	const size_t len = harness.writes_len - 1;
+	uint32_t crossings = 0;
+	uint64_t first = 0, last = 0;
+	for (size_t i = 1; i < len; i++)
+		if ((harness.writes[i - 1].value < 0x80) && (harness.writes[i].value >= 0x80))
+		{
+			if (crossings++ == 0)
+				first = harness.writes[i].cycle;
+			last = harness.writes[i].cycle;
+		}
+	HOST_TEST_CHECK(crossings > 2, "%s: %.1fHz crosses midscale %u times", program_names[program], freq_hz, crossings);
+	if (crossings > 2)
+	{
+		// the rate the ULP runs at, ulp.sampling_rate is truncated to whole Hz
+		double rate = (double)(len - 1) * HOST_SHIM_RTC_FAST_HZ / (harness.writes[len - 1].cycle - harness.writes[0].cycle);
+		double played_hz = (double)(crossings - 1) * HOST_SHIM_RTC_FAST_HZ / (last - first);
+		double expected_hz = ulp_sound_tone_step(freq_hz, ulp.sampling_rate) * rate / 65536;
+		// a crossing lands on the sample after the phase passes the table entry, up to two samples late
+		double tolerance_hz = played_hz * 2 * HOST_SHIM_RTC_FAST_HZ / rate / (last - first);
+		HOST_TEST_CHECK(fabs(played_hz - expected_hz) < tolerance_hz, "%s: %.1fHz plays %.3fHz, %.3fHz expected", program_names[program], freq_hz, played_hz, expected_hz);
+		// the step rounds to 1/65536 of the rate, the rate it is taken from to 1 Hz
+		tolerance_hz += rate / 65536 / 2 + freq_hz / ulp.sampling_rate;
+		HOST_TEST_CHECK(fabs(played_hz - freq_hz) < tolerance_hz, "%s: %.1fHz plays %.3fHz", program_names[program], freq_hz, played_hz);
+	}
+	ulp_harness_free(&harness);
+}
+
+// codes from..to move towards the last one by steps of up to max_step, never back
+static bool ramps(const uint8_t *played, size_t from, size_t to, int max_step)
+{
+	int direction = (played[to] > played[from]) ? 1 : -1;
+	for (size_t i = from + 1; i <= to; i++)
+	{
+		int step = (played[i] - played[i - 1]) * direction;
+		if ((step < 0) || (step > max_step))
+			return false;
+	}
+	return true;
+}
+
+// PAIR with the amp ramp: up from code 0 at init, the stream, down to the end code after ulp_sound_stop(). The
+// position follows the DAC writes, one per sample, from the prefilled lap on
+static void test_end(ulp_sound_end_t end)
+{
+	const ulp_sound_program_t program = ULPSOUND_PROGRAM_PAIR;
+	const uint8_t level = 200, end_code = (end == ULPSOUND_END_FLOOR) ? 0 : 0x80;
+	ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(TEST_RATE);
+	config.program = program;
+	config.ramp_ms = 10;
+	config.end = end;
+	ulp_harness_init(&harness);
+	ulp_sound_init_with_config(&ulp, &config);
+	memset(samples, level, TEST_SAMPLES);
+	const uint64_t slice = ulp_harness_cycles(&ulp, ((uint64_t)ulp.buff_len << ulp.index_shift) / 3);
+	size_t done = 0;
+	uint32_t slices = 0;
+	int64_t worst_lead = 0, least_lead = INT64_MAX;
+	while ((done < TEST_SAMPLES) && (++slices < 1000))
+	{
+		ulp_harness_run(&harness, slice);
+		ulp_sound_get_buffer_diff(&ulp);
+		ulp_sound_position_t position;
+		ulp_sound_get_position(&ulp, &position);
+		int64_t lead = (int64_t)position.played - (int64_t)ulp_harness_dac(&harness, 0, 0, codes[0], TEST_MAX_CODES);
+		worst_lead = (lead > worst_lead) ? lead : worst_lead;
+		least_lead = (lead < least_lead) ? lead : least_lead;
+		done += ulp_sound_write(&ulp, samples + done, TEST_SAMPLES - done);
+	}
+	HOST_TEST_CHECK((least_lead >= 0) && (worst_lead <= 1), "%s: played leads the DAC by %lld..%lld samples", program_names[program], least_lead, worst_lead);
+	while (!ulp_sound_stop(&ulp) && (++slices < 1000))
+	{
+		ulp_harness_run(&harness, slice);
+		ulp_sound_get_buffer_diff(&ulp);
+	}
+	while (!ulp_sound_is_done(&ulp) && (++slices < 100000))
+		ulp_harness_run(&harness, slice / 8);
+	HOST_TEST_CHECK(ulp_sound_is_done(&ulp), "%s: stream did not end", program_names[program]);
+	ulp_sound_telemetry_t telemetry;
+	ulp_sound_get_telemetry(&ulp, &telemetry, false);
+	HOST_TEST_CHECK(telemetry.underruns == 0, "%s: %lu underruns", program_names[program], telemetry.underruns);
+
+	// 0 up to midscale, the stream, then down or over to the end code, no step larger than a raised cosine
+	// over ramp_ms takes
+	size_t len = ulp_harness_dac(&harness, 0, 0, codes[0], TEST_MAX_CODES);
+	size_t rise = 0;
+	while ((rise < len) && (codes[0][rise] != 0x80))
+		rise++;
+	size_t start = rise;
+	while ((start < len) && (codes[0][start] != level))
+		start++;
+	size_t stop = start;
+	while ((stop < len) && (codes[0][stop] == level))
+		stop++;
+	HOST_TEST_CHECK(len > 0 && codes[0][0] < 8 && rise < start && start < stop && stop < len, "%s: no ramp, stream and end in %zu codes", program_names[program], len);
+	if (!(len > 0 && codes[0][0] < 8 && rise < start && start < stop && stop < len))
+		return;
+	const int max_step = 4;
+	HOST_TEST_CHECK(ramps(codes[0], 0, rise, max_step), "%s: init ramp steps", program_names[program]);
+	HOST_TEST_CHECK(stop - start >= TEST_SAMPLES, "%s: %zu of %u samples", program_names[program], stop - start, TEST_SAMPLES);
+	HOST_TEST_CHECK(ramps(codes[0], stop - 1, len - 1, max_step), "%s: end ramp steps", program_names[program]);
+	HOST_TEST_CHECK(codes[0][len - 1] == end_code, "%s: ends at %u, not %u", program_names[program], codes[0][len - 1], end_code);
+	ulp_harness_free(&harness);
+}
+
+// which curve played each code, 0 identity, 1 inverted, -1 neither
+static void classify(const uint8_t *played, size_t len, const uint8_t *expected, size_t stride, int8_t *curves)
+{
+	for (size_t i = 0; i < len; i++)
+	{
+		uint8_t sample = expected[i * stride];
+		curves[i] = (played[i] == sample) ? 0 : ((played[i] == 0xFF - sample) ? 1 : -1);
+	}
+}
+
+// swaps the curve mid-stream at different phases of the word, every word or frame plays through one curve
+static void test_curve_swap(ulp_sound_program_t program)
+{
+	static uint8_t inverted[256];
+	static int8_t curves[2][TEST_SAMPLES];
+	for (size_t i = 0; i < 256; i++)
+		inverted[i] = 0xFF - i;
+	const bool stereo = (program == ULPSOUND_PROGRAM_STEREO);
+	const size_t stride = stereo ? 2 : 1;
+	const size_t len = TEST_SAMPLES / stride;
+
+	ulp_sound_config_t config = ULPSOUND_DEFAULT_CONFIG(TEST_RATE);
+	config.program = program;
+	ulp_harness_init(&harness);
+	ulp_sound_init_with_config(&ulp, &config);
+	const size_t lap = ((size_t)ulp.buff_len << ulp.index_shift) * stride; // samples of both channels
+	const uint64_t slice = ulp_harness_cycles(&ulp, lap / 16);
+	size_t done = 0;
+	uint32_t swaps = 0, parked_windows = 0;
+	ulp_sound_recal_start(&ulp);
+	while (done < TEST_SAMPLES)
+	{
+		ulp_harness_run(&harness, slice);
+		host_shim_timer_fire(ulp.recal_timer);
+		ulp_sound_get_buffer_diff(&ulp);
+		done += ulp_sound_write(&ulp, samples + done, TEST_SAMPLES - done);
+		// the ULP plays a lap behind the writes, the start of the stream goes out with the identity
+		if (done < lap + 64)
+			continue;
+		ulp_harness_run(&harness, rand() % 200);
+		ulp_sound_set_curve(&ulp, (++swaps % 2) ? inverted : NULL);
+		// the park is no slow clock, the recal window starts after it
+		parked_windows += !ulp.recal_running || (ulp.clock.window_us != 0) || (ulp.recal_last_us != esp_timer_get_time());
+	}
+	ulp_sound_recal_stop(&ulp);
+	ulp_harness_run(&harness, ulp_harness_cycles(&ulp, TEST_SAMPLES));
+	ulp_sound_set_curve(&ulp, NULL);
+	HOST_TEST_CHECK(parked_windows == 0, "%s: %u of %u swaps left the park in the recal window", program_names[program], parked_windows, swaps);
+
+	size_t played_len[2], start[2];
+	for (uint8_t channel = 0; channel < stride; channel++)
+	{
+		played_len[channel] = ulp_harness_dac(&harness, channel, 0, codes[channel], TEST_MAX_CODES);
+		start[channel] = find(codes[channel], played_len[channel], samples + channel, stride);
+		HOST_TEST_CHECK((start[channel] < played_len[channel]) && (played_len[channel] - start[channel] >= len), "%s DAC%u: stream not found", program_names[program], channel + 1);
+		if ((start[channel] == played_len[channel]) || (played_len[channel] - start[channel] < len))
+			return;
+		classify(codes[channel] + start[channel], len, samples + channel, stride, curves[channel]);
+	}
+
+	uint32_t changes = 0, torn = 0, neither = 0;
+	for (size_t i = 0; i < len; i++)
+	{
+		neither += (curves[0][i] < 0) || (stereo && (curves[1][i] < 0));
+		if (stereo && (curves[0][i] != curves[1][i]))
+			torn++;
+		if ((i > 0) && (curves[0][i] != curves[0][i - 1]))
+		{
+			changes++;
+			// PAIR switches between the two samples of a word only
+			if (!stereo && (i % 2 != 0))
+				torn++;
+		}
+	}
+	HOST_TEST_CHECK(neither == 0, "%s: %u codes from neither curve", program_names[program], neither);
+	HOST_TEST_CHECK(changes >= 8, "%s: %u of %u swaps played", program_names[program], changes, swaps);
+	HOST_TEST_CHECK(torn == 0, "%s: %u words play both curves", program_names[program], torn);
+	ulp_harness_free(&harness);
+}
+
+int main(void)
+{
+	srand(1);
+	const ulp_sound_program_t byte_programs[] = {ULPSOUND_PROGRAM_SINGLE, ULPSOUND_PROGRAM_PAIR, ULPSOUND_PROGRAM_STEREO, ULPSOUND_PROGRAM_BRIDGED, ULPSOUND_PROGRAM_COMPACT};
+	for (size_t p = 0; p < sizeof(byte_programs) / sizeof(byte_programs[0]); p++)
+	{
+		for (size_t i = 0; i < TEST_SAMPLES; i++)
+			samples[i] = rand();
+		if (byte_programs[p] == ULPSOUND_PROGRAM_BRIDGED)
+			for (size_t i = 0; i < TEST_SAMPLES; i += 2)
+				samples[i + 1] = samples[i];
+		test_byte_program(byte_programs[p], (byte_programs[p] == ULPSOUND_PROGRAM_COMPACT) ? TEST_NIBBLE_CYCLES : 0);
+	}
+	for (size_t i = 0; i < TEST_SAMPLES; i++)
+		samples[i] = rand();
+	test_curve_swap(ULPSOUND_PROGRAM_PAIR);
+	test_curve_swap(ULPSOUND_PROGRAM_STEREO);
+	test_dither_rate(ULPSOUND_PROGRAM_PAIR, 44100, 1);
+	test_dither_rate(ULPSOUND_PROGRAM_COMPACT, 22050, 2);
+	test_dither_rate(ULPSOUND_PROGRAM_OVERSAMPLED, 22050, 2);
+	test_oversampled();
+	const uint16_t levels[] = {1, 2, 127, 256, 257, 509};
+	for (size_t i = 0; i < sizeof(levels) / sizeof(levels[0]); i++)
+		test_oversampled_level(levels[i]);
+	test_dpcm();
+	test_end(ULPSOUND_END_FLOOR);
+	test_end(ULPSOUND_END_MIDSCALE);
+	const float tones[] = {261.63f, 440.0f, 1000.0f, 3150.7f};
+	for (size_t i = 0; i < sizeof(tones) / sizeof(tones[0]); i++)
+		test_tone_frequency(tones[i]);
+	return host_test_result();
+}